@@ -22,6 +22,7 @@
 #include "stroke.h"
 
 #include "errors.h"
+#include "zone.h"
 
 #include <libgeneral/error.h>
 
@@ -32,8 +33,8 @@
 #include <errno.h>
 #include <unistd.h>
 #include <limits.h>
-#include <libgen.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 
@@ -41,14 +42,15 @@
  * Globals *
  ***********/
 
-static const char *wdays[] =
+const char *wdays[] =
 	{"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
 
-/* Ranges for time value validation */
-static VALUE_BOUNDS bounds = {
-	/* year, month, day, hour, minute, second, dst, week day */
-	{1899, 2101}, {0, 13}, {0, 32}, {-1, 24}, {-1, 60}, {-1, 60}, {-1, 3}, {-1, 7}
-};
+/* System calls made on behalf of files */
+unsigned long syscall_count;
+
+/* Serializes process-wide side effects against file operations */
+static pthread_rwlock_t fileop_rwlock;
+static pthread_once_t fileop_once = PTHREAD_ONCE_INIT;
 
 /*******************************
  * General auxiliary functions *
@@ -92,394 +94,231 @@ inline GENERAL_BOOL isnum(const char *str)
 }
 
 /*
- * Returned current cwd using new_str().
- * Return NULL on failure, a pointer on success.
+ * Initialize the lock behind fileop_lock(); writers are preferred
+ * so that a pending clock excursion is not starved by a steady
+ * stream of file operations.
  */
-static char* scwd()
+static void fileop_lock_init()
 {
-#ifdef HAVE_GETCWD
-	char buf[PATH_MAX];
-	if(!getcwd(buf, sizeof buf))
-		return NULL;
-	return new_str(buf);
-#else
-	char *pwd;
-	if(!(pwd = getenv("PWD")))
-		return NULL;
-	return new_str(pwd);
+	pthread_rwlockattr_t attr;
+
+	pthread_rwlockattr_init(&attr);
+#ifdef PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
+	pthread_rwlock_init(&fileop_rwlock, &attr);
+	pthread_rwlockattr_destroy(&attr);
 }
+
 /*
- * Set the modification and access time of a symbolic link.
- * Linux does not have the lutime() system call by default
- * which is a why a hack using utimensat() is used here.
- * However, utimens() is only present on more recent
- * versions of Linux.
- * This function returns the exit status lutime(),
- * utimensat(), or utime() respectively or -1 if
- * a general error occurred.
+ * Enter a section of file operations. Work on a single file
+ * is done in a shared section; anything that changes state of
+ * the whole process and therefore affects other files being
+ * worked on (stepping the system clock) requires an exclusive one.
  */
-int
-lutime_symlink(const char *filename, const struct utimbuf *times)
+void
+fileop_lock(GENERAL_BOOL exclusive)
 {
-	verbose(1, "Altering symbolic link if one");
-	
-#if defined(HAVE_LUTIME)
-	return lutime(filename, times);
-#elif defined(HAVE_UTIMENSAT)
-	
-	char *cwd = NULL;
-	int retv;
-	struct timespec ts[2] = {
-		{times->actime, 0},
-		{times->modtime, 0}
-	};
-	
-	if(!(cwd = scwd(cwd)) ||
-	   chdir(dirname(new_str(filename))) < 0)
-		goto error;
-	
-	retv = utimensat(AT_FDCWD, basename(new_str(filename)), ts, AT_SYMLINK_NOFOLLOW);
-
-	if(chdir(cwd) < 0)
-		goto error;
-
-	return retv;
-
- error:
-	error_out(ERROR_ERROR_UTIMSYM, errno, FLN, filename);
-	return -1;
-	
-#else
-# warning lutime() or utimensat() missing; will not be able to set atime or mtime of symlink 
-	return utime(filename, times);
-#endif
+	pthread_once(&fileop_once, &fileop_lock_init);
+	if(exclusive)
+		pthread_rwlock_wrlock(&fileop_rwlock);
+	else
+		pthread_rwlock_rdlock(&fileop_rwlock);
 }
 
 /*
- * Similiar to access(). Only checks whether pathname
- * is a symlink exclusively. If so, 0 is returned
- * otherwise -1.
- * If link is a dangling symlink return LDANGLING.
+ * Leave a section entered by fileop_lock().
  */
-int
-laccess(const char *pathname, int mode)
+void
+fileop_unlock(void)
 {
-	/* Fixme:
-	 * This function is intrinsically faulty, as pathname might
-	 * still exist, however, lstat() fails as read permissions
-	 * are denied.
-	 * On the other hand, I know of no nice way to
-	 * check whether a symlink exists as it is or not.
-	 * Note that the mode field of this function is ignored
-	 * altogether; F_OK may be given simply for readability.
-	 */
-	struct stat buf;
-	
-	if((lstat(pathname, &buf) < 0 ||
-	    !S_ISLNK(buf.st_mode)))
-		return -1;
-
-	return !access(pathname, F_OK) ? 0 : LDANGLING;
+	pthread_rwlock_unlock(&fileop_rwlock);
 }
 
 /*
- * If file refers to a regular file that name
- * is returned. In case file refers to a
- * symbolic link, the name of the file pointed
- * to is returned. String returned is new_str()'d
- * in case of a symlink, otherwise it's just file.
- * NULL is returned on error.
+ * Reset a file context to its initial state.
  */
-const char*
-realname(const char *file)
+void
+file_ctx_init(struct file_ctx *ctx)
 {
-	char lnk[PATH_MAX];
-	struct stat st;
-	ssize_t lbyt;
-
-	if(lstat(file, &st) < 0)
-		return NULL;
-
-	if(S_ISLNK(st.st_mode)) {
-		if((lbyt = readlink(file, lnk, sizeof lnk)) < 0)
-			return NULL;
-		lnk[lbyt] = 0;
-		return (const char*)new_str(lnk);
-	} 
-
-	return file;
+	memset(ctx->times, 0, sizeof ctx->times);
+	ctx->flags = 0;
+	ctx->fd = -1;
+	ctx->probe = NULL;
+	ctx->pos = 0;
 }
 
-
-/*********************************
- * Specific auxiliariy functions *
- *********************************/
-
 /*
- * Convert FILE_TIME table to fill `struct utimbuf' as used by utime()
- * and lutime().
- * Note that utimbuf does not contain a field for ctime.
- * Returns 0 on success, -1 on failure.
+ * Release the resources held by a file context.
  */
-int
-ft_to_utimbuf(FILE_TIMES time_vals, struct utimbuf *ut)
+void
+file_ctx_release(struct file_ctx *ctx)
 {
-	struct tm tm;
-
-	memset(&tm, 0, sizeof(struct tm));
-	
-	translate(&tm, time_vals, MTIME, TO_TM);
-	if((ut->modtime = mktime(&tm)) < 0) goto error;
-
-	translate(&tm, time_vals, ATIME, TO_TM);
-	if((ut->actime = mktime(&tm)) < 0) goto error;
-
-	return 0;
- error:
-	error_out(ERROR_ERROR_TSTMP, 0, FLN);
-	return -1;
+	if(ctx->fd >= 0)
+		SC(close(ctx->fd));
+	ctx->fd = -1;
 }
 
 /*
- * Validate a time_vals structure for what is logically feasable as date.
- * Returns 0 upon successful validation, -1 otherwise.
+ * Read the target of symbolic link name, relative to dirfd, into
+ * the link buffer of p; it is left empty if that fails.
  */
-int
-validate_times(FILE_TIMES time_vals)
+static void
+probe_readlink(struct file_probe *p, int dirfd, const char *name)
 {
-	register int j;
-	int t;
+	ssize_t len;
 
-	if(CHKF(FORCE))
-		return 0;
+	if((len = SC(readlinkat(dirfd, name, p->link, sizeof p->link - 1))) < 0)
+		len = 0;
+	p->link[len] = 0;
+}
 
-	for(t = 0; t < TIME_TBLS; t++) {
-		for(j = 0; j < TIME_VALS-1; j++) {
-			if(!validate(time_vals[t][j].name, time_vals[t][j].val))
-				goto error;
-		}
+/*
+ * Complete a probe whose lstat() part (lst, lerr) is filled in: a
+ * file that is no symbolic link is described by it alone, for a
+ * link its target and what it points to are looked up as well.
+ */
+void
+probe_resolve(struct file_probe *p, int dirfd, const char *name)
+{
+	*p->link = 0;
 
-		struct tm tm = {0};
-		translate(&tm, time_vals, t, TO_TM);
-		struct tm original = tm;
-		if(mktime(&tm) == (time_t)-1)
-			goto error;
-		if(original.tm_year != tm.tm_year ||
-		   original.tm_mon  != tm.tm_mon  ||
-		   original.tm_mday != tm.tm_mday)
-			goto error;
+	if(p->lerr || !S_ISLNK(p->lst.st_mode)) {
+		p->st = p->lst;
+		p->err = p->lerr;
+		return;
 	}
 
-	return 0;
-
-error:
-	error_out(ERROR_ERROR_VALDAT, 0, FLN, tv_to_str(time_vals, t));
-	return -1;
+	probe_readlink(p, dirfd, name);
+	p->err = SC(fstatat(dirfd, name, &p->st, 0)) < 0 ? errno : 0;
 }
 
 /*
- * Change a file's ctime according to the values set in
- * time_vals array passed.
- * As ctime cannot be directly modified a trick is used:
- * the system clock is reset to the desired ctime,
- * then a chmod() or fopen(..., "w") call is performed
- * which alteres the ctime as desired.
- * Note that CAP_SYS_TIME capability is required under
- * linux, which, by default, is only masked to root.
- * I guess other systems handle this similarily.
- * Returns 0 on success, -1 on failure.
+ * Look up file name, relative to dirfd, once and keep everything
+ * later stages need to know about it in p. This costs a single
+ * lstat(); only symbolic links need a readlink() and a stat() of
+ * what they point to on top of it.
  */
-int
-mod_ctime(FILE_TIME (*time_vals)[], const char *file)
+void
+probe_lookup(struct file_probe *p, int dirfd, const char *name)
 {
-	int (*statf)(const char*, struct stat*);
-	int (*chmodf)(const char *, mode_t);
-	struct timeval current, elapsed = {0, 0}, ctime = {0, 0};
-	struct stat st;
-	struct tm tm;
-	
-	verbose(1, "Attempting to %s change time",
-		CHKF(CTPRES) ? "preserve" : "modify");
-
-	memset(&tm, 0, sizeof tm);
-	translate(&tm, time_vals, CTIME, TO_TM);
+	p->lerr = SC(fstatat(dirfd, name, &p->lst, AT_SYMLINK_NOFOLLOW)) < 0 ? errno : 0;
+	probe_resolve(p, dirfd, name);
+}
 
-	if(gettimeofday(&current, NULL) < 0)
-		goto error;
+#ifdef O_PATH
+/*
+ * As probe_lookup(), but the file is also left open (O_PATH) as *fd
+ * so that it can be worked on without resolving name again; with
+ * nofollow a symbolic link itself, otherwise what it points to. *fd
+ * is -1 if there is no such file.
+ */
+void
+probe_open(struct file_probe *p, int dirfd, const char *name,
+	   GENERAL_BOOL nofollow, int *fd)
+{
+	int lfd;
 
-	if((ctime.tv_sec = mktime(&tm)) < 0)
-		goto error;
+	*p->link = 0;
+	*fd = -1;
 
-	statf = CHKF(SYMLINKS) ? &lstat : &stat;
+	if((lfd = SC(openat(dirfd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC))) < 0 ||
+	   SC(fstat(lfd, &p->lst)) < 0) {
+		p->lerr = p->err = errno;
+		if(lfd >= 0)
+			SC(close(lfd));
+		return;
+	}
+	p->lerr = 0;
 
-	if((*statf)(file, &st) < 0)
-		goto error;
-		
-#ifdef HAVE_LCHMOD
-	chmodf = CHKF(SYMLINKS) ? &lchmod : &chmod;
-#else
-#warning Will not be able to alter ctime of symbolic links
-	chmodf = &chmod;
-#endif
-	
-	/*
-	 * Note: Beware clock skews; hence use of timer()
-	 */
-	
-	/* set to ctime, change file, set back to current time */
-	if(settimeofday(&ctime, NULL))
-		goto error;
-
-	(void)timer(NULL);
-
-	if((*chmodf)(file, st.st_mode))
-		goto error;
-
-	(void)timer(&elapsed);
-
-	/* Fixme: Adding seconds too slow/unnecessary? */
-	current.tv_usec += elapsed.tv_usec;
-	current.tv_sec += elapsed.tv_sec;
-	
-	if(settimeofday(&current, NULL))
-		goto error;
-	
-	return 0;
+	if(!S_ISLNK(p->lst.st_mode)) {
+		p->st = p->lst;
+		p->err = 0;
+		*fd = lfd;
+		return;
+	}
 
- error:
-	error_out(ERROR_ERROR_CHCTIME, errno, FLN, file,
-		  IFSTR(geteuid(), "Root privileges might be required."));
-	return -1;
-}
+	probe_readlink(p, lfd, "");
+	if(nofollow) {
+		*fd = lfd;
+		p->err = SC(fstatat(dirfd, name, &p->st, 0)) < 0 ? errno : 0;
+		return;
+	}
 
-/*
- * Maps the string representation of time_values to
- * enum constants that represent indices within the time_vals array.
- */
-static inline int
-value_mapping(const char *name)
-{
-	switch(*++name) {
-		case 'Y': return YEAR; break;
-		case 'M': return MON; break;
-		case 'D': return DAY; break;
-		case 'h': return HOUR; break;
-		case 'm': return MIN; break;
-		case 's': return SEC; break;
-		case 'l': return DST; break;
+	SC(close(lfd));
+	if((*fd = SC(openat(dirfd, name, O_PATH | O_CLOEXEC))) < 0 ||
+	   SC(fstat(*fd, &p->st)) < 0) {
+		p->err = errno;
+		if(*fd >= 0)
+			SC(close(*fd));
+		*fd = -1;
+		return;
 	}
-	return -1;
+	p->err = 0;
 }
+#endif
 
+/*********************************
+ * Specific auxiliariy functions *
+ *********************************/
 
 /*
- * Returns TRUE if all time values within the time_vals struct could successfully be
- * validated - syntactically and logically that is. Returns FALSE otherwise.
+ * Validate the times array for what is logically feasable as date.
+ * Returns 0 upon successful validation, -1 otherwise.
  */
-GENERAL_BOOL
-validate(const char *name, int val)
+int
+validate_times(const struct timespec *times)
 {
-	int time_map;
+	int t;
 
 	if(CHKF(FORCE))
-		return TRUE;
-	if(!name || strlen(name) != 2)
-		return FALSE;
-	if((time_map = value_mapping(name)) < 0)
-		return FALSE;
-
-	return (bounds[time_map].lower < val && bounds[time_map].upper > val);
-}
+		return 0;
 
-/*
- * Translate between standard time structue `struct tm' and FILE_TIME array as used by stroke.
- */
-void
-translate(struct tm *tm, FILE_TIMES ft, int mactime, GENERAL_BOOL to_file_time) 
-{
-	if(to_file_time) {
-		ft[mactime][YEAR].val = tm->tm_year + YEAR_BASE;
-		ft[mactime][MON].val = tm->tm_mon + MON_BASE;
-		ft[mactime][DAY].val = tm->tm_mday;
-		ft[mactime][HOUR].val = tm->tm_hour;
-		ft[mactime][MIN].val = tm->tm_min;
-		ft[mactime][SEC].val = tm->tm_sec;
-		ft[mactime][DST].val = tm->tm_isdst + DST_BASE;
-		ft[mactime][WKD].val = tm->tm_wday;
-	} else {
-		tm->tm_year = ft[mactime][YEAR].val - YEAR_BASE;
-		tm->tm_mon = ft[mactime][MON].val - MON_BASE;
-		tm->tm_mday = ft[mactime][DAY].val;
-		tm->tm_hour = ft[mactime][HOUR].val;
-		tm->tm_min = ft[mactime][MIN].val;
-		tm->tm_sec = ft[mactime][SEC].val;
-		tm->tm_isdst = ft[mactime][DST].val - DST_BASE;
+	for(t = 0; t < TIME_TBLS; t++) {
+		if((long long)times[t].tv_sec < TIME_MIN ||
+		   (long long)times[t].tv_sec > TIME_MAX ||
+		   times[t].tv_nsec < 0 || times[t].tv_nsec >= 1000000000L) {
+			char stamp[128];
+			error_out(ERROR_ERROR_VALDAT, 0, FLN,
+				  ts_to_str(&times[t], stamp, sizeof stamp));
+			return -1;
+		}
 	}
+
+	return 0;
 }
 
 /*
- * Make string representation of time_vals date entry.
+ * Make string representation of time stamp ts, in local
+ * time, in buf of size len. Returns buf.
  */
 char*
-tv_to_str(FILE_TIMES time_vals, int t)
+ts_to_str(const struct timespec *ts, char *buf, size_t len)
 {
-	char dbuf[128];
-	sprintf(dbuf, DATE_FORMAT);
-	return new_str(dbuf);
-}
-
+	time_t sec = ts->tv_sec;
+	struct tm tm;
 
-/*
- * Look at first character of time value identifier name and return
- * symbolic representation of array index.
- */
-inline int
-tstr(const char *tname)
-{
-	switch(*tname) {
-		case 'm': return MTIME; break;
-		case 'a': return ATIME; break;	
-		case 'c': return CTIME; break;
-	}	
-	return -1;
+	if(zone_localtime(sec, &tm) < 0 && !localtime_r(&sec, &tm)) {
+		snprintf(buf, len, "@%lld", (long long)sec);
+		return buf;
+	}
+	snprintf(buf, len, DATE_FORMAT);
+	return buf;
 }
 
 /*
- * Attempts to find entry in time_vals table given by its name.
- * If lookup is TRUE the value found will be written to *val,
- * if lookup is FALSE the value pointed to by val will be written
- * to the time_vals table.
- * Returns 0 on success, -1 on failure (equivalent to identifier
- * not found). Also, may return -2 if ctime preservation was opted
- * for (`-preserve'), but ctime changes were attempted herein.
+ * Make string representation of time i of batch b, converted by
+ * zone_localtime_batch(), as ts_to_str() does. Returns buf.
  */
-int
-times_mod(FILE_TIMES time_vals, const char *name, int *val, GENERAL_BOOL lookup)
+char*
+zone_batch_str(const struct zone_batch *b, size_t i, char *buf, size_t len)
 {
-	int times_tbl, i;
-	FILE_TIME *tbl;
-
-	if(*name == 'c') {
-		if(CHKF(CTPRES)) {
-			error_out(ERROR_ERROR_CTCHPR, 0, FLN);
-			return -2;
-		} else SETF(CTAPPLY);
-	}
-	
-	if((times_tbl = tstr(name)) < 0) return -1;
-
-	tbl = *(time_vals + times_tbl);
-
-	for(i = 0; i < TIME_VALS-1; i++) {
-		if(!strcmp(tbl[i].name, name)) {
-			if(lookup) 
-				*val = tbl[i].val;
-			else
-				tbl[i].val = *val;
-			return 0;
-		}
+	struct tm tm;
+
+	if(zone_batch_tm(b, i, &tm) < 0) {
+		snprintf(buf, len, "@%lld", b->t[i]);
+		return buf;
 	}
-	
-	return -1;
+	snprintf(buf, len, DATE_FORMAT);
+	return buf;
 }
@@ -0,0 +1,106 @@
+/*
+ *      bench-literal.c - Benchmark of literal time stamp parsing
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * Compares how many time stamps per second the SPEC grammar and
+ * literal_parse() convert, for the forms literal_parse() knows:
+ *
+ *   make -C src bench
+ *
+ * runs it in Europe/Berlin; set TZ and run ./bench-literal directly
+ * for other zones. The grammar is called the way spec_eval() calls
+ * it on a cache miss.
+ */
+
+#include "stroke.h"
+#include "literal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <parse-datetime.h>
+
+/* Conversions timed per form and parser */
+#define BENCH_ROUNDS 200000
+
+static const char *samples[] = {
+	"@1700000000",
+	"@1700000000.123456789",
+	"2024-01-01T12:00:00Z",
+	"2024-06-15 08:30:45.5+02:00",
+	"2023-03-12T02:30:00",
+	"2024-01-01",
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+	const char *tzstring = getenv("TZ");
+	struct timespec base, ts;
+	double t0, grammar, literal;
+	timezone_t tz;
+	size_t i, len;
+	long n;
+
+	clock_gettime(CLOCK_REALTIME, &base);
+	if(!(tz = tzalloc(tzstring))) {
+		fprintf(stderr, "bench-literal: cannot set up time zone\n");
+		return 1;
+	}
+
+	printf("Literals parsed per second, TZ=%s, grammar vs literal:\n\n",
+	       tzstring ? tzstring : "(unset)");
+	for(i = 0; i < sizeof samples / sizeof *samples; i++) {
+		len = strlen(samples[i]);
+
+		if(!literal_parse(samples[i], len, &ts, FALSE)) {
+			printf("  %-30s not a literal\n", samples[i]);
+			continue;
+		}
+
+		t0 = now();
+		for(n = 0; n < BENCH_ROUNDS; n++)
+			parse_datetime2(&ts, samples[i], &base, 0, tz, tzstring);
+		grammar = BENCH_ROUNDS / (now() - t0);
+
+		t0 = now();
+		for(n = 0; n < BENCH_ROUNDS; n++)
+			literal_parse(samples[i], len, &ts, FALSE);
+		literal = BENCH_ROUNDS / (now() - t0);
+
+		printf("  %-30s %6.2fM %6.2fM  (%.0fx)\n", samples[i],
+		       grammar / 1e6, literal / 1e6, literal / grammar);
+	}
+
+	tzfree(tz);
+	return 0;
+}
@@ -0,0 +1,537 @@
+/*
+ *      clockstep.c - Batched change time updates for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "stroke.h"
+#include "clockstep.h"
+#include "errors.h"
+#include "stats.h"
+
+#include <libgeneral/error.h>
+#include <libgeneral/arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+/*
+ * The change time of a file cannot be set directly; the kernel
+ * takes it from the system clock whenever the inode changes. So
+ * the clock is stepped to the wanted time, the file is touched by
+ * a chmod() to its own mode, and the clock is stepped back. This
+ * needs the CAP_SYS_TIME capability, which by default only root has.
+ *
+ * Every step disturbs whatever else runs on the host, so instead
+ * of one excursion per file all pending updates are collected,
+ * sorted by target time and applied in a single excursion. The
+ * clock is only stepped again once it is more than half of
+ * CTIME_SLACK away from the next target: files sharing a target
+ * share a step, and a run over many files takes a handful of steps
+ * instead of two per file.
+ *
+ * A file is not looked up by its path again when the batch is
+ * flushed, which may be long after: each update keeps the file
+ * open, or else its directory, and touches it through that.
+ *
+ * While the clock is away, signals that would end the process are
+ * held off: the thread stepping the clock blocks them, and any
+ * other thread only notes them. The clock is set back before they
+ * take effect. It is also set back whenever it has been away for
+ * CLOCKSTEP_AWAY_MAX, however many files are still pending, and
+ * stepped again for the rest.
+ */
+
+/* Number of updates collected before they are applied regardless */
+#define CLOCKSTEP_BATCH 65536
+
+/* Longest time in nanoseconds the clock stays away in one piece */
+#define CLOCKSTEP_AWAY_MAX 200000000LL
+
+/* Arena chunk size for the paths of the updates */
+#define CLOCKSTEP_PATHS_CHUNK (64 * 1024)
+
+/* One pending update */
+struct clockstep_entry {
+	struct timespec ts;
+	const char *path;	/* As shown to the user */
+	const char *name;	/* Relative to dirfd; with fd -1 only */
+	int fd;			/* The file itself, or -1 */
+	int dirfd;		/* Its directory, AT_FDCWD or -1 */
+	mode_t mode;
+	GENERAL_BOOL nofollow;
+	int err;		/* errno the update failed with, or 0 */
+	void *data;
+};
+
+struct clockstep {
+	pthread_mutex_t lock;
+	struct clockstep_entry *entries;
+	size_t count;
+	size_t size;
+	size_t max;          /* Updates in a full batch */
+	ARENA *paths;        /* Paths of the entries; reset on flush */
+	CLOCKSTEP_DONE done;
+	void *arg;
+
+	/* Totals over all batches */
+	unsigned long steps;
+	struct timespec displaced;
+};
+
+/* Signals held off while the clock is away */
+static const int held_signals[] = {SIGHUP, SIGINT, SIGQUIT, SIGTERM};
+
+#define HELD_SIGNALS (sizeof held_signals / sizeof *held_signals)
+
+/* A held off signal caught by another thread, or 0 */
+static volatile sig_atomic_t caught;
+
+static long long
+ts_diff(const struct timespec *a, const struct timespec *b)
+{
+	return (long long)(a->tv_sec - b->tv_sec) * 1000000000LL +
+		(a->tv_nsec - b->tv_nsec);
+}
+
+static long long
+ts_ns(const struct timespec *ts)
+{
+	return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void
+ts_add_ns(struct timespec *ts, long long ns)
+{
+	ns += ts->tv_nsec;
+	ts->tv_sec += ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+	if(ts->tv_nsec < 0) {
+		ts->tv_nsec += 1000000000L;
+		--ts->tv_sec;
+	}
+}
+
+static int
+entry_cmp(const void *a, const void *b)
+{
+	const struct clockstep_entry *x = a, *y = b;
+	long long d = ts_diff(&x->ts, &y->ts);
+
+	return d < 0 ? -1 : d > 0;
+}
+
+static void
+signal_note(int sig)
+{
+	caught = sig;
+}
+
+/*
+ * Hold off the signals in held_signals: they are blocked in the
+ * calling thread and only noted by the others. Signals ignored are
+ * left alone. Their previous handling is saved in old and the
+ * previous signal mask of the thread in mask.
+ */
+static void
+signals_hold(struct sigaction old[HELD_SIGNALS], sigset_t *mask)
+{
+	struct sigaction sa;
+	sigset_t set;
+	size_t i;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = &signal_note;
+	sigemptyset(&sa.sa_mask);
+	sigemptyset(&set);
+
+	for(i = 0; i < HELD_SIGNALS; i++) {
+		sigaddset(&set, held_signals[i]);
+		sigaction(held_signals[i], NULL, &old[i]);
+		if(old[i].sa_handler != SIG_IGN)
+			sigaction(held_signals[i], &sa, NULL);
+	}
+	pthread_sigmask(SIG_BLOCK, &set, mask);
+}
+
+/*
+ * Undo signals_hold(); a signal that arrived in the meantime takes
+ * effect now.
+ */
+static void
+signals_release(const struct sigaction old[HELD_SIGNALS], const sigset_t *mask)
+{
+	size_t i;
+	int sig;
+
+	for(i = 0; i < HELD_SIGNALS; i++)
+		sigaction(held_signals[i], &old[i], NULL);
+	pthread_sigmask(SIG_SETMASK, mask, NULL);
+
+	if((sig = caught)) {
+		caught = 0;
+		raise(sig);
+	}
+}
+
+/*
+ * Set the clock back to real plus the time elapsed since start on
+ * the monotonic clock, ending an excursion of c.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+clock_back(struct clockstep *c, const struct timespec *real,
+	   const struct timespec *start)
+{
+	struct timespec end, back = *real;
+	long long elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = ts_diff(&end, start);
+	if(stats_on || trace_on)
+		stats_phase(PHASE_CTIME, ts_ns(start), ts_ns(&end), 1);
+	ts_add_ns(&back, elapsed);
+	ts_add_ns(&c->displaced, elapsed);
+
+	if(SC(clock_settime(CLOCK_REALTIME, &back)) < 0) {
+		error_out(ERROR_ERROR_CHCTIME, errno, FLN, "-",
+			  "Could not set the system clock back.");
+		return -1;
+	}
+	++c->steps;
+
+	return 0;
+}
+
+/*
+ * Note the updates of c from entry from on as failed with errno err.
+ */
+static void
+entries_failed(struct clockstep *c, size_t from, int err)
+{
+	for(; from < c->count; from++)
+		c->entries[from].err = err;
+}
+
+/*
+ * Number of updates a batch may hold. Each holds a descriptor, and
+ * a batch takes no more than half of those the process may open;
+ * the limit is raised as far as needed and allowed first.
+ */
+static size_t
+batch_max(void)
+{
+	struct rlimit rl;
+
+	if(getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == RLIM_INFINITY)
+		return CLOCKSTEP_BATCH;
+
+	if(rl.rlim_cur < 2 * CLOCKSTEP_BATCH && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ||
+			rl.rlim_max > 2 * CLOCKSTEP_BATCH ?
+			2 * CLOCKSTEP_BATCH : rl.rlim_max;
+		if(setrlimit(RLIMIT_NOFILE, &rl) < 0)
+			getrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	return rl.rlim_cur / 2 < CLOCKSTEP_BATCH ?
+		rl.rlim_cur / 2 : CLOCKSTEP_BATCH;
+}
+
+/*
+ * Touch the file of e so that the kernel takes its change time from
+ * the clock: a chmod() to its own mode, or for a symbolic link,
+ * whose mode cannot be changed, a chown() that changes nothing. The
+ * latter is no choice for other files, as it would drop their
+ * set-user-ID and set-group-ID bits.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int
+entry_touch(const struct clockstep_entry *e)
+{
+	GENERAL_BOOL link = e->nofollow && S_ISLNK(e->mode);
+	mode_t mode = e->mode & 07777;
+
+	if(e->fd < 0) {
+		if(link)
+			return SC(fchownat(e->dirfd, e->name, -1, -1,
+					   AT_SYMLINK_NOFOLLOW));
+#ifdef HAVE_LCHMOD
+		return SC(fchmodat(e->dirfd, e->name, mode,
+				   e->nofollow ? AT_SYMLINK_NOFOLLOW : 0));
+#else
+		return SC(fchmodat(e->dirfd, e->name, mode, 0));
+#endif
+	}
+
+#ifdef AT_EMPTY_PATH
+	char proc[32];
+	int rc;
+
+	if(link)
+		return SC(fchownat(e->fd, "", -1, -1, AT_EMPTY_PATH));
+	if((rc = SC(fchmodat(e->fd, "", mode, AT_EMPTY_PATH))) == 0 ||
+	   (errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP))
+		return rc;
+
+	/* Before Linux 6.6 a file opened O_PATH is reached through /proc */
+	snprintf(proc, sizeof proc, "/proc/self/fd/%d", e->fd);
+	return SC(chmod(proc, mode));
+#else
+	return SC(fchmod(e->fd, mode));
+#endif
+}
+
+/*
+ * Read back the change time of the file of e into ctime; the one
+ * it was set to is taken if that fails.
+ */
+static void
+entry_ctime(const struct clockstep_entry *e, struct timespec *ctime)
+{
+	struct stat st;
+
+	if((e->fd >= 0 ? SC(fstat(e->fd, &st)) :
+	    SC(fstatat(e->dirfd, e->name, &st,
+		       e->nofollow ? AT_SYMLINK_NOFOLLOW : 0))) < 0)
+		*ctime = e->ts;
+	else
+		*ctime = st.st_ctim;
+}
+
+/*
+ * Close the descriptors held by e.
+ */
+static void
+entry_close(struct clockstep_entry *e)
+{
+	if(e->fd >= 0)
+		SC(close(e->fd));
+	if(e->dirfd >= 0)
+		SC(close(e->dirfd));
+}
+
+/*
+ * Set up an empty batch. Every update is handed to done, along with
+ * arg, once the batch is flushed; see CLOCKSTEP_DONE.
+ */
+struct clockstep*
+clockstep_create(CLOCKSTEP_DONE done, void *arg)
+{
+	struct clockstep *c = general_malloc(sizeof *c);
+
+	memset(c, 0, sizeof *c);
+	c->max = batch_max();
+	c->paths = arena_new(CLOCKSTEP_PATHS_CHUNK);
+	c->done = done;
+	c->arg = arg;
+	pthread_mutex_init(&c->lock, NULL);
+
+	return c;
+}
+
+/*
+ * Queue setting the change time of a file to ctime; the file keeps
+ * mode. The file is fd, which is taken over, or if that is -1 name,
+ * relative to dirfd, which is duplicated. If nofollow is TRUE a
+ * symbolic link itself is changed. path is the name of the file as
+ * shown to the user and data is handed to the done function of c.
+ * Safe to call from several threads.
+ * Returns 1 once the batch is full and should be flushed, 0 if not,
+ * and -1 if the update cannot be queued; fd is not taken over then.
+ */
+int
+clockstep_add(struct clockstep *c, int fd, int dirfd, const char *name,
+	      const char *path, mode_t mode, const struct timespec *ctime,
+	      GENERAL_BOOL nofollow, void *data)
+{
+	struct clockstep_entry *e;
+	int full;
+
+	if(fd < 0 && dirfd != AT_FDCWD &&
+	   (dirfd = SC(fcntl(dirfd, F_DUPFD_CLOEXEC, 0))) < 0) {
+		error_out(ERROR_ERROR_CHCTIME, errno, FLN, path, "");
+		return -1;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	if(c->count == c->size) {
+		c->size = c->size ? c->size << 1 : 256;
+		c->entries = general_realloc(c->entries, c->size * sizeof *c->entries);
+	}
+	e = &c->entries[c->count++];
+	e->ts = *ctime;
+	e->path = arena_str(c->paths, path);
+	e->fd = fd;
+	if(fd < 0) {
+		e->name = path == name ? e->path : arena_str(c->paths, name);
+		e->dirfd = dirfd;
+	} else {
+		e->name = "";
+		e->dirfd = -1;
+	}
+	e->mode = mode;
+	e->nofollow = nofollow;
+	e->err = 0;
+	e->data = data;
+	full = c->count >= c->max;
+	pthread_mutex_unlock(&c->lock);
+
+	return full;
+}
+
+/*
+ * Apply every queued update in one excursion of the system clock,
+ * then hand each to the done function of c, and close the files.
+ * Must be called inside an exclusive fileop_lock() section. A file
+ * that cannot be changed is reported and the others still are.
+ * Returns 0 on success, -1 if the done function failed for any
+ * update, or if the clock could not be set back.
+ */
+int
+clockstep_flush(struct clockstep *c)
+{
+	struct clockstep_entry *e;
+	struct sigaction old[HELD_SIGNALS];
+	struct timespec real, start, now, ctime;
+	GENERAL_BOOL away = FALSE;
+	sigset_t mask;
+	size_t i;
+	int rc = 0, err;
+
+	pthread_mutex_lock(&c->lock);
+	if(!c->count)
+		goto done;
+
+	qsort(c->entries, c->count, sizeof *c->entries, &entry_cmp);
+
+	signals_hold(old, &mask);
+	for(i = 0; i < c->count; i++) {
+		e = &c->entries[i];
+
+		/* Back for a signal, or after CLOCKSTEP_AWAY_MAX */
+		if(away && (caught || (clock_gettime(CLOCK_MONOTONIC, &now) == 0 &&
+				       ts_diff(&now, &start) > CLOCKSTEP_AWAY_MAX))) {
+			away = FALSE;
+			if(clock_back(c, &real, &start) < 0) {
+				rc = -1;
+				entries_failed(c, i, EINTR);
+				break;
+			}
+		}
+		if(caught) {
+			entries_failed(c, i, EINTR);
+			break;
+		}
+
+		/*
+		 * Note: Beware clock skews; hence the time spent away is
+		 * taken from the monotonic clock
+		 */
+		if(!away && (clock_gettime(CLOCK_REALTIME, &real) < 0 ||
+			     clock_gettime(CLOCK_MONOTONIC, &start) < 0)) {
+			err = errno;
+			error_out(ERROR_ERROR_CHCTIME, err, FLN, e->path, "");
+			entries_failed(c, i, err);
+			break;
+		}
+
+		if(!away || clock_gettime(CLOCK_REALTIME, &now) < 0 ||
+		   ts_diff(&now, &e->ts) > CTIME_SLACK / 2 ||
+		   ts_diff(&e->ts, &now) > CTIME_SLACK / 2) {
+			if(SC(clock_settime(CLOCK_REALTIME, &e->ts)) < 0) {
+				err = errno;
+				error_out(ERROR_ERROR_CHCTIME, err, FLN, e->path,
+					  IFSTR(geteuid(), "Root privileges might be required."));
+				entries_failed(c, i, err);
+				break;
+			}
+			away = TRUE;
+			++c->steps;
+		}
+
+		if(entry_touch(e) < 0) {
+			e->err = errno;
+			error_out(ERROR_ERROR_CHCTIME, e->err, FLN, e->path, "");
+		}
+	}
+
+	if(away && clock_back(c, &real, &start) < 0)
+		rc = -1;
+	signals_release(old, &mask);
+
+	/* Files are only reported once the clock is back */
+	for(i = 0; i < c->count; i++) {
+		e = &c->entries[i];
+		if(!e->err)
+			entry_ctime(e, &ctime);
+		if(c->done(c->arg, e->data, e->err ? NULL : &ctime, e->err) < 0)
+			rc = -1;
+		entry_close(e);
+	}
+
+ done:
+	arena_reset(c->paths);
+	c->count = 0;
+	pthread_mutex_unlock(&c->lock);
+
+	return rc;
+}
+
+/*
+ * Tell how often the clock was stepped and for how long it was
+ * away from the actual time, over all batches so far.
+ */
+void
+clockstep_report(struct clockstep *c, unsigned long *steps,
+		 struct timespec *displaced)
+{
+	pthread_mutex_lock(&c->lock);
+	*steps = c->steps;
+	*displaced = c->displaced;
+	pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * Release the batch; updates still queued are dropped without
+ * being handed to the done function.
+ */
+void
+clockstep_destroy(struct clockstep *c)
+{
+	size_t i;
+
+	if(!c)
+		return;
+	for(i = 0; i < c->count; i++)
+		entry_close(&c->entries[i]);
+	arena_destroy(&c->paths);
+	pthread_mutex_destroy(&c->lock);
+	free(c->entries);
+	free(c);
+}
@@ -0,0 +1,57 @@
+/*
+ *      clockstep.h - Batched change time updates for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#ifndef STROKE_CLOCKSTEP_H
+#define STROKE_CLOCKSTEP_H 1
+
+#include <libgeneral/general.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* Opaque batch of pending change time updates */
+struct clockstep;
+
+/*
+ * Called by clockstep_flush() for every update, once the clock is
+ * back: with the change time the file now has and err 0, or with
+ * ctime NULL and the errno it failed with. arg is as passed to
+ * clockstep_create(), data as to clockstep_add().
+ * Returns 0 on success, -1 on failure.
+ */
+typedef int (*CLOCKSTEP_DONE)(void *arg, void *data,
+			      const struct timespec *ctime, int err);
+
+/*
+ * Function declarations
+ */
+extern struct clockstep* clockstep_create(CLOCKSTEP_DONE done, void *arg);
+extern int clockstep_add(struct clockstep *c, int fd, int dirfd,
+			 const char *name, const char *path, mode_t mode,
+			 const struct timespec *ctime, GENERAL_BOOL nofollow,
+			 void *data);
+extern int clockstep_flush(struct clockstep *c);
+extern void clockstep_report(struct clockstep *c, unsigned long *steps,
+			     struct timespec *displaced);
+extern void clockstep_destroy(struct clockstep *c);
+
+#endif /* STROKE_CLOCKSTEP_H */
@@ -34,6 +34,9 @@ ERROR_MESSAGE error_messages[] = {
 	/* Warnings */
 	EM_INIT(ERROR_WARNING_FORCVAL, "Date validations skipped"),
 	EM_INIT(ERROR_WARNING_CTCOPY, "Change time was not copied because root or CAP_SYS_TIME privileges are required"),
+	EM_INIT(ERROR_WARNING_FSLOOP, "File system loop detected; skipping \"%s\""),
+	EM_INIT(ERROR_WARNING_SNAPSKIP, "Skipping \"%s\": %s"),
+	EM_INIT(ERROR_WARNING_SNAPROOT, "Working directory unknown; \"%s\" will be restored relative to the one of the restoring run"),
 
 	/* Normal errors */
 	EM_INIT(ERROR_ERROR_INSUFARGS, "Insufficient command line arguments supplied"),
@@ -61,7 +64,6 @@ ERROR_MESSAGE error_messages[] = {
 	EM_INIT(ERROR_ERROR_BATCHF, "Batch file name argument missing"),
 	EM_INIT(ERROR_ERROR_TIMEST, "Invalid time stamp or selector `%s:%s'"),
 	EM_INIT(ERROR_ERROR_INVTSP, "Invalid time stamp expression `%s'"),
-	EM_INIT(ERROR_ERROR_UTIMSYM, "Cannot change symlink modification or access time: \"%s\""),
 	EM_INIT(ERROR_ERROR_CHCTIME, "Altering change time failed:\n\"%s\" %s"),
 	EM_INIT(ERROR_ERROR_CTPRES, "`-c' and `-p' must not be given together"),
 	EM_INIT(ERROR_ERROR_CTCHPR, "Attempt to alter change time despite `-preserve'"),
@@ -70,34 +72,52 @@ ERROR_MESSAGE error_messages[] = {
 	EM_INIT(ERROR_ERROR_FCREATE, "Unable to create file: \"%s\""),
 	EM_INIT(ERROR_ERROR_CTPRIV, "Option `%s' requires root or CAP_SYS_TIME privileges"),
 	EM_INIT(ERROR_ERROR_SETTIM_PERM, "Insufficient permissions to modify \"%s\""),
+	EM_INIT(ERROR_ERROR_OPENDIR, "Unable to read directory: \"%s\""),
+	EM_INIT(ERROR_ERROR_READLST, "Unable to read file list: \"%s\""),
+	EM_INIT(ERROR_ERROR_INVJOBS, "Invalid number of jobs `%s'"),
+	EM_INIT(ERROR_ERROR_SNAPWR, "Unable to write snapshot: \"%s\""),
+	EM_INIT(ERROR_ERROR_SNAPRD, "Unable to read snapshot: \"%s\""),
+	EM_INIT(ERROR_ERROR_SNAPBAD, "Corrupt or unsupported snapshot: \"%s\""),
+	EM_INIT(ERROR_ERROR_OPTCOMB, "`%s' must not be combined with %s"),
+	EM_INIT(ERROR_ERROR_MANIFEST, "Invalid record in manifest \"%s\", line %s"),
+	EM_INIT(ERROR_ERROR_MANITIME, "Invalid time stamp `%s' in manifest \"%s\", line %s"),
+	EM_INIT(ERROR_ERROR_TZALLOC, "Cannot set up time zone `%s'"),
+	EM_INIT(ERROR_ERROR_EXPREF, "`ref:' in `%s' needs a reference file given with `--copy'"),
+	EM_INIT(ERROR_ERROR_FORMAT, "Invalid format `%s'"),
+	EM_INIT(ERROR_ERROR_WRITE, "Unable to write output"),
+	EM_INIT(ERROR_ERROR_OUTPUT, "Unknown output format `%s' (jsonl, csv or bin)"),
+	EM_INIT(ERROR_ERROR_RETRYWR, "Unable to write retry list: \"%s\""),
+	EM_INIT(ERROR_ERROR_JOURNAL, "Unable to use journal: \"%s\""),
+	EM_INIT(ERROR_ERROR_JOURNALBAD, "Corrupt or unsupported journal: \"%s\""),
+	EM_INIT(ERROR_ERROR_STATS, "Unknown statistics format `%s' (text or json)"),
+	EM_INIT(ERROR_ERROR_TRACE, "Unable to write trace: \"%s\""),
+	EM_INIT(ERROR_ERROR_JOURNALOPT, "Journal \"%s\" belongs to a run with other setters or options; resume with the same ones or remove it"),
 	
 	ZERO_SENTINEL
 };
 
 #ifdef DEBUG
 /*
- * Dump internal time_vals array of time value structures
+ * Dump internal times array
  */
-static void dump_time_vals(FILE_TIME (*time_vals)[TIME_VALS])
+static void dump_times(const struct timespec *times)
 {
 	int i = TIME_TBLS;
-	register int j;
+	char buf[64];
 	
 	while(--i >= 0) {
-		msg("Dumping %s:", names[i]);
-		for(j = 0; j < TIME_VALS; j++) {
-			dumpstr(STR, "name", 7, IFF(time_vals[i][j].name, "wkd"));
-			dumpstr(INT, "val", 7, &time_vals[i][j].val);
-		}
+		snprintf(buf, sizeof buf, "%lld.%09ld",
+			 (long long)times[i].tv_sec, times[i].tv_nsec);
+		msg("Dumping %s: %s", names[i], buf);
 	}
 }
 
 /*
- * Dump tv if debugging and verbosity allowed.
+ * Dump times if debugging and verbosity allowed.
  */
-inline void dump_tv(FILE_TIME (*time_vals)[TIME_VALS])
+inline void dump_tv(const struct timespec *times)
 {
-	if(verbosity_level()) dump_time_vals(time_vals);
+	if(verbosity_level()) dump_times(times);
 }
 
 #endif
@@ -31,6 +31,9 @@ enum {
 	/* Warnings 100 to 199 */
 	ERROR_WARNING_FORCVAL = 101,
 	ERROR_WARNING_CTCOPY = 102,
+	ERROR_WARNING_FSLOOP = 103,
+	ERROR_WARNING_SNAPSKIP = 104,
+	ERROR_WARNING_SNAPROOT = 105,
 	
 	/* Normal errors 200 and beyond */
 	ERROR_ERROR_INSUFARGS = 201,
@@ -54,7 +57,6 @@ enum {
 	ERROR_ERROR_BATCHF = 220,
 	ERROR_ERROR_TIMEST = 221,
 	ERROR_ERROR_INVTSP = 222,
-	ERROR_ERROR_UTIMSYM = 223,
 	ERROR_ERROR_CHCTIME = 224,
 	ERROR_ERROR_CTPRES = 225,
 	ERROR_ERROR_CTCHPR = 226,
@@ -63,6 +65,26 @@ enum {
 	ERROR_ERROR_FCREATE = 229,
 	ERROR_ERROR_CTPRIV = 230,
 	ERROR_ERROR_SETTIM_PERM = 231,
+	ERROR_ERROR_OPENDIR = 232,
+	ERROR_ERROR_READLST = 233,
+	ERROR_ERROR_INVJOBS = 234,
+	ERROR_ERROR_SNAPWR = 235,
+	ERROR_ERROR_SNAPRD = 236,
+	ERROR_ERROR_SNAPBAD = 237,
+	ERROR_ERROR_OPTCOMB = 238,
+	ERROR_ERROR_MANIFEST = 239,
+	ERROR_ERROR_MANITIME = 240,
+	ERROR_ERROR_TZALLOC = 241,
+	ERROR_ERROR_EXPREF = 242,
+	ERROR_ERROR_FORMAT = 243,
+	ERROR_ERROR_WRITE = 244,
+	ERROR_ERROR_OUTPUT = 245,
+	ERROR_ERROR_RETRYWR = 246,
+	ERROR_ERROR_JOURNAL = 247,
+	ERROR_ERROR_JOURNALBAD = 248,
+	ERROR_ERROR_STATS = 249,
+	ERROR_ERROR_TRACE = 250,
+	ERROR_ERROR_JOURNALOPT = 251,
 };
 
 /* Array of error messages; used by libgeneral; initialized in errors.c */
@@ -0,0 +1,435 @@
+/*
+ *      expr.c - Per-file time stamp expressions
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "stroke.h"
+#include "expr.h"
+#include "literal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A setter may compute its value from the file it is applied to:
+ *
+ *	expr    := operand { ('+' | '-') offset }
+ *	operand := clock | `ref:' clock | `@' SECONDS
+ *		 | (`min' | `max') `(' expr { `,' expr } `)'
+ *	clock   := `self' | `mtime' | `atime' | `ctime'
+ *	offset  := NUMBER [unit]
+ *
+ * where self is the clock being set and ref: refers to the file
+ * given with `--copy'. An offset without a unit is in seconds.
+ *
+ * Expressions are compiled once into code for a small stack machine
+ * working on struct timespec, so that evaluating one for a file is
+ * a handful of additions and comparisons; there is no calendar
+ * arithmetic involved at all. Adjacent offsets are folded into one.
+ */
+
+/* Deepest nesting of min() and max() */
+#define EXPR_STACK 16
+
+enum expr_op {
+	OP_CLOCK,	/* push a time stamp of the file */
+	OP_REF,		/* push a time stamp of the reference file */
+	OP_CONST,	/* push ts */
+	OP_ADD,		/* add ts to the top */
+	OP_MIN,		/* replace the top two by the earlier */
+	OP_MAX,		/* replace the top two by the later */
+};
+
+struct expr_insn {
+	unsigned char op;
+	unsigned char clock;
+	struct timespec ts;	/* normalised: 0 <= tv_nsec < 1e9 */
+};
+
+struct expr {
+	struct expr_insn *code;
+	size_t len;
+	size_t size;
+	_FLAG_TYPE flags;
+};
+
+/* Compiler state */
+struct expr_parser {
+	const char *p;
+	struct expr *e;
+	int clock;
+	int depth;
+};
+
+/* Units an offset may be given in, with their length in nanoseconds */
+static const struct {
+	const char *name;
+	long long ns;
+} units[] = {
+	{"ns", 1LL}, {"us", 1000LL}, {"ms", 1000000LL},
+	{"s", 1000000000LL}, {"sec", 1000000000LL}, {"secs", 1000000000LL},
+	{"second", 1000000000LL}, {"seconds", 1000000000LL},
+	{"m", 60000000000LL}, {"min", 60000000000LL}, {"mins", 60000000000LL},
+	{"minute", 60000000000LL}, {"minutes", 60000000000LL},
+	{"h", 3600000000000LL}, {"hour", 3600000000000LL},
+	{"hours", 3600000000000LL},
+	{"d", 86400000000000LL}, {"day", 86400000000000LL},
+	{"days", 86400000000000LL},
+	{"w", 604800000000000LL}, {"week", 604800000000000LL},
+	{"weeks", 604800000000000LL},
+};
+
+#define IS_ALPHA(C) (((C) >= 'a' && (C) <= 'z') || ((C) >= 'A' && (C) <= 'Z'))
+#define IS_DIGIT(C) ((C) >= '0' && (C) <= '9')
+
+static void
+skip_space(struct expr_parser *ps)
+{
+	while(*ps->p == ' ' || *ps->p == '\t')
+		++ps->p;
+}
+
+/*
+ * Read a word of letters into buf.
+ * Returns its length, 0 if there is none or it does not fit.
+ */
+static size_t
+word(struct expr_parser *ps, char *buf, size_t len)
+{
+	size_t n = 0;
+
+	while(IS_ALPHA(ps->p[n])) {
+		if(n + 1 >= len)
+			return 0;
+		buf[n] = ps->p[n];
+		++n;
+	}
+	buf[n] = 0;
+	ps->p += n;
+	return n;
+}
+
+/*
+ * Add d to t, both normalised.
+ */
+static void
+ts_add(struct timespec *t, const struct timespec *d)
+{
+	t->tv_sec += d->tv_sec;
+	t->tv_nsec += d->tv_nsec;
+	if(t->tv_nsec >= 1000000000L) {
+		t->tv_nsec -= 1000000000L;
+		++t->tv_sec;
+	}
+}
+
+static int
+ts_cmp(const struct timespec *a, const struct timespec *b)
+{
+	if(a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	if(a->tv_nsec != b->tv_nsec)
+		return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+static void
+emit(struct expr_parser *ps, int op, int clock, const struct timespec *ts)
+{
+	struct expr *e = ps->e;
+	struct expr_insn *in;
+
+	if(e->len == e->size) {
+		e->size = e->size ? e->size << 1 : 8;
+		e->code = general_realloc(e->code, e->size * sizeof *e->code);
+	}
+	in = &e->code[e->len++];
+	in->op = op;
+	in->clock = clock;
+	if(ts)
+		in->ts = *ts;
+	else
+		in->ts.tv_sec = in->ts.tv_nsec = 0;
+}
+
+/*
+ * Read a clock name; self stands for the clock being set.
+ * Returns its index, -1 if buf names no clock.
+ */
+static int
+clock_index(struct expr_parser *ps, const char *buf)
+{
+	int i;
+
+	if(!strcmp(buf, "self"))
+		return ps->clock;
+	for(i = 0; i < TIME_TBLS; i++)
+		if(!strcmp(buf, names[i]))
+			return i;
+	return -1;
+}
+
+/*
+ * Read an offset, a number with an optional unit, into d.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+offset(struct expr_parser *ps, GENERAL_BOOL neg, struct timespec *d)
+{
+	long long ip = 0, frac = 0, scale = 1, unit = 1000000000LL, ns;
+	char buf[16];
+	size_t i, n = 0;
+
+	skip_space(ps);
+	for(; IS_DIGIT(*ps->p); ps->p++, n++) {
+		if(__builtin_mul_overflow(ip, 10, &ip) ||
+		   __builtin_add_overflow(ip, *ps->p - '0', &ip))
+			return -1;
+	}
+	if(*ps->p == '.') {
+		for(++ps->p; IS_DIGIT(*ps->p); ps->p++, n++) {
+			if(scale == 1000000000LL)
+				return -1;
+			frac = frac * 10 + (*ps->p - '0');
+			scale *= 10;
+		}
+	}
+	if(!n)
+		return -1;
+
+	skip_space(ps);
+	if(word(ps, buf, sizeof buf)) {
+		for(i = 0; i < sizeof units / sizeof *units; i++)
+			if(!strcmp(buf, units[i].name))
+				break;
+		if(i == sizeof units / sizeof *units)
+			return -1;
+		unit = units[i].ns;
+	}
+
+	if(__builtin_mul_overflow(ip, unit, &ns) ||
+	   __builtin_add_overflow(ns, frac * (unit / scale) +
+				  frac * (unit % scale) / scale, &ns))
+		return -1;
+	if(neg)
+		ns = -ns;
+
+	d->tv_sec = ns / 1000000000LL;
+	d->tv_nsec = ns % 1000000000LL;
+	if(d->tv_nsec < 0) {
+		d->tv_nsec += 1000000000L;
+		--d->tv_sec;
+	}
+	return 0;
+}
+
+static int expr(struct expr_parser *ps);
+
+/*
+ * Compile one operand.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+operand(struct expr_parser *ps)
+{
+	struct timespec ts;
+	char buf[16];
+	const char *s;
+	int clock, op;
+
+	skip_space(ps);
+
+	if(*ps->p == '@') {
+		s = ++ps->p;
+		while(IS_DIGIT(*ps->p) || *ps->p == '.' || *ps->p == '-')
+			++ps->p;
+		if(!literal_epoch(s, ps->p - s, &ts))
+			return -1;
+		emit(ps, OP_CONST, 0, &ts);
+		return 0;
+	}
+
+	if(!word(ps, buf, sizeof buf))
+		return -1;
+
+	if(!strcmp(buf, "min") || !strcmp(buf, "max")) {
+		op = buf[1] == 'i' ? OP_MIN : OP_MAX;
+		skip_space(ps);
+		if(*ps->p++ != '(' || ++ps->depth >= EXPR_STACK || expr(ps) < 0)
+			return -1;
+		for(skip_space(ps); *ps->p == ','; skip_space(ps)) {
+			++ps->p;
+			if(expr(ps) < 0)
+				return -1;
+			emit(ps, op, 0, NULL);
+		}
+		if(*ps->p++ != ')')
+			return -1;
+		--ps->depth;
+		return 0;
+	}
+
+	op = OP_CLOCK;
+	if(!strcmp(buf, "ref") && *ps->p == ':') {
+		++ps->p;
+		if(!word(ps, buf, sizeof buf))
+			return -1;
+		op = OP_REF;
+		ps->e->flags |= EXPR_REF;
+	}
+	if((clock = clock_index(ps, buf)) < 0)
+		return -1;
+	emit(ps, op, clock, NULL);
+	return 0;
+}
+
+/*
+ * Compile an operand followed by any number of offsets.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+expr(struct expr_parser *ps)
+{
+	struct timespec d;
+	struct expr_insn *last;
+
+	if(operand(ps) < 0)
+		return -1;
+
+	for(skip_space(ps); *ps->p == '+' || *ps->p == '-'; skip_space(ps)) {
+		GENERAL_BOOL neg = *ps->p++ == '-';
+
+		if(offset(ps, neg, &d) < 0)
+			return -1;
+		last = &ps->e->code[ps->e->len-1];
+		if(last->op == OP_ADD)
+			ts_add(&last->ts, &d);
+		else
+			emit(ps, OP_ADD, 0, &d);
+	}
+	return 0;
+}
+
+/*
+ * Compile setter value src for clock (MTIME, ATIME or CTIME) into
+ * *out. Only values beginning with a clock name, `ref:', `min(' or
+ * `max(' are expressions; anything else is left to the SPEC parser.
+ * Returns 1 if compiled, 0 if src is no expression, -1 if it is an
+ * invalid one.
+ */
+int
+expr_compile(const char *src, int clock, struct expr **out)
+{
+	static const char *const heads[] = {
+		"self", "mtime", "atime", "ctime", "ref", "min", "max"
+	};
+	struct expr_parser ps;
+	char buf[16];
+	size_t i;
+
+	ps.p = src;
+	skip_space(&ps);
+	if(!word(&ps, buf, sizeof buf))
+		return 0;
+	for(i = 0; i < sizeof heads / sizeof *heads; i++)
+		if(!strcmp(buf, heads[i]))
+			break;
+	if(i == sizeof heads / sizeof *heads)
+		return 0;
+
+	ps.p = src;
+	ps.clock = clock;
+	ps.depth = 0;
+	ps.e = general_malloc(sizeof *ps.e);
+	memset(ps.e, 0, sizeof *ps.e);
+
+	if(expr(&ps) < 0 || (skip_space(&ps), *ps.p)) {
+		expr_free(ps.e);
+		return -1;
+	}
+
+	*out = ps.e;
+	return 1;
+}
+
+/*
+ * Properties of e; EXPR_REF if it refers to the reference file.
+ */
+_FLAG_TYPE
+expr_flags(const struct expr *e)
+{
+	return e->flags;
+}
+
+/*
+ * Evaluate e for a file whose time stamps are cur into out. ref
+ * holds those of the reference file and may only be NULL if e
+ * does not refer to it.
+ */
+void
+expr_eval(const struct expr *e, const struct timespec *cur,
+	  const struct timespec *ref, struct timespec *out)
+{
+	struct timespec stack[EXPR_STACK + 1];
+	const struct expr_insn *in = e->code, *end = e->code + e->len;
+	int sp = 0;
+
+	for(; in < end; in++) {
+		switch(in->op) {
+		case OP_CLOCK:
+			stack[sp++] = cur[in->clock];
+			break;
+		case OP_REF:
+			stack[sp++] = ref[in->clock];
+			break;
+		case OP_CONST:
+			stack[sp++] = in->ts;
+			break;
+		case OP_ADD:
+			ts_add(&stack[sp-1], &in->ts);
+			break;
+		case OP_MIN:
+			--sp;
+			if(ts_cmp(&stack[sp], &stack[sp-1]) < 0)
+				stack[sp-1] = stack[sp];
+			break;
+		case OP_MAX:
+			--sp;
+			if(ts_cmp(&stack[sp], &stack[sp-1]) > 0)
+				stack[sp-1] = stack[sp];
+			break;
+		}
+	}
+
+	*out = stack[0];
+}
+
+/*
+ * Release a compiled expression.
+ */
+void
+expr_free(struct expr *e)
+{
+	if(!e)
+		return;
+	free(e->code);
+	free(e);
+}
@@ -0,0 +1,46 @@
+/*
+ *      expr.h - Per-file time stamp expressions
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_EXPR_H
+#define STROKE_EXPR_H 1
+
+#include <libgeneral/general.h>
+#include <time.h>
+
+/* Properties of a compiled expression; see expr_flags() */
+enum {
+	EXPR_REF = _FLAG(0),	/* refers to the reference file */
+};
+
+/* Opaque compiled expression */
+struct expr;
+
+/*
+ * Function declarations
+ */
+extern int expr_compile(const char *src, int clock, struct expr **out);
+extern _FLAG_TYPE expr_flags(const struct expr *e);
+extern void expr_eval(const struct expr *e, const struct timespec *cur,
+		      const struct timespec *ref, struct timespec *out);
+extern void expr_free(struct expr *e);
+
+#endif /* STROKE_EXPR_H */
@@ -0,0 +1,199 @@
+/*
+ *      failures.c - Log of files that failed, for --keep-going
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "failures.h"
+
+#include "stroke.h"
+#include "writer.h"
+
+#include <libgeneral/arena.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* Arena chunk size for the paths of failed files */
+#define FAILURE_PATHS_CHUNK (64 * 1024)
+
+/*
+ * Every file that failed is noted with the error code it was
+ * reported with and the errno behind it. Failures are expected to
+ * be few, so the log is simply appended to under a lock; the paths
+ * are packed into an arena.
+ */
+struct failure {
+	const char *path;
+	int code;
+	int err;
+};
+
+struct failure_log {
+	pthread_mutex_t lock;
+	struct failure *entries;
+	size_t count;
+	size_t size;
+	ARENA *paths;
+};
+
+/* Failures of one kind, for the summary */
+struct failure_kind {
+	int code;
+	int err;
+	unsigned long count;
+	const char *first;
+};
+
+struct failure_log*
+failure_log_create(void)
+{
+	struct failure_log *l = general_malloc(sizeof *l);
+
+	memset(l, 0, sizeof *l);
+	l->paths = arena_new(FAILURE_PATHS_CHUNK);
+	pthread_mutex_init(&l->lock, NULL);
+
+	return l;
+}
+
+/*
+ * Note that path failed with error code, caused by errno err (0 if
+ * none). Safe to call from several threads.
+ */
+void
+failure_log_add(struct failure_log *l, const char *path, int code, int err)
+{
+	struct failure *f;
+
+	pthread_mutex_lock(&l->lock);
+	if(l->count == l->size) {
+		l->size = l->size ? l->size << 1 : 64;
+		l->entries = general_realloc(l->entries, l->size * sizeof *l->entries);
+	}
+	f = &l->entries[l->count++];
+	f->path = arena_str(l->paths, path);
+	f->code = code;
+	f->err = err;
+	pthread_mutex_unlock(&l->lock);
+}
+
+unsigned long
+failure_log_count(struct failure_log *l)
+{
+	unsigned long n;
+
+	pthread_mutex_lock(&l->lock);
+	n = l->count;
+	pthread_mutex_unlock(&l->lock);
+
+	return n;
+}
+
+/*
+ * Print how many files failed in which way to f, grouped by error
+ * code and errno in the order they first occurred. Nothing is
+ * printed if no file failed.
+ */
+void
+failure_log_summary(struct failure_log *l, FILE *f)
+{
+	struct failure_kind *kinds = NULL, *k;
+	size_t nkinds = 0, i, j;
+
+	pthread_mutex_lock(&l->lock);
+	if(!l->count)
+		goto done;
+
+	for(i = 0; i < l->count; i++) {
+		for(j = 0; j < nkinds; j++) {
+			if(kinds[j].code == l->entries[i].code &&
+			   kinds[j].err == l->entries[i].err)
+				break;
+		}
+		if(j == nkinds) {
+			kinds = general_realloc(kinds, ++nkinds * sizeof *kinds);
+			kinds[j].code = l->entries[i].code;
+			kinds[j].err = l->entries[i].err;
+			kinds[j].count = 0;
+			kinds[j].first = l->entries[i].path;
+		}
+		++kinds[j].count;
+	}
+
+	fprintf(f, "%s: %lu file(s) failed:\n", PROGRAM, (unsigned long)l->count);
+	for(k = kinds; k < kinds + nkinds; k++) {
+		fprintf(f, "%s:   %lu x error %d", PROGRAM, k->count, k->code);
+		if(k->err)
+			fprintf(f, " (%s)", strerror(k->err));
+		fprintf(f, ", e.g. \"%s\"\n", k->first);
+	}
+	free(kinds);
+
+ done:
+	pthread_mutex_unlock(&l->lock);
+}
+
+/*
+ * Write the paths of all failed files to file, each terminated by
+ * a NUL byte, so that they can be fed back through `--files-from'
+ * with `-0'. The file is written even if no file failed.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int
+failure_log_write(struct failure_log *l, const char *file)
+{
+	struct writer *w;
+	size_t i;
+	int fd, err;
+
+	if((fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0)
+		return -1;
+
+	w = writer_open(fd);
+	pthread_mutex_lock(&l->lock);
+	for(i = 0; i < l->count; i++)
+		writer_write(w, l->entries[i].path, strlen(l->entries[i].path) + 1);
+	pthread_mutex_unlock(&l->lock);
+
+	if(writer_close(w) < 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if(close(fd) < 0)
+		return -1;
+
+	return 0;
+}
+
+void
+failure_log_destroy(struct failure_log *l)
+{
+	if(!l)
+		return;
+	arena_destroy(&l->paths);
+	pthread_mutex_destroy(&l->lock);
+	free(l->entries);
+	free(l);
+}
@@ -0,0 +1,41 @@
+/*
+ *      failures.h - Log of files that failed, for --keep-going
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef STROKE_FAILURES_H
+#define STROKE_FAILURES_H 1
+
+#include <stdio.h>
+
+/* Opaque log of failed files */
+struct failure_log;
+
+/*
+ * Function declarations
+ */
+extern struct failure_log* failure_log_create(void);
+extern void failure_log_add(struct failure_log *l, const char *path,
+			    int code, int err);
+extern unsigned long failure_log_count(struct failure_log *l);
+extern void failure_log_summary(struct failure_log *l, FILE *f);
+extern int failure_log_write(struct failure_log *l, const char *file);
+extern void failure_log_destroy(struct failure_log *l);
+
+#endif /* STROKE_FAILURES_H */
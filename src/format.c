@@ -0,0 +1,396 @@
+/*
+ *      format.c - Compiled per-file output formats
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "format.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A format such as "%n\t%y{%s.%N}\t%x{%F %T}" is compiled once
+ * into a list of render ops; rendering a file is then a walk over
+ * them, appending straight to the output buffer. Literal text of
+ * all ops is kept in one string.
+ */
+
+/* Kinds of render op */
+enum {
+	OP_TEXT,	/* literal text */
+	OP_PATH,	/* %n */
+	OP_LINK,	/* %l */
+	OP_CLOCK,	/* %y, %x or %z; its fields follow */
+	OP_SECS,	/* %s */
+	OP_NSEC,	/* %N */
+
+	/* Fields of local time from here on */
+	OP_YEAR,	/* %Y */
+	OP_MON,		/* %m */
+	OP_MDAY,	/* %d */
+	OP_HOUR,	/* %H */
+	OP_MIN,		/* %M */
+	OP_SEC,		/* %S */
+	OP_WDAY,	/* %a */
+};
+
+struct format_op {
+	unsigned char kind;
+	unsigned char clock;
+	GENERAL_BOOL local;	/* OP_CLOCK: a local time field follows */
+	size_t skip;		/* OP_CLOCK: number of field ops */
+	size_t off;		/* OP_TEXT: text[off] to text[off+len] */
+	size_t len;
+};
+
+struct format {
+	struct format_op *ops;
+	size_t nops;
+	size_t opsz;
+	char *text;
+	size_t textlen;
+	size_t textsz;
+	_FLAG_TYPE flags;
+};
+
+/* Fields shown for a clock without braces */
+#define CLOCK_DEFAULT "%F %T"
+
+/* Longest number written by put_num() */
+#define NUM_MAX 21
+
+static struct format_op*
+op_add(struct format *f, int kind)
+{
+	struct format_op *op;
+
+	if(f->nops == f->opsz) {
+		f->opsz = f->opsz ? f->opsz << 1 : 16;
+		f->ops = general_realloc(f->ops, f->opsz * sizeof *f->ops);
+	}
+	op = &f->ops[f->nops++];
+	memset(op, 0, sizeof *op);
+	op->kind = kind;
+	return op;
+}
+
+/*
+ * Add n bytes of literal text, extending the previous op if it is
+ * text as well.
+ */
+static void
+text_add(struct format *f, const char *s, size_t n)
+{
+	struct format_op *op;
+
+	if(f->textlen + n > f->textsz) {
+		while(f->textlen + n > f->textsz)
+			f->textsz = f->textsz ? f->textsz << 1 : 64;
+		f->text = general_realloc(f->text, f->textsz);
+	}
+	memcpy(f->text + f->textlen, s, n);
+
+	if(f->nops && f->ops[f->nops-1].kind == OP_TEXT) {
+		f->ops[f->nops-1].len += n;
+	} else {
+		op = op_add(f, OP_TEXT);
+		op->off = f->textlen;
+		op->len = n;
+	}
+	f->textlen += n;
+}
+
+/*
+ * Compile the backslash escape at *s, advancing *s past it.
+ * Returns 0 on success, -1 if it is unknown.
+ */
+static int
+compile_escape(struct format *f, const char **s)
+{
+	char c;
+
+	switch((*s)[1]) {
+	case 't':  c = '\t'; break;
+	case 'n':  c = '\n'; break;
+	case '0':  c = '\0'; break;
+	case '\\': c = '\\'; break;
+	default:
+		return -1;
+	}
+	text_add(f, &c, 1);
+	*s += 2;
+	return 0;
+}
+
+/*
+ * Compile the fields of a clock at *s up to a closing brace or the
+ * end of the string, advancing *s to it.
+ * Returns 0 on success, -1 if a field is unknown.
+ */
+static int
+compile_fields(struct format *f, const char **s)
+{
+	static const struct {
+		char c;
+		int kind;		/* -1: expand instead */
+		const char *expand;
+	} fields[] = {
+		{'s', OP_SECS, NULL}, {'N', OP_NSEC, NULL},
+		{'Y', OP_YEAR, NULL}, {'m', OP_MON, NULL}, {'d', OP_MDAY, NULL},
+		{'H', OP_HOUR, NULL}, {'M', OP_MIN, NULL}, {'S', OP_SEC, NULL},
+		{'a', OP_WDAY, NULL},
+		{'F', -1, "%Y-%m-%d"}, {'T', -1, "%H:%M:%S"},
+	};
+	const char *p = *s, *sub;
+	size_t i;
+
+	while(*p && *p != '}') {
+		if(*p == '\\') {
+			if(compile_escape(f, &p) < 0)
+				return -1;
+			continue;
+		}
+		if(*p != '%') {
+			text_add(f, p++, 1);
+			continue;
+		}
+		if(p[1] == '%') {
+			text_add(f, p, 1);
+			p += 2;
+			continue;
+		}
+		for(i = 0; i < sizeof fields / sizeof *fields; i++)
+			if(fields[i].c == p[1])
+				break;
+		if(i == sizeof fields / sizeof *fields)
+			return -1;
+		if(fields[i].kind < 0) {
+			sub = fields[i].expand;
+			compile_fields(f, &sub);
+		} else {
+			op_add(f, fields[i].kind);
+		}
+		p += 2;
+	}
+
+	*s = p;
+	return 0;
+}
+
+/*
+ * Compile clock and its fields at *s, if any, advancing *s past
+ * them.
+ * Returns 0 on success, -1 if they are invalid.
+ */
+static int
+compile_clock(struct format *f, int clock, const char **s)
+{
+	const char *fields = CLOCK_DEFAULT;
+	size_t at = f->nops, i;
+	struct format_op *op;
+
+	op_add(f, OP_CLOCK)->clock = clock;
+
+	if(**s == '{') {
+		++*s;
+		if(compile_fields(f, s) < 0 || **s != '}')
+			return -1;
+		++*s;
+	} else {
+		compile_fields(f, &fields);
+	}
+
+	op = &f->ops[at];
+	op->skip = f->nops - at - 1;
+	for(i = at + 1; i < f->nops; i++)
+		if(f->ops[i].kind >= OP_YEAR)
+			op->local = TRUE;
+	if(op->local)
+		f->flags |= FORMAT_LOCAL;
+	return 0;
+}
+
+/*
+ * Compile format src. Every file rendered ends with the character
+ * end, which the format itself thus never needs to give.
+ * Returns the format, or NULL if src is invalid.
+ */
+struct format*
+format_compile(const char *src, char end)
+{
+	struct format *f = general_malloc(sizeof *f);
+	const char *s = src;
+
+	memset(f, 0, sizeof *f);
+
+	while(*s) {
+		if(*s == '\\') {
+			if(compile_escape(f, &s) < 0)
+				goto fail;
+			continue;
+		}
+		if(*s != '%') {
+			text_add(f, s++, 1);
+			continue;
+		}
+		switch(s[1]) {
+		case 'n':
+			op_add(f, OP_PATH);
+			break;
+		case 'l':
+			op_add(f, OP_LINK);
+			break;
+		case '%':
+			text_add(f, s, 1);
+			break;
+		case 'y':
+		case 'x':
+		case 'z':
+			s += 2;
+			if(compile_clock(f, s[-1] == 'y' ? MTIME :
+					 s[-1] == 'x' ? ATIME : CTIME, &s) < 0)
+				goto fail;
+			continue;
+		default:
+			goto fail;
+		}
+		s += 2;
+	}
+	text_add(f, &end, 1);
+
+	return f;
+
+ fail:
+	format_free(f);
+	return NULL;
+}
+
+_FLAG_TYPE
+format_flags(const struct format *f)
+{
+	return f->flags;
+}
+
+/*
+ * Write v in decimal to p, zero-padded to width digits.
+ * Returns the number of bytes written.
+ */
+static size_t
+put_num(char *p, long long v, int width)
+{
+	unsigned long long u = v < 0 ? -(unsigned long long)v : (unsigned long long)v;
+	char digits[NUM_MAX];
+	int n = 0;
+	size_t len = 0;
+
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while(u);
+	while(n < width)
+		digits[n++] = '0';
+
+	if(v < 0)
+		p[len++] = '-';
+	while(n)
+		p[len++] = digits[--n];
+	return len;
+}
+
+static void
+write_num(struct writer *w, long long v, int width)
+{
+	writer_commit(w, put_num(writer_reserve(w, NUM_MAX), v, width));
+}
+
+/*
+ * Render file through f into w. The caller holds the lock of w if
+ * it is shared.
+ */
+void
+format_render(const struct format *f, struct writer *w,
+	      const struct format_file *file)
+{
+	const struct format_op *op, *end = f->ops + f->nops;
+	const struct timespec *ts = NULL;
+	const struct tm *tm = NULL;
+	char *p;
+
+	for(op = f->ops; op < end; op++) {
+		switch(op->kind) {
+		case OP_TEXT:
+			writer_write(w, f->text + op->off, op->len);
+			break;
+		case OP_PATH:
+			writer_write(w, file->path, strlen(file->path));
+			break;
+		case OP_LINK:
+			writer_write(w, file->link, strlen(file->link));
+			break;
+		case OP_CLOCK:
+			ts = &file->times[op->clock];
+			tm = &file->tm[op->clock];
+			/* Like ts_to_str(), for times beyond local time */
+			if(op->local && !(file->local & TIME_BIT(op->clock))) {
+				p = writer_reserve(w, NUM_MAX + 1);
+				*p = '@';
+				writer_commit(w, 1 + put_num(p + 1, ts->tv_sec, 0));
+				op += op->skip;
+			}
+			break;
+		case OP_SECS:
+			write_num(w, ts->tv_sec, 0);
+			break;
+		case OP_NSEC:
+			write_num(w, ts->tv_nsec, 9);
+			break;
+		case OP_YEAR:
+			write_num(w, tm->tm_year + 1900LL, 4);
+			break;
+		case OP_MON:
+			write_num(w, tm->tm_mon + 1, 2);
+			break;
+		case OP_MDAY:
+			write_num(w, tm->tm_mday, 2);
+			break;
+		case OP_HOUR:
+			write_num(w, tm->tm_hour, 2);
+			break;
+		case OP_MIN:
+			write_num(w, tm->tm_min, 2);
+			break;
+		case OP_SEC:
+			write_num(w, tm->tm_sec, 2);
+			break;
+		case OP_WDAY:
+			writer_write(w, wdays[tm->tm_wday], 3);
+			break;
+		}
+	}
+}
+
+void
+format_free(struct format *f)
+{
+	if(!f)
+		return;
+	free(f->ops);
+	free(f->text);
+	free(f);
+}
@@ -0,0 +1,62 @@
+/*
+ *      format.h - Compiled per-file output formats
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_FORMAT_H
+#define STROKE_FORMAT_H 1
+
+#include <libgeneral/general.h>
+#include <time.h>
+
+#include "stroke.h"
+#include "writer.h"
+
+/* Properties of a compiled format; see format_flags() */
+enum {
+	FORMAT_LOCAL = _FLAG(0),	/* shows local date or time of day */
+};
+
+/*
+ * What a format is rendered from for one file. tm only needs to
+ * be filled in if the format has FORMAT_LOCAL set; local then has
+ * TIME_BIT() of every clock that could be converted.
+ */
+struct format_file {
+	const char *path;
+	const char *link;		/* target of a symbolic link, or "" */
+	const struct timespec *times;
+	struct tm tm[TIME_TBLS];
+	unsigned local;
+};
+
+/* Opaque compiled format */
+struct format;
+
+/*
+ * Function declarations
+ */
+extern struct format* format_compile(const char *src, char end);
+extern _FLAG_TYPE format_flags(const struct format *f);
+extern void format_render(const struct format *f, struct writer *w,
+			  const struct format_file *file);
+extern void format_free(struct format *f);
+
+#endif /* STROKE_FORMAT_H */
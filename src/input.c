@@ -0,0 +1,185 @@
+/*
+ *      input.c - Streaming file list input for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#include "input.h"
+
+#include "stroke.h"
+#include "errors.h"
+
+#include <libgeneral/error.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Initial size of the read buffer; only grows for longer records */
+#define READER_BUFSZ (64 * 1024)
+
+/*
+ * Records are handed out straight from one read buffer, so the
+ * memory used stays constant no matter how many paths are read;
+ * the buffer is only enlarged if a single record does not fit.
+ */
+struct path_reader {
+	const char *file;
+	int fd;
+	char delim;
+	GENERAL_BOOL eof;
+	unsigned long count;	/* records read, empty ones included */
+
+	char *buf;
+	size_t bufsz;
+	size_t start;
+	size_t end;
+};
+
+/*
+ * Open file, or standard input if file is "-", for reading
+ * records terminated by delim.
+ * Returns NULL on failure.
+ */
+struct path_reader*
+path_reader_open(const char *file, char delim)
+{
+	struct path_reader *r;
+	int fd;
+
+	if(!strcmp(file, "-"))
+		fd = STDIN_FILENO;
+	else if((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+		error_out(ERROR_ERROR_FOPEN, errno, FLN, file);
+		return NULL;
+	}
+
+	r = general_malloc(sizeof *r);
+	memset(r, 0, sizeof *r);
+	r->file = file;
+	r->fd = fd;
+	r->delim = delim;
+	r->bufsz = READER_BUFSZ;
+	r->buf = general_malloc(r->bufsz + 1);
+
+	return r;
+}
+
+/*
+ * Refill the buffer, keeping the unconsumed tail.
+ * Returns the number of bytes read, -1 on failure.
+ */
+static ssize_t
+reader_fill(struct path_reader *r)
+{
+	ssize_t n;
+
+	if(r->start > 0) {
+		memmove(r->buf, r->buf + r->start, r->end - r->start);
+		r->end -= r->start;
+		r->start = 0;
+	}
+
+	if(r->end == r->bufsz) {
+		r->bufsz <<= 1;
+		r->buf = general_realloc(r->buf, r->bufsz + 1);
+	}
+
+	do {
+		n = read(r->fd, r->buf + r->end, r->bufsz - r->end);
+	} while(n < 0 && errno == EINTR);
+
+	if(n < 0) {
+		error_out(ERROR_ERROR_READLST, errno, FLN, r->file);
+		return -1;
+	}
+	if(n == 0)
+		r->eof = TRUE;
+
+	r->end += n;
+	return n;
+}
+
+/*
+ * Fetch the next non-empty record. *record points into the
+ * reader's buffer and stays valid until the next call. Only the
+ * delimiter is removed: a carriage return before a newline is part
+ * of the record, as it may be of a file name.
+ * Returns 1 if a record was read, 0 at end of input and
+ * -1 on failure.
+ */
+int
+path_reader_next(struct path_reader *r, const char **record)
+{
+	char *rec, *sep;
+
+	for(;;) {
+		rec = r->buf + r->start;
+		sep = memchr(rec, r->delim, r->end - r->start);
+
+		if(!sep) {
+			if(!r->eof) {
+				if(reader_fill(r) < 0)
+					return -1;
+				continue;
+			}
+			/* Last record without terminator */
+			if(r->start == r->end)
+				return 0;
+			sep = r->buf + r->end;
+			r->end++;
+		}
+
+		*sep = 0;
+		r->start = sep - r->buf + 1;
+		++r->count;
+
+		if(!*rec)
+			continue;
+
+		*record = rec;
+		return 1;
+	}
+}
+
+/*
+ * Number of records read so far, counting the empty ones skipped;
+ * for records that are lines, the line number of the last one.
+ */
+unsigned long
+path_reader_count(struct path_reader *r)
+{
+	return r->count;
+}
+
+/*
+ * Close the reader; standard input is left open.
+ */
+void
+path_reader_close(struct path_reader *r)
+{
+	if(!r)
+		return;
+	if(r->fd != STDIN_FILENO)
+		close(r->fd);
+	free(r->buf);
+	free(r);
+}
@@ -0,0 +1,41 @@
+/*
+ *      input.h - Streaming file list input for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_INPUT_H
+#define STROKE_INPUT_H 1
+
+#include <sys/types.h>
+
+#include <libgeneral/general.h>
+
+/* Opaque reader state */
+struct path_reader;
+
+/*
+ * Function declarations
+ */
+extern struct path_reader* path_reader_open(const char *file, char delim);
+extern int path_reader_next(struct path_reader *r, const char **record);
+extern unsigned long path_reader_count(struct path_reader *r);
+extern void path_reader_close(struct path_reader *r);
+
+#endif /* STROKE_INPUT_H */
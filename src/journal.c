@@ -0,0 +1,407 @@
+/*
+ *      journal.c - Checkpoint journal to resume interrupted runs
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "journal.h"
+
+#include "stroke.h"
+#include "errors.h"
+#include "writer.h"
+
+#include <libgeneral/error.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * A journal is a header record followed by one record per file
+ * completed, in the order they completed:
+ *
+ *   header   "stroke-journal 2 ordered" or "... paths", a space,
+ *            the settings fingerprint in 16 hex digits, NUL
+ *   record   input position in decimal, a space, the path, NUL
+ *
+ * Records are only ever appended, and the journal is synced to
+ * disk at least every JOURNAL_SYNC_NS, so a crash loses no more
+ * than the files of the last moments; they are simply done again.
+ * A record torn by the crash is cut off when the journal is
+ * opened again.
+ *
+ * Positions count the files of the input as they are handed out.
+ * For input in a fixed order (arguments, lists, snapshots and
+ * manifests) the same position is normally the same file in every
+ * run, so a file below the first position missing from the journal,
+ * the watermark, is done if the journal has its path at its
+ * position. The input may have changed all the same, so any other
+ * file, and every file of a walk whose order may differ from run to
+ * run, is looked up by path in a hash set. Either way a file is
+ * checked in constant time.
+ *
+ * The fingerprint is a hash of the setters and options that decide
+ * which times a file is given. A journal only tells which files are
+ * done, so one written with other settings must not be resumed:
+ * files it records would silently keep the times of the earlier run.
+ */
+#define JOURNAL_MAGIC "stroke-journal 2 "
+#define JOURNAL_ORDERED "ordered"
+#define JOURNAL_PATHS "paths"
+
+/* Hex digits of the settings fingerprint */
+#define JOURNAL_FP_LEN 16
+
+/* Longest time completed files stay in memory only */
+#define JOURNAL_SYNC_NS 1000000000LL
+
+/* Files done before, found by path */
+struct journal_slot {
+	uint64_t hash;
+	const char *path;
+};
+
+struct journal {
+	const char *file;
+	int fd;
+	struct writer *out;
+	struct timespec synced;
+
+	/* The journal as found when opened */
+	char *map;
+	size_t size;
+	unsigned long resumed;
+
+	/* Positions below this one are done, by the paths in done */
+	unsigned long long watermark;
+	const char **done;
+
+	/* Open addressing, size a power of two */
+	struct journal_slot *slots;
+	size_t nslots;
+};
+
+static uint64_t
+path_hash(const char *path)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while(*path)
+		h = (h ^ (unsigned char)*path++) * 0x100000001b3ULL;
+	return h ? h : 1;
+}
+
+/*
+ * Fingerprint of the n strings of settings, any of which may be
+ * NULL; each is hashed with its terminator, so that neither their
+ * boundaries nor a missing one go unnoticed.
+ */
+static uint64_t
+settings_hash(const char *const settings[], size_t n)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	const char *p;
+	size_t i;
+
+	for(i = 0; i < n; i++) {
+		if(!(p = settings[i])) {
+			h = (h ^ 0xff) * 0x100000001b3ULL;
+			continue;
+		}
+		do
+			h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+		while(*p++);
+	}
+	return h;
+}
+
+static void
+set_add(struct journal *j, const char *path)
+{
+	uint64_t h = path_hash(path);
+	size_t i = h & (j->nslots - 1);
+
+	while(j->slots[i].hash) {
+		if(j->slots[i].hash == h && !strcmp(j->slots[i].path, path))
+			return;
+		i = (i + 1) & (j->nslots - 1);
+	}
+	j->slots[i].hash = h;
+	j->slots[i].path = path;
+}
+
+/*
+ * Take in the records of the journal mapped at j->map; there are
+ * n of them, the first at rec. Those of a journal written in
+ * another order than ordered only count by path.
+ */
+static void
+journal_load(struct journal *j, const char *rec, unsigned long n,
+	     GENERAL_BOOL same_order)
+{
+	const char *end = j->map + j->size, *p;
+	unsigned char *seen;
+	unsigned long long pos;
+	unsigned long i;
+
+	/* Every position up to n + 1 may be the watermark */
+	seen = general_malloc(n + 2);
+	memset(seen, 0, n + 2);
+	for(p = rec, i = 0; i < n; i++) {
+		pos = strtoull(p, (char**)&p, 10);
+		if(same_order && pos <= n + 1)
+			seen[pos] = 1;
+		p = memchr(p, '\0', end - p) + 1;
+	}
+	j->watermark = 1;
+	if(same_order)
+		while(seen[j->watermark])
+			++j->watermark;
+	free(seen);
+
+	j->done = general_malloc(j->watermark * sizeof *j->done);
+	for(j->nslots = 16; j->nslots < 2 * n; j->nslots <<= 1);
+	j->slots = general_malloc(j->nslots * sizeof *j->slots);
+	memset(j->slots, 0, j->nslots * sizeof *j->slots);
+	for(p = rec, i = 0; i < n; i++) {
+		pos = strtoull(p, (char**)&p, 10);
+		if(pos < j->watermark)
+			j->done[pos] = p + 1;
+		set_add(j, p + 1);
+		p = memchr(p, '\0', end - p) + 1;
+	}
+}
+
+/*
+ * Check the records of the journal mapped at j->map and tell how
+ * many complete ones there are. *valid is set to the length of the
+ * journal up to the last of them.
+ * Returns their number, -1 if the journal is corrupt.
+ */
+static long
+journal_scan(struct journal *j, const char *rec, size_t *valid)
+{
+	const char *end = j->map + j->size, *p = rec, *nul;
+	long n = 0;
+
+	while(p < end) {
+		if(!(nul = memchr(p, '\0', end - p)))
+			break;
+		if(p == nul || *p < '0' || *p > '9')
+			return -1;
+		while(*p >= '0' && *p <= '9')
+			++p;
+		if(*p != ' ')
+			return -1;
+		p = nul + 1;
+		++n;
+	}
+	*valid = p - j->map;
+
+	return n;
+}
+
+/*
+ * Open journal file, creating it if need be, and take in the files
+ * it records as completed. ordered tells whether the input comes in
+ * a fixed order; see above. The n strings of settings describe what
+ * the run does to every file; a journal written by a run described
+ * otherwise is refused.
+ * Returns NULL on failure.
+ */
+struct journal*
+journal_open(const char *file, GENERAL_BOOL ordered,
+	     const char *const settings[], size_t n_settings)
+{
+	const char *mode = ordered ? JOURNAL_ORDERED : JOURNAL_PATHS;
+	size_t hlen = strlen(JOURNAL_MAGIC), valid;
+	char fp[JOURNAL_FP_LEN + 2];
+	struct journal *j;
+	struct stat st;
+	const char *rec, *was;
+	long n = 0;
+	int fd;
+
+	snprintf(fp, sizeof fp, " %016llx",
+		 (unsigned long long)settings_hash(settings, n_settings));
+
+	if((fd = open(file, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666)) < 0 ||
+	   fstat(fd, &st) < 0) {
+		error_out(ERROR_ERROR_JOURNAL, errno, FLN, file);
+		if(fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	j = general_malloc(sizeof *j);
+	memset(j, 0, sizeof *j);
+	j->file = file;
+	j->fd = fd;
+	j->watermark = 1;
+
+	if(st.st_size) {
+		j->size = st.st_size;
+		if((j->map = mmap(NULL, j->size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+		   MAP_FAILED) {
+			error_out(ERROR_ERROR_JOURNAL, errno, FLN, file);
+			j->map = NULL;
+			goto fail;
+		}
+		madvise(j->map, j->size, MADV_SEQUENTIAL);
+
+		was = j->map + hlen;
+		if(!(rec = memchr(j->map, '\0', j->size)) ||
+		   strncmp(j->map, JOURNAL_MAGIC, hlen) ||
+		   (strncmp(was, JOURNAL_ORDERED " ", strlen(JOURNAL_ORDERED) + 1) &&
+		    strncmp(was, JOURNAL_PATHS " ", strlen(JOURNAL_PATHS) + 1)) ||
+		   strlen(strchr(was, ' ')) != JOURNAL_FP_LEN + 1 ||
+		   (n = journal_scan(j, ++rec, &valid)) < 0) {
+			error_out(ERROR_ERROR_JOURNALBAD, 0, FLN, file);
+			goto fail;
+		}
+		if(strcmp(strchr(was, ' '), fp)) {
+			error_out(ERROR_ERROR_JOURNALOPT, 0, FLN, file);
+			goto fail;
+		}
+		if(valid < j->size && ftruncate(fd, valid) < 0) {
+			error_out(ERROR_ERROR_JOURNAL, errno, FLN, file);
+			goto fail;
+		}
+		journal_load(j, rec, n, !strncmp(was, mode, strlen(mode)) &&
+			     was[strlen(mode)] == ' ');
+		j->resumed = n;
+	}
+
+	j->out = writer_open(fd);
+	if(!st.st_size) {
+		writer_write(j->out, JOURNAL_MAGIC, hlen);
+		writer_write(j->out, mode, strlen(mode));
+		writer_write(j->out, fp, strlen(fp) + 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &j->synced);
+
+	return j;
+
+ fail:
+	if(j->map)
+		munmap(j->map, j->size);
+	close(fd);
+	free(j);
+	return NULL;
+}
+
+/*
+ * Tell how many files the journal recorded as completed when it
+ * was opened.
+ */
+unsigned long
+journal_resumed(struct journal *j)
+{
+	return j->resumed;
+}
+
+/*
+ * Tell whether the file at input position pos, path, was completed
+ * before.
+ */
+GENERAL_BOOL
+journal_completed(struct journal *j, unsigned long long pos, const char *path)
+{
+	uint64_t h;
+	size_t i;
+
+	if(pos < j->watermark && !strcmp(j->done[pos], path))
+		return TRUE;
+	if(!j->slots)
+		return FALSE;
+
+	h = path_hash(path);
+	for(i = h & (j->nslots - 1); j->slots[i].hash;
+	    i = (i + 1) & (j->nslots - 1)) {
+		if(j->slots[i].hash == h && !strcmp(j->slots[i].path, path))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * Hand what was recorded so far to the disk. Called with the
+ * writer locked.
+ */
+static void
+journal_sync(struct journal *j)
+{
+	if(writer_flush(j->out) == 0)
+		fdatasync(j->fd);
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &j->synced);
+}
+
+/*
+ * Record the file at input position pos, path, as completed. Safe
+ * to call from several threads.
+ */
+void
+journal_add(struct journal *j, unsigned long long pos, const char *path)
+{
+	struct timespec now;
+	char num[24];
+	int len;
+
+	len = snprintf(num, sizeof num, "%llu ", pos);
+
+	writer_lock(j->out);
+	writer_write(j->out, num, len);
+	writer_write(j->out, path, strlen(path) + 1);
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if((now.tv_sec - j->synced.tv_sec) * 1000000000LL +
+	   (now.tv_nsec - j->synced.tv_nsec) >= JOURNAL_SYNC_NS)
+		journal_sync(j);
+	writer_unlock(j->out);
+}
+
+/*
+ * Sync and close the journal.
+ * Returns 0 on success, -1 if records were lost.
+ */
+int
+journal_close(struct journal *j)
+{
+	int rc = 0;
+
+	if(!j)
+		return 0;
+	if(writer_close(j->out) < 0 || fdatasync(j->fd) < 0) {
+		error_out(ERROR_ERROR_JOURNAL, errno, FLN, j->file);
+		rc = -1;
+	}
+	close(j->fd);
+	if(j->map)
+		munmap(j->map, j->size);
+	free(j->done);
+	free(j->slots);
+	free(j);
+
+	return rc;
+}
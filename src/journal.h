@@ -0,0 +1,44 @@
+/*
+ *      journal.h - Checkpoint journal to resume interrupted runs
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef STROKE_JOURNAL_H
+#define STROKE_JOURNAL_H 1
+
+#include <libgeneral/general.h>
+#include <stddef.h>
+
+/* Opaque journal of completed files */
+struct journal;
+
+/*
+ * Function declarations
+ */
+extern struct journal* journal_open(const char *file, GENERAL_BOOL ordered,
+				     const char *const settings[],
+				     size_t n_settings);
+extern unsigned long journal_resumed(struct journal *j);
+extern GENERAL_BOOL journal_completed(struct journal *j, unsigned long long pos,
+				      const char *path);
+extern void journal_add(struct journal *j, unsigned long long pos,
+			const char *path);
+extern int journal_close(struct journal *j);
+
+#endif /* STROKE_JOURNAL_H */
@@ -0,0 +1,72 @@
+/*
+ *      arena.h - Bump-pointer allocation with scoped release
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef LIBGENERAL_ARENA_H
+#define LIBGENERAL_ARENA_H 1
+
+#include <stddef.h>
+
+/*
+ * Chunk of memory handed out by an arena.
+ */
+typedef struct __ARENA_CHUNK ARENA_CHUNK;
+
+struct __ARENA_CHUNK {
+	ARENA_CHUNK *next;
+	size_t size;         /* Usable bytes */
+	size_t used;
+};
+
+/*
+ * Memory taken from a few large chunks, one piece after the other.
+ * Pieces are never freed one by one: everything allocated since a
+ * mark is given back at once by arena_release(), and the chunks
+ * are kept for what is allocated next.
+ */
+typedef struct {
+	ARENA_CHUNK *cur;    /* Chunk allocated from; older ones follow */
+	ARENA_CHUNK *spare;  /* Released chunks */
+	size_t chunk_size;
+} ARENA;
+
+/*
+ * Position within an arena; see arena_mark().
+ */
+typedef struct {
+	ARENA_CHUNK *chunk;
+	size_t used;
+} ARENA_MARK;
+
+/* New/destroy arena */
+extern ARENA* arena_new(size_t chunk_size);
+extern void arena_destroy(ARENA **);
+
+/* Allocation */
+extern void* arena_alloc(ARENA *, size_t size);
+extern char* arena_str(ARENA *, const char *str);
+extern char* arena_strn(ARENA *, const char *str, size_t len);
+
+/* Scoped release */
+extern ARENA_MARK arena_mark(ARENA *);
+extern void arena_release(ARENA *, ARENA_MARK mark);
+extern void arena_reset(ARENA *);
+
+#endif /* LIBGENERAL_ARENA_H */
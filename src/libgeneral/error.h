@@ -106,6 +106,8 @@ extern void clean_error_message(ERROR_MESSAGE *e);
 extern void error_out(int code, int errno_err, const char *file, const int line, ...);
 extern void errors_out(int error_stack_num);
 extern void error_store(int error_stack_num, int code, int errno_err, const char *file, const int line, ...);
+extern void error_set_last(int code, int errno_err);
+extern void error_last(int *code, int *errno_err);
 extern void errwrn(ERROR_TYPE type, int errno_err, const char *file, const int line, char *err, ...);
 
 #endif /* LIBGENERAL_ERROR_H */
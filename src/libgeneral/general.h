@@ -120,6 +120,8 @@ extern void libgeneral_set_flag(_FLAG_TYPE flag);
 extern void libgeneral_unset_flag(_FLAG_TYPE flag);
 extern void libgeneral_init_verbose(int (*verbose_func)(), const char *prefix, int max_level);
 extern GENERAL_BOOL libgeneral_check_flag(_FLAG_TYPE flag);
+extern void libgeneral_lock();
+extern void libgeneral_unlock();
 
 /* Memory managment */
 extern void* general_malloc(size_t size);
@@ -0,0 +1,163 @@
+/*
+ *      arena.c - Bump-pointer allocation with scoped release
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include <libgeneral/arena.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libgeneral/general.h>
+
+/* Alignment of every piece handed out */
+#define ARENA_ALIGN 16
+
+/* Room taken by the chunk header; the data follows aligned */
+#define ARENA_HEAD ((sizeof(ARENA_CHUNK) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+#define CHUNK_DATA(C) ((char*)(C) + ARENA_HEAD)
+
+/**
+ * Create an arena that takes memory chunk_size bytes at a time.
+ */
+ARENA* arena_new(size_t chunk_size)
+{
+	ARENA *a = general_malloc(sizeof(ARENA));
+
+	a->cur = a->spare = NULL;
+	a->chunk_size = chunk_size;
+	return a;
+}
+
+/**
+ * Free the arena with everything allocated from it.
+ */
+void arena_destroy(ARENA **a)
+{
+	ARENA_CHUNK *c, *next;
+	int i;
+
+	if( !*a ) return;
+	for( i = 0; i < 2; i++ ) {
+		for( c = i ? (*a)->spare : (*a)->cur; c; c = next ) {
+			next = c->next;
+			free(c);
+		}
+	}
+	free(*a);
+	*a = NULL;
+}
+
+/**
+ * Make a chunk holding at least size bytes the current one, reusing a
+ * released chunk if one is large enough.
+ */
+static void arena_grow(ARENA *a, size_t size)
+{
+	ARENA_CHUNK *c, **p;
+
+	for( p = &a->spare; *p && (*p)->size < size; p = &(*p)->next );
+	if( (c = *p) ) {
+		*p = c->next;
+	} else {
+		if( size < a->chunk_size ) size = a->chunk_size;
+		c = general_malloc(ARENA_HEAD + size);
+		c->size = size;
+	}
+	c->used = 0;
+	c->next = a->cur;
+	a->cur = c;
+}
+
+/**
+ * Allocate size bytes, aligned for any type. The memory stays valid
+ * until released with arena_release() or arena_reset().
+ */
+void* arena_alloc(ARENA *a, size_t size)
+{
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if( !a->cur || a->cur->size - a->cur->used < size )
+		arena_grow(a, size);
+	p = CHUNK_DATA(a->cur) + a->cur->used;
+	a->cur->used += size;
+	return p;
+}
+
+/**
+ * Copy the first len bytes of str into the arena and terminate them.
+ */
+char* arena_strn(ARENA *a, const char *str, size_t len)
+{
+	char *s = arena_alloc(a, len + 1);
+
+	memcpy(s, str, len);
+	s[len] = '\0';
+	return s;
+}
+
+/**
+ * Copy str into the arena; like cpy_string() but never to be free'd.
+ */
+char* arena_str(ARENA *a, const char *str)
+{
+	return arena_strn(a, str, strlen(str));
+}
+
+/**
+ * Remember the current position, to release everything allocated
+ * after it later on.
+ */
+ARENA_MARK arena_mark(ARENA *a)
+{
+	ARENA_MARK m;
+
+	m.chunk = a->cur;
+	m.used = a->cur ? a->cur->used : 0;
+	return m;
+}
+
+/**
+ * Give back everything allocated since mark was taken. Marks must be
+ * released in the reverse order they were taken.
+ */
+void arena_release(ARENA *a, ARENA_MARK mark)
+{
+	ARENA_CHUNK *c;
+
+	while( a->cur != mark.chunk ) {
+		c = a->cur;
+		a->cur = c->next;
+		c->next = a->spare;
+		a->spare = c;
+	}
+	if( a->cur ) a->cur->used = mark.used;
+}
+
+/**
+ * Give back everything allocated from the arena.
+ */
+void arena_reset(ARENA *a)
+{
+	ARENA_MARK none = {NULL, 0};
+
+	arena_release(a, none);
+}
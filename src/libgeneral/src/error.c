@@ -72,6 +72,13 @@ char* strerr(int errno) {
  */
 int last_error_code;
 
+/*
+ * Code and errno of the last error reported by the calling thread;
+ * see error_last().
+ */
+static __thread int thread_error_code;
+static __thread int thread_error_errno;
+
 /*
  * Errors and warnings counted 
  */
@@ -184,21 +191,47 @@ void error_out(int code, int errno_err, const char *file, const int line, ...) {
 	ERROR_MESSAGE *m;
 	ARG_ARRAY args;
 	va_list l;
+	int saved_errno = errno;
 	
 	va_start(l, line);
+	libgeneral_lock();
 	m = find_error(code);
 	
 	last_error_code = code;
+	if( error_type(code) != ERROR_WARNING )
+		error_set_last(code, errno_err ? errno_err : saved_errno);
 	
 	verror(error_type(code), errno_err, file, line, m->msg,
 	       (args = varg_to_argarr(m->msg, l)),
 	       libgeneral_check_flag(OPTION_ERROR_CODE_ON_ERROR));
 	
 	arg_array_destroy(args);
+	libgeneral_unlock();
 	
 	va_end(l);
 }
 
+/**
+ * Note that the calling thread failed with error code, caused by
+ * errno_err (0 if none). Also for errors reported by other means
+ * than error_out().
+ */
+void error_set_last(int code, int errno_err) {
+	last_error_code = code;
+	thread_error_code = code;
+	thread_error_errno = errno_err;
+}
+
+/**
+ * Retrieve code and errno of the last error reported by the calling
+ * thread; both are 0 if it has not reported any. Warnings are not
+ * taken into account.
+ */
+void error_last(int *code, int *errno_err) {
+	*code = thread_error_code;
+	*errno_err = thread_error_errno;
+}
+
 /**
  * Returns true if error is on error stack given by name.
  */
@@ -390,8 +423,10 @@ void errwrn(
 	va_list ap;
 	ARG_ARRAY arg_ar = NULL;
 	va_start(ap, err);
+	libgeneral_lock();
 	verror(type, errno_err, file, line, err, (arg_ar = varg_to_argarr(err, ap)), 0);
 	arg_array_destroy(arg_ar);
+	libgeneral_unlock();
 	va_end(ap);
 }
 	
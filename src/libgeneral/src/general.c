@@ -3,7 +3,9 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <pthread.h>
 
+#include <libgeneral/arena.h>
 #include <libgeneral/args.h>
 #include <libgeneral/error.h>
 
@@ -23,6 +25,14 @@ _FLAG_TYPE libgeneral_flags;
 /* Bool if library is initialized already */
 static GENERAL_BOOL initialized;
 
+/* Serializes output and the shared state used while printing */
+static pthread_mutex_t output_lock;
+static pthread_once_t output_lock_once = PTHREAD_ONCE_INIT;
+
+/* Stored strings handed out by new_str() */
+#define NEW_STR_CHUNK 4096
+static ARENA *str_strg;
+
 /*
  * General
  */
@@ -42,9 +52,37 @@ void libgeneral_uninit()
 	if(initialized && prog_name) {
 		free(prog_name);
 		visual_spacing(0);
-		new_str(0);
+		arena_destroy(&str_strg);
 	}
 }
+/*
+ * Output locking.
+ * Messages, verbose output and errors may be emitted from several
+ * threads; they are formatted through shared static buffers (see
+ * new_str()) and must therefore not interleave. The lock is
+ * recursive as printing an error may lead to another one.
+ */
+
+static void output_lock_init()
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&output_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void libgeneral_lock()
+{
+	pthread_once(&output_lock_once, &output_lock_init);
+	pthread_mutex_lock(&output_lock);
+}
+
+void libgeneral_unlock()
+{
+	pthread_mutex_unlock(&output_lock);
+}
+
 /*
  * Libgeneral options
  */
@@ -204,32 +242,21 @@ char *readline_stream(FILE *s)
  * A function may obtain such a reference by calling new_str( str ). Then str is 
  * copied into the newly allocated heap memory.
  * To clean up heap memory, new_str(NULL) should be called at frequent intervals.
+ * The strings are taken from an arena, so neither storing nor cleaning up
+ * calls the allocator once it has grown to the usual amount.
  * Will return NULL if an error occured or if string
  * supplied was somehow invalid.
  */
 char* new_str(const char *str)
 {
-	static char **str_strg;
-	static int num_strs;
-	char *ret = (char*)0;
-	
-	/* str was passed; store string on heap */
+	/* str was passed; store string in the arena */
 	if( str ) {
-		str_strg = (char**)general_realloc(str_strg, (num_strs + 1) * sizeof(char*));
-		str_strg[num_strs] = (char*)general_malloc(strlen(str) + 1);
-		strcpy(str_strg[num_strs], str);
-		ret = *(str_strg + num_strs);
-		++num_strs;
-	} 
-	/* NULL was passed; do cleanups */
-	else if( num_strs > 0 ) {
-		while( num_strs > 0 ) {
-			free(str_strg[--num_strs]);	
-		}
-		free(str_strg);
-		str_strg = (char**)0;
+		if( !str_strg ) str_strg = arena_new(NEW_STR_CHUNK);
+		return arena_str(str_strg, str);
 	}
-	return ret;
+	/* NULL was passed; do cleanups, keeping the memory for reuse */
+	if( str_strg ) arena_reset(str_strg);
+	return (char*)0;
 }
 
 /**
@@ -348,9 +375,11 @@ int msg(const char *msg, ...)
 	va_start(ap, msg);
 	if( !msg || !*msg || strlen(msg) < 1 ) return 0;
 	if( !libgeneral_check_flag(OPTION_QUIET) ) {
+		libgeneral_lock();
 		_VSPACING(ap, msg, 0);
 		_prfx_print(stdout, prog_name, msg, ap);
 		putc('\n', stdout);
+		libgeneral_unlock();
 	}
 	va_end(ap);
 	return 0;
@@ -369,6 +398,7 @@ void verbose(int vlevel, const char *msg, ... )
 	if( !libgeneral_check_flag(OPTION_QUIET) ) {
 		/* Verbosity level check */
 		if(vlevel <= verbosity && verbosity > 0) {
+			libgeneral_lock();
 			_VSPACING(ap, msg, 1);
 			*level = 0;
 			if(libgeneral_check_flag(OPTION_VERBOSE_SHOW_LEVEL))
@@ -376,6 +406,7 @@ void verbose(int vlevel, const char *msg, ... )
 			sprintf(prfx, "%s: %s%s", prog_name, vprefix, level);
 			_prfx_print(stdout, prfx, msg, ap);
 			putc('\n', stdout);
+			libgeneral_unlock();
 		}
 	}
 	va_end(ap);
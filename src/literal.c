@@ -0,0 +1,239 @@
+/*
+ *      literal.c - Fast parsing of literal time stamps
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "stroke.h"
+#include "literal.h"
+#include "zone.h"
+
+#include <string.h>
+
+/*
+ * The SPEC grammar accepts a great many forms, and running the full
+ * parser costs a lexer pass, keyword table scans and several calls
+ * into the time zone code per time stamp. Nearly every time stamp
+ * handed to stroke by scripts, however, is either seconds since the
+ * epoch or an ISO 8601 / RFC 3339 date and time. Those are
+ * recognised here and converted directly; whatever does not match
+ * exactly is left to the grammar, so the result never differs from
+ * what parse_datetime() would have produced.
+ */
+
+#define IS_DIGIT(C) ((C) >= '0' && (C) <= '9')
+
+/*
+ * Read exactly n digits from *p, not going past end.
+ * Returns the value, or -1 if there are not n digits.
+ */
+static int
+digits(const char **p, const char *end, int n)
+{
+	const char *s = *p;
+	int v = 0;
+
+	if(end - s < n)
+		return -1;
+	for(; n; n--, s++) {
+		if(!IS_DIGIT(*s))
+			return -1;
+		v = v * 10 + (*s - '0');
+	}
+	*p = s;
+	return v;
+}
+
+/*
+ * Read an optional fraction of a second, `.' or `,' followed by one
+ * to nine digits, into *nsec. More digits would need rounding the
+ * way the grammar does it and are left to the grammar.
+ * Returns 0 on success, -1 if the fraction cannot be handled.
+ */
+static int
+fraction(const char **p, const char *end, long *nsec)
+{
+	const char *s = *p;
+	long scale = 100000000L;
+
+	*nsec = 0;
+	if(s == end || (*s != '.' && *s != ','))
+		return 0;
+	if(++s == end || !IS_DIGIT(*s))
+		return -1;
+	for(; s < end && IS_DIGIT(*s); s++) {
+		if(!scale)
+			return -1;
+		*nsec += (*s - '0') * scale;
+		scale /= 10;
+	}
+	*p = s;
+	return 0;
+}
+
+static int
+days_in_month(int y, int m)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	if(m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))
+		return 29;
+	return days[m-1];
+}
+
+/*
+ * Convert s, of length len, if it is a number of seconds since the
+ * epoch: an optional `-', up to 18 digits and an optional fraction.
+ * Returns 1 if converted, 0 if s has any other form.
+ */
+int
+literal_epoch(const char *s, size_t len, struct timespec *ts)
+{
+	const char *p = s, *end = s + len;
+	GENERAL_BOOL neg = FALSE;
+	long long sec = 0;
+	long nsec;
+	int n = 0;
+
+	if(p < end && *p == '-') {
+		neg = TRUE;
+		++p;
+	}
+	for(; p < end && IS_DIGIT(*p); p++) {
+		if(++n > 18)
+			return 0;
+		sec = sec * 10 + (*p - '0');
+	}
+	if(!n || fraction(&p, end, &nsec) < 0 || p != end)
+		return 0;
+
+	ts->tv_sec = neg ? -sec : sec;
+	ts->tv_nsec = nsec;
+	if(neg && nsec) {
+		--ts->tv_sec;
+		ts->tv_nsec = 1000000000L - nsec;
+	}
+	return 1;
+}
+
+/*
+ * Convert s, of length len, if it is a literal time stamp, either
+ * `@' followed by seconds since the epoch or an ISO 8601 date
+ * YYYY-MM-DD, optionally followed by `T' or a space, HH:MM, and
+ * optionally :SS with a fraction and a zone of `Z', +HH, +HHMM or
+ * +HH:MM. A date and time without a zone is local time, or UTC if
+ * parse_as_utc is TRUE.
+ * Returns 1 if converted, 0 if s has to go through the grammar.
+ */
+int
+literal_parse(const char *s, size_t len, struct timespec *ts,
+	      GENERAL_BOOL parse_as_utc)
+{
+	const char *p = s, *end = s + len;
+	int year, mon, mday, hour = 0, min = 0, sec = 0;
+	long nsec = 0, off = 0;
+	GENERAL_BOOL zone = FALSE;
+	struct tm tm;
+	time_t t;
+
+	if(len && *s == '@')
+		return literal_epoch(s + 1, len - 1, ts);
+
+	if((year = digits(&p, end, 4)) < 0 || p == end || *p++ != '-' ||
+	   (mon = digits(&p, end, 2)) < 1 || mon > 12 || p == end || *p++ != '-' ||
+	   (mday = digits(&p, end, 2)) < 1 || mday > days_in_month(year, mon))
+		return 0;
+
+	if(p < end) {
+		if(*p != 'T' && *p != ' ')
+			return 0;
+		++p;
+		if((hour = digits(&p, end, 2)) < 0 || hour > 23 ||
+		   p == end || *p++ != ':' ||
+		   (min = digits(&p, end, 2)) < 0 || min > 59)
+			return 0;
+		if(p < end && *p == ':') {
+			++p;
+			if((sec = digits(&p, end, 2)) < 0 || sec > 59 ||
+			   fraction(&p, end, &nsec) < 0)
+				return 0;
+		}
+
+		if(p < end && *p == 'Z') {
+			zone = TRUE;
+			++p;
+		} else if(p < end && (*p == '+' || *p == '-')) {
+			int sign = *p++ == '-' ? -1 : 1, oh, om = 0;
+
+			if((oh = digits(&p, end, 2)) < 0 || oh > 24)
+				return 0;
+			if(p < end) {
+				if(*p == ':')
+					++p;
+				if((om = digits(&p, end, 2)) < 0 || om > 59)
+					return 0;
+			}
+			zone = TRUE;
+			off = sign * (oh * 3600L + om * 60L);
+		}
+		if(p != end)
+			return 0;
+	}
+
+	if(zone || parse_as_utc) {
+		ts->tv_sec = (time_t)days_from_civil(year, mon, mday) * 86400 +
+			hour * 3600L + min * 60L + sec - off;
+		ts->tv_nsec = nsec;
+		return 1;
+	}
+
+	/*
+	 * Local time: a time skipped or repeated by a daylight saving
+	 * change is left to the grammar, which rejects the former and
+	 * has its own way of picking one of the latter.
+	 */
+	memset(&tm, 0, sizeof tm);
+	tm.tm_year = year - 1900;
+	tm.tm_mon = mon - 1;
+	tm.tm_mday = mday;
+	tm.tm_hour = hour;
+	tm.tm_min = min;
+	tm.tm_sec = sec;
+	tm.tm_isdst = -1;
+	switch(zone_mktime(&tm, &t)) {
+	case 1:
+		ts->tv_sec = t;
+		ts->tv_nsec = nsec;
+		return 1;
+	case 0:
+		return 0;
+	}
+
+	/* No zone of our own; mktime() makes the same choice the grammar does */
+	if((t = mktime(&tm)) == (time_t)-1 ||
+	   tm.tm_year != year - 1900 || tm.tm_mon != mon - 1 ||
+	   tm.tm_mday != mday || tm.tm_hour != hour || tm.tm_min != min ||
+	   tm.tm_sec != sec)
+		return 0;
+
+	ts->tv_sec = t;
+	ts->tv_nsec = nsec;
+	return 1;
+}
@@ -0,0 +1,220 @@
+/*
+ *      manifest.c - Per-file time stamp lists for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "manifest.h"
+
+#include "stroke.h"
+#include "errors.h"
+#include "input.h"
+
+#include <libgeneral/error.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * A manifest holds one record per line: a path and up to
+ * MANIFEST_FIELDS time stamps, separated by tabs. Empty lines and
+ * lines starting with `#' are skipped.
+ *
+ * A regular file is mapped and its records are located with
+ * memchr(), which the C library implements with vector
+ * instructions; only the path of the current record is copied, so
+ * that it can be NUL-terminated. Anything else (a pipe, standard
+ * input) is read through a path_reader instead.
+ */
+struct manifest {
+	const char *file;
+
+	/* Mapped file, or NULL if read through reader */
+	const char *map;
+	size_t size;
+	size_t pos;
+	struct path_reader *reader;
+
+	unsigned long line;
+	char *path;
+	size_t pathsz;
+};
+
+/*
+ * Open manifest file; "-" is standard input.
+ * Returns NULL on failure.
+ */
+struct manifest*
+manifest_open(const char *file)
+{
+	struct manifest *m;
+	struct stat st;
+	void *map;
+	int fd;
+
+	m = general_malloc(sizeof *m);
+	memset(m, 0, sizeof *m);
+	m->file = file;
+
+	if(strcmp(file, "-")) {
+		if((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0) {
+			error_out(ERROR_ERROR_FOPEN, errno, FLN, file);
+			if(fd >= 0)
+				close(fd);
+			free(m);
+			return NULL;
+		}
+
+		if(S_ISREG(st.st_mode)) {
+			map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) :
+				NULL;
+			close(fd);
+			if(map == MAP_FAILED) {
+				error_out(ERROR_ERROR_READLST, errno, FLN, file);
+				free(m);
+				return NULL;
+			}
+			if(map)
+				madvise(map, st.st_size, MADV_SEQUENTIAL);
+			m->map = map ? map : "";
+			m->size = st.st_size;
+			return m;
+		}
+		close(fd);
+	}
+
+	if(!(m->reader = path_reader_open(file, '\n'))) {
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+/*
+ * Fetch the next line of the manifest, without its terminator or a
+ * carriage return before it, and count it. The reader skips empty lines, but counts them as well.
+ * Returns 1 if a line was read, 0 at the end, -1 on failure.
+ */
+static int
+manifest_line(struct manifest *m, const char **line, size_t *len)
+{
+	const char *p, *nl;
+	int rc;
+
+	if(m->reader) {
+		if((rc = path_reader_next(m->reader, line)) > 0) {
+			*len = strlen(*line);
+			if((*line)[*len-1] == '\r')
+				--*len;
+			m->line = path_reader_count(m->reader);
+		}
+		return rc;
+	}
+
+	if(m->pos >= m->size)
+		return 0;
+
+	p = m->map + m->pos;
+	if((nl = memchr(p, '\n', m->size - m->pos))) {
+		*len = nl - p;
+		m->pos += *len + 1;
+	} else {
+		*len = m->size - m->pos;
+		m->pos = m->size;
+	}
+	if(*len && p[*len-1] == '\r')
+		--*len;
+
+	*line = p;
+	++m->line;
+	return 1;
+}
+
+/*
+ * Fetch the next record of the manifest.
+ * Returns 1 if a record was read, 0 at the end, -1 on failure.
+ */
+int
+manifest_next(struct manifest *m, struct manifest_record *rec)
+{
+	const char *line, *end, *tab;
+	size_t len, plen;
+	char buf[32];
+	int rc, i;
+
+	do {
+		if((rc = manifest_line(m, &line, &len)) <= 0)
+			return rc;
+	} while(!len || *line == '#');
+
+	end = line + len;
+	if(!(tab = memchr(line, '\t', len)) || tab == line) {
+		snprintf(buf, sizeof buf, "%lu", m->line);
+		error_out(ERROR_ERROR_MANIFEST, 0, FLN, m->file, buf);
+		return -1;
+	}
+
+	plen = tab - line;
+	if(plen + 1 > m->pathsz) {
+		while(plen + 1 > m->pathsz)
+			m->pathsz = m->pathsz ? m->pathsz << 1 : 256;
+		m->path = general_realloc(m->path, m->pathsz);
+	}
+	memcpy(m->path, line, plen);
+	m->path[plen] = 0;
+
+	for(i = 0; i < MANIFEST_FIELDS; i++) {
+		const char *f = tab ? tab + 1 : end;
+
+		tab = f < end ? memchr(f, '\t', end - f) : NULL;
+		rec->field[i] = f;
+		rec->len[i] = (tab ? tab : end) - f;
+	}
+	if(tab) {
+		snprintf(buf, sizeof buf, "%lu", m->line);
+		error_out(ERROR_ERROR_MANIFEST, 0, FLN, m->file, buf);
+		return -1;
+	}
+
+	rec->path = m->path;
+	rec->line = m->line;
+	return 1;
+}
+
+/*
+ * Unmap or close the manifest; standard input is left open.
+ */
+void
+manifest_close(struct manifest *m)
+{
+	if(!m)
+		return;
+	if(m->reader)
+		path_reader_close(m->reader);
+	else if(m->size)
+		munmap((void*)m->map, m->size);
+	free(m->path);
+	free(m);
+}
@@ -0,0 +1,56 @@
+/*
+ *      manifest.h - Per-file time stamp lists for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#ifndef STROKE_MANIFEST_H
+#define STROKE_MANIFEST_H 1
+
+#include <sys/types.h>
+
+#include <libgeneral/general.h>
+
+/* Number of time stamp fields after the path */
+#define MANIFEST_FIELDS 2
+
+/*
+ * One record of a manifest. path is NUL-terminated; the fields are
+ * not, and are empty if missing. All remain valid until the next
+ * call to manifest_next().
+ */
+struct manifest_record {
+	const char *path;
+	const char *field[MANIFEST_FIELDS];
+	size_t len[MANIFEST_FIELDS];
+	unsigned long line;
+};
+
+/* Opaque reader state */
+struct manifest;
+
+/*
+ * Function declarations
+ */
+extern struct manifest* manifest_open(const char *file);
+extern int manifest_next(struct manifest *m, struct manifest_record *rec);
+extern void manifest_close(struct manifest *m);
+
+#endif /* STROKE_MANIFEST_H */
@@ -0,0 +1,386 @@
+/*
+ *      output.c - Machine-readable per-file records
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "output.h"
+
+#include "stroke.h"
+
+#include <string.h>
+
+/*
+ * Records are serialized straight into the buffer of the writer,
+ * field by field, without allocating. Strings are copied as they
+ * are unless they hold a byte that needs escaping, which a scan
+ * finds first; paths are taken as bytes and never recoded.
+ *
+ * The binary format starts with BIN_MAGIC and then holds one
+ * record per file, a BIN_HEAD byte header followed by the path,
+ * a NUL, the link target, a NUL and zero bytes up to a multiple of
+ * eight. All numbers are little-endian:
+ *
+ *   0  u32 size of the whole record
+ *   4  u8  action (ACTION_*)
+ *   5  u8  flags: 1 exists, 2 symbolic link, 4 dangling
+ *   6  u16 zero
+ *   8  u32 length of the path
+ *  12  u32 length of the link target
+ *  16  i64 seconds of mtime, atime and ctime
+ *  40  u32 nanoseconds of mtime, atime and ctime
+ *  52  u32 zero
+ */
+
+#define BIN_MAGIC "STROKEr1"
+#define BIN_HEAD 56
+
+#define BIN_EXISTS 1
+#define BIN_LINK 2
+#define BIN_DANGLING 4
+
+/* Longest nanosecond count written by put_ns() */
+#define NS_MAX 32
+
+static const char *actions[] = {
+	"show", "missing", "set", "create", "unchanged", "dry-run", "failed"
+};
+
+static const char *csv_head = "path,link,dangling,mtime_ns,atime_ns,ctime_ns,action\n";
+
+/*
+ * Kind of output called name.
+ * Returns OUTPUT_*, or -1 if there is none.
+ */
+int
+output_kind(const char *name)
+{
+	if(!strcmp(name, "jsonl"))
+		return OUTPUT_JSONL;
+	if(!strcmp(name, "csv"))
+		return OUTPUT_CSV;
+	if(!strcmp(name, "bin"))
+		return OUTPUT_BIN;
+	return -1;
+}
+
+/*
+ * Write what comes before the first record.
+ */
+void
+output_begin(int kind, struct writer *w)
+{
+	if(kind == OUTPUT_CSV)
+		writer_write(w, csv_head, strlen(csv_head));
+	else if(kind == OUTPUT_BIN)
+		writer_write(w, BIN_MAGIC, sizeof BIN_MAGIC - 1);
+}
+
+/*
+ * Write ts as a whole number of nanoseconds to p. The digits are
+ * put together from seconds and nanoseconds, so no time stamp is
+ * out of range.
+ * Returns the number of bytes written.
+ */
+static size_t
+put_ns(char *p, const struct timespec *ts)
+{
+	unsigned long long sec;
+	long nsec;
+	char digits[NS_MAX];
+	size_t len = 0;
+	int n = 0, width;
+
+	if(ts->tv_sec < 0) {
+		p[len++] = '-';
+		sec = -(unsigned long long)ts->tv_sec;
+		if((nsec = ts->tv_nsec)) {
+			--sec;
+			nsec = 1000000000L - nsec;
+		}
+	} else {
+		sec = ts->tv_sec;
+		nsec = ts->tv_nsec;
+	}
+
+	width = sec ? 9 : 1;
+	do {
+		digits[n++] = '0' + nsec % 10;
+		nsec /= 10;
+	} while(nsec || n < width);
+	while(sec) {
+		digits[n++] = '0' + sec % 10;
+		sec /= 10;
+	}
+
+	while(n)
+		p[len++] = digits[--n];
+	return len;
+}
+
+static void
+write_ns(struct writer *w, const struct timespec *ts)
+{
+	writer_commit(w, put_ns(writer_reserve(w, NS_MAX), ts));
+}
+
+/*
+ * Length of the UTF-8 sequence p starts with, or 0 if it is not
+ * a valid one; overlong forms and surrogates are not.
+ */
+static int
+utf8_len(const unsigned char *p)
+{
+	unsigned char lo = 0x80, hi = 0xbf;
+	int n, i;
+
+	if(*p < 0x80)
+		return 1;
+	if(*p < 0xc2 || *p > 0xf4)
+		return 0;
+	n = *p < 0xe0 ? 2 : *p < 0xf0 ? 3 : 4;
+	if(*p == 0xe0)
+		lo = 0xa0;
+	else if(*p == 0xed)
+		hi = 0x9f;
+	else if(*p == 0xf0)
+		lo = 0x90;
+	else if(*p == 0xf4)
+		hi = 0x8f;
+
+	for(i = 1; i < n; i++, lo = 0x80, hi = 0xbf)
+		if(p[i] < lo || p[i] > hi)
+			return 0;
+	return n;
+}
+
+/*
+ * Write s as a JSON string. Bytes that are not part of valid UTF-8
+ * are written as \u00XX, which does not tell them apart from the
+ * characters U+0080 to U+00FF.
+ * Returns TRUE if s was written as it is, FALSE if it was not UTF-8.
+ */
+GENERAL_BOOL
+json_string(struct writer *w, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *p = (const unsigned char*)s;
+	char esc[6] = {'\\', 'u', '0', '0'};
+	GENERAL_BOOL utf8 = TRUE;
+	size_t run;
+	int n;
+
+	writer_write(w, "\"", 1);
+	while(*p) {
+		for(run = 0; p[run] >= 0x20 && p[run] != '"' && p[run] != '\\';
+		    run += n)
+			if(!(n = utf8_len(p + run)))
+				break;
+		writer_write(w, (const char*)p, run);
+		if(!*(p += run))
+			break;
+
+		switch(*p) {
+		case '"':  writer_write(w, "\\\"", 2); break;
+		case '\\': writer_write(w, "\\\\", 2); break;
+		case '\n': writer_write(w, "\\n", 2); break;
+		case '\t': writer_write(w, "\\t", 2); break;
+		default:
+			if(*p >= 0x80)
+				utf8 = FALSE;
+			esc[4] = hex[*p >> 4];
+			esc[5] = hex[*p & 15];
+			writer_write(w, esc, sizeof esc);
+		}
+		++p;
+	}
+	writer_write(w, "\"", 1);
+
+	return utf8;
+}
+
+/*
+ * Write s as a JSON string holding its bytes in base64.
+ */
+static void
+b64_string(struct writer *w, const char *s)
+{
+	static const char b64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const unsigned char *p = (const unsigned char*)s;
+	size_t len = strlen(s), i;
+	unsigned long v;
+	char q[4];
+
+	writer_write(w, "\"", 1);
+	for(i = 0; i < len; i += 3) {
+		v = (unsigned long)p[i] << 16;
+		if(i + 1 < len)
+			v |= p[i+1] << 8;
+		if(i + 2 < len)
+			v |= p[i+2];
+		q[0] = b64[v >> 18];
+		q[1] = b64[(v >> 12) & 63];
+		q[2] = i + 1 < len ? b64[(v >> 6) & 63] : '=';
+		q[3] = i + 2 < len ? b64[v & 63] : '=';
+		writer_write(w, q, 4);
+	}
+	writer_write(w, "\"", 1);
+}
+
+/*
+ * Write s as a CSV field, quoted only if it has to be.
+ */
+static void
+csv_string(struct writer *w, const char *s)
+{
+	const char *q;
+
+	if(!s[strcspn(s, ",\"\r\n")]) {
+		writer_write(w, s, strlen(s));
+		return;
+	}
+
+	writer_write(w, "\"", 1);
+	while((q = strchr(s, '"'))) {
+		writer_write(w, s, q - s + 1);
+		writer_write(w, "\"", 1);
+		s = q + 1;
+	}
+	writer_write(w, s, strlen(s));
+	writer_write(w, "\"", 1);
+}
+
+static void
+record_jsonl(struct writer *w, const struct output_record *rec)
+{
+	static const char *keys[] = {
+		",\"mtime_ns\":", ",\"atime_ns\":", ",\"ctime_ns\":"
+	};
+	int i;
+
+	/* Names that are not UTF-8 are given in base64 as well */
+	writer_write(w, "{\"path\":", 8);
+	if(!json_string(w, rec->path)) {
+		writer_write(w, ",\"path_b64\":", 12);
+		b64_string(w, rec->path);
+	}
+	writer_write(w, ",\"link\":", 8);
+	if(!rec->link) {
+		writer_write(w, "null", 4);
+	} else if(!json_string(w, rec->link)) {
+		writer_write(w, ",\"link_b64\":", 12);
+		b64_string(w, rec->link);
+	}
+	if(rec->dangling)
+		writer_write(w, ",\"dangling\":true", 16);
+	else
+		writer_write(w, ",\"dangling\":false", 17);
+	for(i = 0; i < TIME_TBLS; i++) {
+		writer_write(w, keys[i], strlen(keys[i]));
+		if(rec->times)
+			write_ns(w, &rec->times[i]);
+		else
+			writer_write(w, "null", 4);
+	}
+	writer_write(w, ",\"action\":\"", 11);
+	writer_write(w, actions[rec->action], strlen(actions[rec->action]));
+	writer_write(w, "\"}\n", 3);
+}
+
+static void
+record_csv(struct writer *w, const struct output_record *rec)
+{
+	int i;
+
+	csv_string(w, rec->path);
+	writer_write(w, ",", 1);
+	if(rec->link)
+		csv_string(w, rec->link);
+	writer_write(w, rec->dangling ? ",1" : ",0", 2);
+	for(i = 0; i < TIME_TBLS; i++) {
+		writer_write(w, ",", 1);
+		if(rec->times)
+			write_ns(w, &rec->times[i]);
+	}
+	writer_write(w, ",", 1);
+	writer_write(w, actions[rec->action], strlen(actions[rec->action]));
+	writer_write(w, "\n", 1);
+}
+
+static void
+put_le(unsigned char *p, unsigned long long v, int bytes)
+{
+	while(bytes--) {
+		*p++ = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static void
+record_bin(struct writer *w, const struct output_record *rec)
+{
+	static const char pad[8];
+	unsigned char head[BIN_HEAD];
+	size_t plen = strlen(rec->path), llen = rec->link ? strlen(rec->link) : 0;
+	size_t size = BIN_HEAD + plen + llen + 2;
+	int i, fl = 0;
+
+	if(rec->times)
+		fl |= BIN_EXISTS;
+	if(rec->link)
+		fl |= BIN_LINK;
+	if(rec->dangling)
+		fl |= BIN_DANGLING;
+
+	memset(head, 0, sizeof head);
+	put_le(head, (size + 7) & ~(size_t)7, 4);
+	head[4] = rec->action;
+	head[5] = fl;
+	put_le(head + 8, plen, 4);
+	put_le(head + 12, llen, 4);
+	for(i = 0; i < TIME_TBLS && rec->times; i++) {
+		put_le(head + 16 + 8 * i, rec->times[i].tv_sec, 8);
+		put_le(head + 40 + 4 * i, rec->times[i].tv_nsec, 4);
+	}
+
+	writer_write(w, (const char*)head, sizeof head);
+	writer_write(w, rec->path, plen + 1);
+	writer_write(w, rec->link ? rec->link : "", llen + 1);
+	writer_write(w, pad, -size & 7);
+}
+
+/*
+ * Write the record of one file. The caller holds the lock of w if
+ * it is shared.
+ */
+void
+output_record(int kind, struct writer *w, const struct output_record *rec)
+{
+	switch(kind) {
+	case OUTPUT_JSONL:
+		record_jsonl(w, rec);
+		break;
+	case OUTPUT_CSV:
+		record_csv(w, rec);
+		break;
+	case OUTPUT_BIN:
+		record_bin(w, rec);
+		break;
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ *      output.h - Machine-readable per-file records
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_OUTPUT_H
+#define STROKE_OUTPUT_H 1
+
+#include <libgeneral/general.h>
+#include <time.h>
+
+#include "writer.h"
+
+/* Record formats of `--output' */
+enum {
+	OUTPUT_JSONL = 1,
+	OUTPUT_CSV,
+	OUTPUT_BIN,
+};
+
+/* What was done to a file */
+enum {
+	ACTION_SHOW = 0,	/* inspected */
+	ACTION_MISSING,		/* inspected, but does not exist */
+	ACTION_SET,		/* time stamps changed */
+	ACTION_CREATE,		/* created, then time stamps set */
+	ACTION_UNCHANGED,	/* time stamps already as wanted */
+	ACTION_DRYRUN,		/* time stamps would have been changed */
+	ACTION_FAILED,		/* change time could not be set */
+};
+
+/* Everything a record tells about one file */
+struct output_record {
+	const char *path;
+	const char *link;		/* NULL if not a symbolic link */
+	GENERAL_BOOL dangling;
+	const struct timespec *times;	/* NULL if the file does not exist */
+	int action;
+};
+
+/*
+ * Function declarations
+ */
+extern int output_kind(const char *name);
+extern void output_begin(int kind, struct writer *w);
+extern void output_record(int kind, struct writer *w,
+			  const struct output_record *rec);
+extern GENERAL_BOOL json_string(struct writer *w, const char *s);
+
+#endif /* STROKE_OUTPUT_H */
@@ -0,0 +1,273 @@
+/*
+ *      pool.c - Work-stealing thread pool for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#include "pool.h"
+
+#include <libgeneral/error.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* Number of tasks each worker may have queued */
+#define POOL_DEQUE_SIZE 256
+
+/*
+ * Every worker owns a deque of tasks. The owner takes tasks
+ * from the front; a worker that runs dry steals from the back
+ * of the others' deques. As a slow file only ever holds up its
+ * own worker, the rest of the queue keeps draining.
+ */
+struct pool_deque {
+	pthread_mutex_t lock;
+	void *slots[POOL_DEQUE_SIZE];
+	size_t head;
+	size_t count;
+};
+
+struct pool_worker {
+	struct pool *pool;
+	pthread_t thread;
+	int id;
+};
+
+struct pool {
+	int nworkers;
+	struct pool_worker *workers;
+	struct pool_deque *deques;
+
+	POOL_HANDLER handler;
+	void *arg;
+
+	/* Protects queued and closing; signals work and space */
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t space;
+	long queued;
+	GENERAL_BOOL closing;
+
+	int failed;
+	int next;
+};
+
+/*
+ * Append task to the back of deque d.
+ * Returns 0 on success, -1 if the deque is full.
+ */
+static int
+deque_push(struct pool_deque *d, void *task)
+{
+	int rc = -1;
+
+	pthread_mutex_lock(&d->lock);
+	if(d->count < POOL_DEQUE_SIZE) {
+		d->slots[(d->head + d->count) % POOL_DEQUE_SIZE] = task;
+		++d->count;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return rc;
+}
+
+/*
+ * Take a task from the front (owner) or the back (thief) of d.
+ * Returns NULL if d is empty.
+ */
+static void*
+deque_take(struct pool_deque *d, GENERAL_BOOL steal)
+{
+	void *task = NULL;
+
+	pthread_mutex_lock(&d->lock);
+	if(d->count > 0) {
+		--d->count;
+		if(steal) {
+			task = d->slots[(d->head + d->count) % POOL_DEQUE_SIZE];
+		} else {
+			task = d->slots[d->head];
+			d->head = (d->head + 1) % POOL_DEQUE_SIZE;
+		}
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return task;
+}
+
+/*
+ * Fetch the next task for worker id: its own deque first, then
+ * any other. Returns NULL if all deques are empty.
+ */
+static void*
+pool_take(struct pool *p, int id)
+{
+	void *task;
+	int i;
+
+	if((task = deque_take(&p->deques[id], FALSE)))
+		return task;
+
+	for(i = 1; i < p->nworkers; i++) {
+		if((task = deque_take(&p->deques[(id + i) % p->nworkers], TRUE)))
+			return task;
+	}
+
+	return NULL;
+}
+
+static void*
+pool_worker_main(void *data)
+{
+	struct pool_worker *w = data;
+	struct pool *p = w->pool;
+	void *task;
+
+	for(;;) {
+		if(!(task = pool_take(p, w->id))) {
+			pthread_mutex_lock(&p->lock);
+			while(p->queued <= 0 && !p->closing)
+				pthread_cond_wait(&p->work, &p->lock);
+			if(p->queued <= 0 && p->closing) {
+				pthread_mutex_unlock(&p->lock);
+				break;
+			}
+			pthread_mutex_unlock(&p->lock);
+			continue;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		--p->queued;
+		pthread_cond_signal(&p->space);
+		pthread_mutex_unlock(&p->lock);
+
+		if((*p->handler)(p->arg, task, pool_failed(p)) < 0)
+			__atomic_store_n(&p->failed, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/*
+ * Start a pool of workers threads passing each submitted task
+ * to handler. Fails fatally if threads cannot be created.
+ */
+struct pool*
+pool_create(int workers, POOL_HANDLER handler, void *arg)
+{
+	struct pool *p = general_malloc(sizeof *p);
+	int i, err;
+
+	memset(p, 0, sizeof *p);
+	p->nworkers = workers;
+	p->handler = handler;
+	p->arg = arg;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->space, NULL);
+
+	p->deques = general_malloc(workers * sizeof *p->deques);
+	p->workers = general_malloc(workers * sizeof *p->workers);
+
+	for(i = 0; i < workers; i++) {
+		pthread_mutex_init(&p->deques[i].lock, NULL);
+		p->deques[i].head = p->deques[i].count = 0;
+	}
+
+	for(i = 0; i < workers; i++) {
+		p->workers[i].pool = p;
+		p->workers[i].id = i;
+		if((err = pthread_create(&p->workers[i].thread, NULL,
+					 &pool_worker_main, &p->workers[i])))
+			errwrn(ERROR_FATAL, err, FLN, "Unable to start worker threads");
+	}
+
+	return p;
+}
+
+/*
+ * Queue task, distributing tasks round-robin over the workers.
+ * Blocks while every deque is full. Must only be called from a
+ * single thread.
+ */
+void
+pool_submit(struct pool *p, void *task)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	while(p->queued >= (long)p->nworkers * POOL_DEQUE_SIZE)
+		pthread_cond_wait(&p->space, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+
+	for(i = 0; i < p->nworkers; i++) {
+		if(!deque_push(&p->deques[p->next], task))
+			break;
+		p->next = (p->next + 1) % p->nworkers;
+	}
+	p->next = (p->next + 1) % p->nworkers;
+
+	pthread_mutex_lock(&p->lock);
+	++p->queued;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Returns TRUE if a task has failed.
+ */
+GENERAL_BOOL
+pool_failed(struct pool *p)
+{
+	return __atomic_load_n(&p->failed, __ATOMIC_RELAXED) ? TRUE : FALSE;
+}
+
+/*
+ * Wait for all queued tasks, stop the workers and free the pool.
+ * Returns 0 if every task succeeded, -1 otherwise.
+ */
+int
+pool_finish(struct pool *p)
+{
+	int i, rc;
+
+	pthread_mutex_lock(&p->lock);
+	p->closing = TRUE;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+
+	for(i = 0; i < p->nworkers; i++)
+		pthread_join(p->workers[i].thread, NULL);
+
+	rc = pool_failed(p) ? -1 : 0;
+
+	for(i = 0; i < p->nworkers; i++)
+		pthread_mutex_destroy(&p->deques[i].lock);
+	pthread_cond_destroy(&p->space);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->lock);
+	free(p->workers);
+	free(p->deques);
+	free(p);
+
+	return rc;
+}
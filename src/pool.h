@@ -0,0 +1,46 @@
+/*
+ *      pool.h - Work-stealing thread pool for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_POOL_H
+#define STROKE_POOL_H 1
+
+#include <libgeneral/general.h>
+
+/*
+ * Task handler called by the workers. skip is TRUE once any
+ * task has failed; the handler should then only release task.
+ * A negative return value marks the pool as failed.
+ */
+typedef int (*POOL_HANDLER)(void *arg, void *task, GENERAL_BOOL skip);
+
+/* Opaque pool state */
+struct pool;
+
+/*
+ * Function declarations
+ */
+extern struct pool* pool_create(int workers, POOL_HANDLER handler, void *arg);
+extern void pool_submit(struct pool *p, void *task);
+extern GENERAL_BOOL pool_failed(struct pool *p);
+extern int pool_finish(struct pool *p);
+
+#endif /* STROKE_POOL_H */
@@ -0,0 +1,532 @@
+/*
+ *      snapshot.c - Time stamp snapshots of whole trees
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "stroke.h"
+#include "snapshot.h"
+#include "errors.h"
+
+#include <libgeneral/error.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Snapshot file layout; all integers are little endian.
+ *
+ *   header   SNAP_HEADER bytes: magic, flags, length of the root,
+ *            entry count, offsets of the four sections below, total
+ *            size
+ *   root     the working directory the paths are relative to, as
+ *            an absolute path; empty if it was not known
+ *   paths    per entry: length of the prefix shared with the path
+ *            before, length of the rest, the rest itself
+ *   mtime    per entry: difference to the mtime before, in
+ *   atime    nanoseconds since the epoch; likewise for atime and
+ *   ctime    ctime
+ *
+ * Entries are sorted by path, so that front coding leaves little
+ * more than the file names, and lengths and differences are stored
+ * as variable-length integers (differences zigzag encoded). Each
+ * column is read through its own cursor, so a snapshot is restored
+ * straight from the mapping without copying it.
+ *
+ * Snapshots of the first version, SNAP_MAGIC_V1, have no root.
+ */
+#define SNAP_MAGIC "STRKSNP\002"
+#define SNAP_MAGIC_V1 "STRKSNP\001"
+#define SNAP_HEADER 64
+#define SNAP_SYMLINKS 0x1
+
+/* Sections of a snapshot */
+enum {SEC_PATHS, SEC_MTIME, SEC_ATIME, SEC_CTIME, SECTIONS};
+
+/* Largest seconds value whose nanoseconds fit into 64 bits */
+#define SNAP_SEC_MAX 9000000000LL
+
+/*
+ * While a snapshot is taken the entries are collected in one
+ * buffer, each as its three times followed by the path.
+ */
+struct snap_rec {
+	int64_t ns[TIME_TBLS];
+	char path[];
+};
+
+struct snapshot {
+	char *file;
+	char *root;
+	GENERAL_BOOL symlinks;
+
+	pthread_mutex_t lock;
+	char *data;
+	size_t len;
+	size_t size;
+	unsigned long count;
+};
+
+struct snapshot_reader {
+	const char *file;
+	unsigned char *map;
+	size_t size;
+	char *root;
+	GENERAL_BOOL symlinks;
+	unsigned long count;
+	unsigned long left;
+
+	/* Read position and end of every section */
+	const unsigned char *cur[SECTIONS];
+	const unsigned char *end[SECTIONS];
+	int64_t prev[TIME_TBLS];
+
+	/* Path of the current entry */
+	char *path;
+	size_t pathlen;
+	size_t pathsz;
+};
+
+static void
+put_le(unsigned char *p, uint64_t v, int bytes)
+{
+	int i;
+
+	for(i = 0; i < bytes; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+static uint64_t
+get_le(const unsigned char *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while(bytes--)
+		v = v << 8 | p[bytes];
+	return v;
+}
+
+static void
+put_varint(FILE *f, uint64_t v)
+{
+	while(v >= 0x80) {
+		putc((v & 0x7f) | 0x80, f);
+		v >>= 7;
+	}
+	putc(v, f);
+}
+
+/*
+ * Decode a variable-length integer at *p, not reading past end.
+ * Returns 0 on success, -1 if it is truncated or too long.
+ */
+static int
+get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v)
+{
+	const unsigned char *q = *p;
+	int shift = 0;
+
+	*v = 0;
+	do {
+		if(q == end || shift > 63)
+			return -1;
+		*v |= (uint64_t)(*q & 0x7f) << shift;
+		shift += 7;
+	} while(*q++ & 0x80);
+
+	*p = q;
+	return 0;
+}
+
+static uint64_t
+zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t
+unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static size_t
+common_prefix(const char *a, const char *b)
+{
+	size_t i = 0;
+
+	while(a[i] && a[i] == b[i])
+		++i;
+	return i;
+}
+
+static int
+rec_cmp(const void *a, const void *b)
+{
+	const struct snap_rec *x = *(const struct snap_rec* const*)a;
+	const struct snap_rec *y = *(const struct snap_rec* const*)b;
+
+	return strcmp(x->path, y->path);
+}
+
+/*
+ * Begin taking a snapshot to be written to file. symlinks tells
+ * whether the time stamps are those of symbolic links themselves.
+ * The working directory is recorded as the root of the paths.
+ */
+struct snapshot*
+snapshot_create(const char *file, GENERAL_BOOL symlinks)
+{
+	struct snapshot *s = general_malloc(sizeof *s);
+
+	memset(s, 0, sizeof *s);
+	s->file = cpy_string(file);
+	if(!(s->root = getcwd(NULL, 0)))
+		error_out(ERROR_WARNING_SNAPROOT, errno, FLN, file);
+	s->symlinks = symlinks;
+	pthread_mutex_init(&s->lock, NULL);
+
+	return s;
+}
+
+/*
+ * Record the times array of the file shown as path. Safe to call
+ * from several threads.
+ */
+void
+snapshot_add(struct snapshot *s, const char *path,
+	     const struct timespec *times)
+{
+	struct snap_rec *rec;
+	size_t need, len = strlen(path);
+	int i;
+
+	for(i = 0; i < TIME_TBLS; i++) {
+		if(times[i].tv_sec > SNAP_SEC_MAX || times[i].tv_sec < -SNAP_SEC_MAX) {
+			error_out(ERROR_WARNING_SNAPSKIP, 0, FLN, path,
+				  "time stamp out of range");
+			return;
+		}
+	}
+
+	/* Keep every record aligned for its times */
+	need = (sizeof *rec + len + 1 + 7) & ~(size_t)7;
+
+	pthread_mutex_lock(&s->lock);
+	if(s->len + need > s->size) {
+		while(s->len + need > s->size)
+			s->size = s->size ? s->size << 1 : 1 << 16;
+		s->data = general_realloc(s->data, s->size);
+	}
+	rec = (struct snap_rec*)(s->data + s->len);
+	for(i = 0; i < TIME_TBLS; i++)
+		rec->ns[i] = (int64_t)times[i].tv_sec * 1000000000 + times[i].tv_nsec;
+	memcpy(rec->path, path, len + 1);
+	s->len += need;
+	++s->count;
+	pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * Sort the recorded entries and write them out. The snapshot is
+ * written to a temporary file first and only replaces file once
+ * complete.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+snapshot_write(struct snapshot *s)
+{
+	unsigned char hdr[SNAP_HEADER];
+	struct snap_rec **index;
+	const char *prev = "";
+	uint64_t off[SECTIONS];
+	char *tmp;
+	size_t pos, tmplen;
+	unsigned long i;
+	int64_t last;
+	FILE *f;
+	size_t rootlen = s->root ? strlen(s->root) : 0;
+	int sec, rc;
+
+	index = general_malloc((s->count ? s->count : 1) * sizeof *index);
+	for(i = 0, pos = 0; i < s->count; i++) {
+		index[i] = (struct snap_rec*)(s->data + pos);
+		pos += (sizeof **index + strlen(index[i]->path) + 1 + 7) & ~(size_t)7;
+	}
+	qsort(index, s->count, sizeof *index, &rec_cmp);
+
+	tmplen = strlen(s->file) + 5;
+	tmp = general_malloc(tmplen);
+	snprintf(tmp, tmplen, "%s.tmp", s->file);
+
+	if(!(f = fopen(tmp, "wb"))) {
+		error_out(ERROR_ERROR_SNAPWR, errno, FLN, s->file);
+		free(tmp);
+		free(index);
+		return -1;
+	}
+	setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+	memset(hdr, 0, sizeof hdr);
+	fwrite(hdr, 1, sizeof hdr, f);
+	fwrite(s->root, 1, rootlen, f);
+
+	off[SEC_PATHS] = SNAP_HEADER + rootlen;
+	for(i = 0; i < s->count; i++) {
+		const char *path = index[i]->path;
+		size_t shared = common_prefix(prev, path), rest = strlen(path + shared);
+
+		put_varint(f, shared);
+		put_varint(f, rest);
+		fwrite(path + shared, 1, rest, f);
+		prev = path;
+	}
+
+	for(sec = SEC_MTIME; sec < SECTIONS; sec++) {
+		off[sec] = ftell(f);
+		for(i = 0, last = 0; i < s->count; i++) {
+			int64_t ns = index[i]->ns[sec - SEC_MTIME];
+
+			put_varint(f, zigzag((int64_t)((uint64_t)ns - (uint64_t)last)));
+			last = ns;
+		}
+	}
+
+	memcpy(hdr, SNAP_MAGIC, 8);
+	put_le(hdr + 8, s->symlinks ? SNAP_SYMLINKS : 0, 4);
+	put_le(hdr + 12, rootlen, 4);
+	put_le(hdr + 16, s->count, 8);
+	for(sec = 0; sec < SECTIONS; sec++)
+		put_le(hdr + 24 + 8 * sec, off[sec], 8);
+	put_le(hdr + 56, ftell(f), 8);
+
+	free(index);
+
+	rc = fseek(f, 0, SEEK_SET) < 0 ||
+		fwrite(hdr, 1, sizeof hdr, f) != sizeof hdr || ferror(f);
+	if(fclose(f) || rc || rename(tmp, s->file) < 0) {
+		error_out(ERROR_ERROR_SNAPWR, errno, FLN, s->file);
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+
+	return 0;
+}
+
+/*
+ * Release a snapshot, whether written or not.
+ */
+void
+snapshot_free(struct snapshot *s)
+{
+	if(!s)
+		return;
+	pthread_mutex_destroy(&s->lock);
+	free(s->data);
+	free(s->root);
+	free(s->file);
+	free(s);
+}
+
+/*
+ * Open snapshot file for reading.
+ * Returns NULL on failure.
+ */
+struct snapshot_reader*
+snapshot_open(const char *file)
+{
+	struct snapshot_reader *r;
+	uint64_t off[SECTIONS], size, rootlen = 0;
+	struct stat st;
+	void *map;
+	int fd, sec;
+
+	if((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0) {
+		error_out(ERROR_ERROR_SNAPRD, errno, FLN, file);
+		if(fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	if(st.st_size < SNAP_HEADER) {
+		close(fd);
+		error_out(ERROR_ERROR_SNAPBAD, 0, FLN, file);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		error_out(ERROR_ERROR_SNAPRD, errno, FLN, file);
+		return NULL;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	r = general_malloc(sizeof *r);
+	memset(r, 0, sizeof *r);
+	r->file = file;
+	r->map = map;
+	r->size = st.st_size;
+
+	size = get_le(r->map + 56, 8);
+	for(sec = 0; sec < SECTIONS; sec++)
+		off[sec] = get_le(r->map + 24 + 8 * sec, 8);
+
+	if(!memcmp(r->map, SNAP_MAGIC, 8))
+		rootlen = get_le(r->map + 12, 4);
+	else if(memcmp(r->map, SNAP_MAGIC_V1, 8))
+		size = 0;
+	if(size != r->size || off[SEC_PATHS] != SNAP_HEADER + rootlen) {
+		error_out(ERROR_ERROR_SNAPBAD, 0, FLN, file);
+		snapshot_close(r);
+		return NULL;
+	}
+	for(sec = 0; sec < SECTIONS; sec++) {
+		uint64_t end = sec + 1 < SECTIONS ? off[sec+1] : size;
+
+		if(off[sec] > end || end > size) {
+			error_out(ERROR_ERROR_SNAPBAD, 0, FLN, file);
+			snapshot_close(r);
+			return NULL;
+		}
+		r->cur[sec] = r->map + off[sec];
+		r->end[sec] = r->map + end;
+	}
+
+	if(rootlen) {
+		r->root = general_malloc(rootlen + 1);
+		memcpy(r->root, r->map + SNAP_HEADER, rootlen);
+		r->root[rootlen] = 0;
+	}
+	r->symlinks = (get_le(r->map + 8, 4) & SNAP_SYMLINKS) ? TRUE : FALSE;
+	r->count = r->left = get_le(r->map + 16, 8);
+
+	return r;
+}
+
+/*
+ * Tell whether the snapshot holds the times of symbolic links
+ * themselves.
+ */
+GENERAL_BOOL
+snapshot_symlinks(struct snapshot_reader *r)
+{
+	return r->symlinks;
+}
+
+/*
+ * Tell the directory the paths of the snapshot are relative to, or
+ * NULL if it is not known; the working directory is taken then.
+ */
+const char*
+snapshot_root(struct snapshot_reader *r)
+{
+	return r->root;
+}
+
+/*
+ * Tell how many entries the snapshot holds.
+ */
+unsigned long
+snapshot_count(struct snapshot_reader *r)
+{
+	return r->count;
+}
+
+/*
+ * Fetch the next entry, in path order. path remains valid until
+ * the next call.
+ * Returns 1 if an entry was read, 0 at the end, -1 on failure.
+ */
+int
+snapshot_next(struct snapshot_reader *r, const char **path,
+	      struct timespec *times)
+{
+	uint64_t shared, rest, v;
+	int64_t ns;
+	int i;
+
+	if(!r->left)
+		return 0;
+
+	if(get_varint(&r->cur[SEC_PATHS], r->end[SEC_PATHS], &shared) < 0 ||
+	   get_varint(&r->cur[SEC_PATHS], r->end[SEC_PATHS], &rest) < 0 ||
+	   shared > r->pathlen ||
+	   rest > (uint64_t)(r->end[SEC_PATHS] - r->cur[SEC_PATHS]))
+		goto corrupt;
+
+	if(shared + rest + 1 > r->pathsz) {
+		while(shared + rest + 1 > r->pathsz)
+			r->pathsz = r->pathsz ? r->pathsz << 1 : 256;
+		r->path = general_realloc(r->path, r->pathsz);
+	}
+	memcpy(r->path + shared, r->cur[SEC_PATHS], rest);
+	r->cur[SEC_PATHS] += rest;
+	r->pathlen = shared + rest;
+	r->path[r->pathlen] = 0;
+
+	for(i = 0; i < TIME_TBLS; i++) {
+		if(get_varint(&r->cur[SEC_MTIME + i], r->end[SEC_MTIME + i], &v) < 0)
+			goto corrupt;
+		ns = (int64_t)((uint64_t)r->prev[i] + (uint64_t)unzigzag(v));
+		r->prev[i] = ns;
+		times[i].tv_sec = ns / 1000000000;
+		times[i].tv_nsec = ns % 1000000000;
+		if(times[i].tv_nsec < 0) {
+			times[i].tv_nsec += 1000000000;
+			--times[i].tv_sec;
+		}
+	}
+
+	if(!r->pathlen)
+		goto corrupt;
+
+	--r->left;
+	*path = r->path;
+	return 1;
+
+ corrupt:
+	error_out(ERROR_ERROR_SNAPBAD, 0, FLN, r->file);
+	return -1;
+}
+
+/*
+ * Unmap and release the snapshot.
+ */
+void
+snapshot_close(struct snapshot_reader *r)
+{
+	if(!r)
+		return;
+	munmap(r->map, r->size);
+	free(r->root);
+	free(r->path);
+	free(r);
+}
@@ -0,0 +1,51 @@
+/*
+ *      snapshot.h - Time stamp snapshots of whole trees
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#ifndef STROKE_SNAPSHOT_H
+#define STROKE_SNAPSHOT_H 1
+
+#include <libgeneral/general.h>
+#include <time.h>
+
+/* Opaque state of a snapshot being taken, and of one being read */
+struct snapshot;
+struct snapshot_reader;
+
+/*
+ * Function declarations
+ */
+extern struct snapshot* snapshot_create(const char *file, GENERAL_BOOL symlinks);
+extern void snapshot_add(struct snapshot *s, const char *path,
+			 const struct timespec *times);
+extern int snapshot_write(struct snapshot *s);
+extern void snapshot_free(struct snapshot *s);
+
+extern struct snapshot_reader* snapshot_open(const char *file);
+extern const char* snapshot_root(struct snapshot_reader *r);
+extern GENERAL_BOOL snapshot_symlinks(struct snapshot_reader *r);
+extern unsigned long snapshot_count(struct snapshot_reader *r);
+extern int snapshot_next(struct snapshot_reader *r, const char **path,
+			 struct timespec *times);
+extern void snapshot_close(struct snapshot_reader *r);
+
+#endif /* STROKE_SNAPSHOT_H */
@@ -0,0 +1,217 @@
+/*
+ *      spec.c - Evaluation of time stamp specifications
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "stroke.h"
+#include "spec.h"
+#include "literal.h"
+#include "gnulib/parse-datetime.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every specification of one invocation is evaluated against the
+ * same current time, taken when the cache is created, so that a
+ * relative SPEC like `now -2 hours' means the same instant for the
+ * first and the last file of a large batch. The time zone objects
+ * are set up once as well; parse_datetime() would otherwise build
+ * one from TZ on every call.
+ *
+ * Literal time stamps are converted by literal_parse() and never
+ * enter the cache, which would only grow with every distinct time
+ * of a manifest. Anything else goes through the grammar once and
+ * is then answered by a single hash lookup. The cache is not
+ * thread-safe; specifications are only evaluated while reading
+ * the command line and input lists.
+ */
+
+/* The time zones a SPEC can be evaluated in */
+enum spec_zone {
+	ZONE_LOCAL,
+	ZONE_UTC,
+	ZONES
+};
+
+/* One evaluated specification */
+struct spec_entry {
+	char *spec;
+	size_t len;
+	unsigned hash;
+	enum spec_zone zone;
+	GENERAL_BOOL valid;
+	struct timespec ts;
+};
+
+struct spec_cache {
+	struct timespec now;
+
+	/* Zone objects and the TZ strings they were made from */
+	timezone_t tz[ZONES];
+	const char *tzstring[ZONES];
+
+	/* Open addressing table, size a power of two */
+	struct spec_entry *slots;
+	size_t size;
+	size_t used;
+};
+
+/*
+ * FNV-1a over the specification and its zone.
+ */
+static unsigned
+spec_hash(const char *spec, size_t len, enum spec_zone zone)
+{
+	unsigned h = 2166136261u ^ zone;
+
+	while(len--) {
+		h ^= (unsigned char)*spec++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * Double the size of the table.
+ */
+static void
+spec_grow(struct spec_cache *c)
+{
+	struct spec_entry *old = c->slots;
+	size_t oldsize = c->size, i, j;
+
+	c->size = c->size ? c->size << 1 : 64;
+	c->slots = general_malloc(c->size * sizeof *c->slots);
+	memset(c->slots, 0, c->size * sizeof *c->slots);
+
+	for(i = 0; i < oldsize; i++) {
+		if(!old[i].spec)
+			continue;
+		for(j = old[i].hash & (c->size - 1); c->slots[j].spec;
+		    j = (j + 1) & (c->size - 1))
+			;
+		c->slots[j] = old[i];
+	}
+	free(old);
+}
+
+/*
+ * Set up an empty cache, taking the current time that every
+ * relative specification will be based on.
+ * Returns NULL if a time zone cannot be set up.
+ */
+struct spec_cache*
+spec_cache_create(void)
+{
+	struct spec_cache *c = general_malloc(sizeof *c);
+
+	memset(c, 0, sizeof *c);
+
+#ifdef CLOCK_REALTIME
+	if(clock_gettime(CLOCK_REALTIME, &c->now) != 0)
+#endif
+	{
+		c->now.tv_sec = time(NULL);
+		c->now.tv_nsec = 0;
+	}
+
+	c->tzstring[ZONE_LOCAL] = getenv("TZ");
+	c->tzstring[ZONE_UTC] = "UTC0";
+	if(!(c->tz[ZONE_LOCAL] = tzalloc(c->tzstring[ZONE_LOCAL])) ||
+	   !(c->tz[ZONE_UTC] = tzalloc(c->tzstring[ZONE_UTC]))) {
+		spec_cache_destroy(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+/*
+ * Evaluate specification spec of length len into out, in UTC if
+ * parse_as_utc is TRUE and in local time otherwise.
+ * Returns 0 on success, -1 if spec is invalid.
+ */
+int
+spec_eval(struct spec_cache *c, const char *spec, size_t len,
+	  GENERAL_BOOL parse_as_utc, struct timespec *out)
+{
+	enum spec_zone zone = parse_as_utc ? ZONE_UTC : ZONE_LOCAL;
+	struct spec_entry *e;
+	unsigned hash;
+	size_t i;
+
+	if(literal_parse(spec, len, out, parse_as_utc))
+		return 0;
+
+	hash = spec_hash(spec, len, zone);
+	for(i = c->size ? hash & (c->size - 1) : 0; c->size && c->slots[i].spec;
+	    i = (i + 1) & (c->size - 1)) {
+		e = &c->slots[i];
+		if(e->hash == hash && e->zone == zone && e->len == len &&
+		   !memcmp(e->spec, spec, len))
+			goto found;
+	}
+
+	if((c->used + 1) * 4 > c->size * 3) {
+		spec_grow(c);
+		for(i = hash & (c->size - 1); c->slots[i].spec;
+		    i = (i + 1) & (c->size - 1))
+			;
+	}
+
+	e = &c->slots[i];
+	e->spec = general_malloc(len + 1);
+	memcpy(e->spec, spec, len);
+	e->spec[len] = 0;
+	e->len = len;
+	e->hash = hash;
+	e->zone = zone;
+	e->valid = parse_datetime2(&e->ts, e->spec, &c->now, 0, c->tz[zone],
+				   c->tzstring[zone]) ? TRUE : FALSE;
+	++c->used;
+
+ found:
+	if(!e->valid)
+		return -1;
+	*out = e->ts;
+	return 0;
+}
+
+/*
+ * Release the cache and everything in it.
+ */
+void
+spec_cache_destroy(struct spec_cache *c)
+{
+	size_t i;
+	int z;
+
+	if(!c)
+		return;
+	for(i = 0; i < c->size; i++)
+		free(c->slots[i].spec);
+	free(c->slots);
+	for(z = 0; z < ZONES; z++)
+		if(c->tz[z])
+			tzfree(c->tz[z]);
+	free(c);
+}
@@ -0,0 +1,41 @@
+/*
+ *      spec.h - Evaluation of time stamp specifications
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_SPEC_H
+#define STROKE_SPEC_H 1
+
+#include <libgeneral/general.h>
+#include <stddef.h>
+#include <time.h>
+
+/* Opaque cache of evaluated time stamp specifications */
+struct spec_cache;
+
+/*
+ * Function declarations
+ */
+extern struct spec_cache* spec_cache_create(void);
+extern int spec_eval(struct spec_cache *c, const char *spec, size_t len,
+		     GENERAL_BOOL parse_as_utc, struct timespec *out);
+extern void spec_cache_destroy(struct spec_cache *c);
+
+#endif /* STROKE_SPEC_H */
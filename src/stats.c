@@ -0,0 +1,235 @@
+/*
+ *      stats.c - Per-phase counters and latency histograms for --stats
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "stats.h"
+
+#include "stroke.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every phase keeps a count, the total time and a histogram of how
+ * long it took, with buckets of doubling width: bucket i holds the
+ * samples from 2^i up to 2^(i+1) nanoseconds, the last one all
+ * longer ones. Samples are added with relaxed atomics from any
+ * thread, and the clock is only read while statistics are on.
+ */
+#define STATS_BUCKETS 40
+
+struct stats_phase {
+	unsigned long count;
+	unsigned long long total;
+	unsigned long buckets[STATS_BUCKETS];
+};
+
+static const char *phase_names[PHASES] = {
+	"probe", "parse", "validate", "utime", "ctime", "output"
+};
+
+GENERAL_BOOL stats_on;
+
+static struct stats_phase phases[PHASES];
+
+/*
+ * Map name, as given to `--stats=', to one of STATS_*; no name means
+ * text.
+ * Returns -1 if it is unknown.
+ */
+int
+stats_kind(const char *name)
+{
+	if(!name || !strcmp(name, "text"))
+		return STATS_TEXT;
+	if(!strcmp(name, "json"))
+		return STATS_JSON;
+	return -1;
+}
+
+/*
+ * Monotonic time in nanoseconds.
+ */
+long long
+stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Add ns nanoseconds spent in phase on n files.
+ */
+void
+stats_add(int phase, long long ns, unsigned long n)
+{
+	struct stats_phase *p = &phases[phase];
+	unsigned long long each;
+	int b;
+
+	if(ns < 0)
+		ns = 0;
+	each = n ? (unsigned long long)ns / n : 0;
+	b = each ? 63 - __builtin_clzll(each) : 0;
+	if(b >= STATS_BUCKETS)
+		b = STATS_BUCKETS - 1;
+
+	__atomic_add_fetch(&p->count, n, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&p->total, (unsigned long long)ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&p->buckets[b], n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Account phase, from t0 to t1, to n files as far as statistics
+ * and tracing are on.
+ */
+void
+stats_phase(int phase, long long t0, long long t1, unsigned long n)
+{
+	if(stats_on)
+		stats_add(phase, t1 - t0, n);
+	if(trace_on)
+		trace_span(phase_names[phase], t0, t1, NULL);
+}
+
+/*
+ * Format ns nanoseconds with a fitting unit.
+ */
+static const char*
+fmt_ns(char *buf, size_t len, double ns)
+{
+	if(ns < 1e3)
+		snprintf(buf, len, "%.0fns", ns);
+	else if(ns < 1e6)
+		snprintf(buf, len, "%.1fus", ns / 1e3);
+	else if(ns < 1e9)
+		snprintf(buf, len, "%.1fms", ns / 1e6);
+	else
+		snprintf(buf, len, "%.2fs", ns / 1e9);
+	return buf;
+}
+
+/*
+ * Upper bound of the bucket the q-quantile of p falls into.
+ */
+static double
+quantile(const struct stats_phase *p, double q)
+{
+	unsigned long want = (unsigned long)(q * p->count), seen = 0;
+	int b;
+
+	for(b = 0; b < STATS_BUCKETS - 1; b++) {
+		seen += p->buckets[b];
+		if(seen > want)
+			break;
+	}
+	return (double)(1ULL << (b + 1));
+}
+
+static void
+print_text(FILE *f, const struct stats_totals *t)
+{
+	double secs = t->elapsed / 1e9;
+	char a[16], b[16], c[16], d[16];
+	struct stats_phase *p;
+	int i, k;
+
+	fprintf(f, "%s: files: %lu, system calls: %lu (%.2f per file)\n",
+		PROGRAM, t->files, t->syscalls,
+		(double)t->syscalls / (t->files ? t->files : 1));
+	fprintf(f, "%s: elapsed: %.3f s, %.0f files/s\n", PROGRAM, secs,
+		secs > 0 ? t->files / secs : 0.0);
+	if(t->steps)
+		fprintf(f, "%s: clock steps: %lu, clock away: %ld.%06ld s\n",
+			PROGRAM, t->steps, (long)t->away.tv_sec,
+			t->away.tv_nsec / 1000);
+
+	for(i = 0; i < PHASES; i++) {
+		p = &phases[i];
+		if(!p->count)
+			continue;
+		fprintf(f, "%s: %-8s %lu x, total %s, mean %s, p50 < %s, "
+			"p99 < %s\n", PROGRAM, phase_names[i], p->count,
+			fmt_ns(a, sizeof a, p->total),
+			fmt_ns(b, sizeof b, (double)p->total / p->count),
+			fmt_ns(c, sizeof c, quantile(p, 0.5)),
+			fmt_ns(d, sizeof d, quantile(p, 0.99)));
+		fprintf(f, "%s:  ", PROGRAM);
+		for(k = 0; k < STATS_BUCKETS; k++)
+			if(p->buckets[k])
+				fprintf(f, " %s:%lu",
+					fmt_ns(a, sizeof a, k ? (double)(1ULL << k) : 0),
+					p->buckets[k]);
+		putc('\n', f);
+	}
+}
+
+static void
+print_json(FILE *f, const struct stats_totals *t)
+{
+	double secs = t->elapsed / 1e9;
+	struct stats_phase *p;
+	int i, k, first;
+
+	fprintf(f, "{\"files\":%lu,\"syscalls\":%lu,\"syscalls_per_file\":%.2f,"
+		"\"elapsed_s\":%.6f,\"files_per_s\":%.1f,\"clock_steps\":%lu,"
+		"\"clock_away_s\":%ld.%06ld,\"phases\":{",
+		t->files, t->syscalls,
+		(double)t->syscalls / (t->files ? t->files : 1), secs,
+		secs > 0 ? t->files / secs : 0.0, t->steps,
+		(long)t->away.tv_sec, t->away.tv_nsec / 1000);
+
+	for(i = 0; i < PHASES; i++) {
+		p = &phases[i];
+		fprintf(f, "%s\"%s\":{\"count\":%lu,\"total_ns\":%llu,"
+			"\"mean_ns\":%.0f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,"
+			"\"buckets\":[", i ? "," : "", phase_names[i],
+			p->count, p->total,
+			p->count ? (double)p->total / p->count : 0.0,
+			p->count ? quantile(p, 0.5) : 0.0,
+			p->count ? quantile(p, 0.99) : 0.0);
+		for(k = 0, first = 1; k < STATS_BUCKETS; k++) {
+			if(!p->buckets[k])
+				continue;
+			fprintf(f, "%s[%llu,%lu]", first ? "" : ",",
+				k ? 1ULL << k : 0ULL, p->buckets[k]);
+			first = 0;
+		}
+		fputs("]}", f);
+	}
+	fputs("}}\n", f);
+}
+
+/*
+ * Print the figures of the run t and of every phase to f, as text
+ * or as one JSON object; histogram buckets are named by the least
+ * number of nanoseconds they hold, percentiles by the bound of the
+ * bucket they fall below.
+ */
+void
+stats_print(int kind, FILE *f, const struct stats_totals *t)
+{
+	if(kind == STATS_JSON)
+		print_json(f, t);
+	else
+		print_text(f, t);
+}
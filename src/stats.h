@@ -0,0 +1,82 @@
+/*
+ *      stats.h - Per-phase counters and latency histograms for --stats
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef STROKE_STATS_H
+#define STROKE_STATS_H 1
+
+#include <libgeneral/general.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* Phases of the work on a file that are timed */
+enum {
+	PHASE_PROBE,		/* looking the file up */
+	PHASE_PARSE,		/* turning SPECs, expressions, fields into times */
+	PHASE_VALIDATE,		/* checking the times wanted */
+	PHASE_UTIME,		/* setting mtime and atime */
+	PHASE_CTIME,		/* one excursion of the system clock */
+	PHASE_OUTPUT,		/* the report, format line or record */
+	PHASES
+};
+
+/* Ways of printing the statistics */
+enum {
+	STATS_TEXT = 1,
+	STATS_JSON
+};
+
+/* Figures of the whole run, next to the phases */
+struct stats_totals {
+	unsigned long files;
+	unsigned long syscalls;
+	long long elapsed;		/* nanoseconds */
+	unsigned long steps;
+	struct timespec away;
+};
+
+/* Set while phases are timed */
+extern GENERAL_BOOL stats_on;
+
+/*
+ * Time phases of the work on a file. PHASE_START() is 0 while
+ * neither statistics nor tracing are on, and PHASE_END() then does
+ * nothing; otherwise the time in between is added to PHASE and
+ * traced. PHASE_END_N() accounts it to N files at once, each with
+ * its share.
+ */
+#define PHASE_START() (stats_on || trace_on ? stats_clock() : 0)
+#define PHASE_END_N(PHASE, T0, N) \
+	do { if(T0) stats_phase((PHASE), (T0), stats_clock(), (N)); } while(0)
+#define PHASE_END(PHASE, T0) PHASE_END_N(PHASE, T0, 1)
+
+/*
+ * Function declarations
+ */
+extern int stats_kind(const char *name);
+extern long long stats_clock(void);
+extern void stats_add(int phase, long long ns, unsigned long n);
+extern void stats_phase(int phase, long long t0, long long t1,
+			unsigned long n);
+extern void stats_print(int kind, FILE *f, const struct stats_totals *t);
+
+#endif /* STROKE_STATS_H */
@@ -20,6 +20,8 @@
  *      MA 02110-1301, USA.
  */
 
+#include "stroke.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -30,6 +32,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -37,9 +40,27 @@
 #include <libgeneral/general.h>
 #include <libgeneral/error.h>
 #include <libgeneral/signals.h>
+#include <libgeneral/arena.h>
 
-#include "stroke.h"
 #include "errors.h"
+#include "walk.h"
+#include "input.h"
+#include "pool.h"
+#include "uring.h"
+#include "clockstep.h"
+#include "snapshot.h"
+#include "manifest.h"
+#include "literal.h"
+#include "spec.h"
+#include "expr.h"
+#include "zone.h"
+#include "writer.h"
+#include "format.h"
+#include "output.h"
+#include "failures.h"
+#include "journal.h"
+#include "stats.h"
+#include "trace.h"
 #include "gnulib/parse-datetime.h"
 
 
@@ -48,7 +69,8 @@
  ***************/
 
 const char *usg =
-	"Usage: "PROGRAM" [OPTIONS] FILE...\n\n"
+	"Usage: "PROGRAM" [OPTIONS] FILE...\n"
+	"  or:  "PROGRAM" [OPTIONS] --files-from=LIST [FILE...]\n\n"
 	"Without any setters stroke prints every timestamp for each FILE. Provide\n"
 	"one or more setters to modify them:\n\n"
 	"  -m, --mtime=SPEC      set modification time to SPEC\n"
@@ -60,13 +82,38 @@ const char *usg =
 "  -n, --dry-run         validate changes without applying them\n"
 "  -Z, --utc             interpret SPEC in Coordinated Universal Time\n"
 "  -p, --preserve-ctime  preserve change time even when mutating other clocks\n"
+"  -R, --recursive       process directories and their contents recursively\n"
+"      --files-from=LIST read further FILEs from LIST, one per line; - is stdin\n"
+"  -0, --null            FILEs in LIST, and lines printed by --format, are\n"
+"                        terminated by NUL, not newline\n"
+"  -j, --jobs=N          process up to N files at the same time\n"
+"      --keep-going      go on with the other files when one fails and sum up\n"
+"                        the failures at the end\n"
+"      --retry-list=FILE with --keep-going, write the failed FILEs to FILE,\n"
+"                        NUL-terminated, for --files-from=FILE -0\n"
+"      --journal=FILE    record completed files in FILE; a rerun with the\n"
+"                        same FILE skips them\n"
+"      --stats[=KIND]    report system calls, files per second and the time\n"
+"                        spent per phase when done, as text or json\n"
+"      --trace=FILE      write a span for every file and phase to FILE, for\n"
+"                        Perfetto or chrome://tracing\n"
+"      --save=SNAP       record the timestamps of every FILE in SNAP\n"
+"      --restore=SNAP    put back the timestamps recorded in SNAP\n"
+"      --manifest=FILE   set the times listed in FILE as PATH<TAB>MTIME<TAB>ATIME\n"
+"      --format=FMT      print one line per file as given by FMT, e.g.\n"
+"                        '%n\\t%y{%s.%N}\\t%x{%F %T}'\n"
+"      --output=KIND     print one record per file as jsonl, csv or bin\n"
+"      --diff A B        list files added, removed or with other\n"
+"                        timestamps in tree B compared to tree A\n"
 	"  -f, --force           skip sanity checks (dangerous)\n"
 	"  -q, --quiet           suppress per-file output\n"
 	"  -v, --verbose         emit additional diagnostics\n"
 	"      --help            show this help text\n"
 	"      --version         print program information\n\n"
 	"Timestamp SPEC accepts common ISO-8601 forms (e.g. 2024-02-01T13:37) or\n"
-	"relative expressions such as \"now -2 hours\" and \"+3days\".\n"
+	"relative expressions such as \"now -2 hours\" and \"+3days\". A SPEC of\n"
+	"the form \"self +2h\", \"atime\" or \"max(mtime, ref:mtime) -1d\" is\n"
+	"computed for each file from its own timestamps.\n"
 	"\nPlease help by reporting bugs to <"PACKAGE_BUGREPORT">.\n\n";
 
 const char *pinf[] =
@@ -88,16 +135,6 @@ const char *bugs =
  *   Globals   *
  ***************/
 
-FILE_TIME time_vals[][TIME_VALS] =
-{	
-	/* mtime: year, month, day, hour, minute, second, daylight saving time, weekday */
-	{ T("mY"), T("mM"), T("mD"), T("mh"), T("mm"), T("ms"), T("ml"), WD },
-	/* atime */
-	{ T("aY"), T("aM"), T("aD"), T("ah"), T("am"), T("as"), T("al"), WD },
-	/* ctime */
-	{ T("cY"), T("cM"), T("cD"), T("ch"), T("cm"), T("cs"), T("cl"), WD }
-};
-
 const char *names[] = {"mtime", "atime", "ctime"};
 
 /* Flags set through cmd line args */
@@ -109,59 +146,111 @@ _FLAG_TYPE flags;
  ***************/	
 
 /*
- * Reads time information for file and write them to global
- * time_vals array. If file is NULL the current time is taken instead.
+ * Tell from the probe of ctx whether the file is a symbolic link.
+ * Returns 0 if it is, LDANGLING if what it points to does not exist,
+ * -1 if it is no link.
+ */
+static int
+ctx_laccess(struct file_ctx *ctx)
+{
+	const struct file_probe *p = ctx->probe;
+
+	if(!p || p->lerr || !S_ISLNK(p->lst.st_mode))
+		return -1;
+	return p->err ? LDANGLING : 0;
+}
+
+/*
+ * Take time stamps, device and mode of ctx from st.
+ */
+static void
+stat_to_ctx(struct file_ctx *ctx, const struct stat *st)
+{
+	ctx->times[MTIME] = st->st_mtim;
+	ctx->times[ATIME] = st->st_atim;
+	ctx->times[CTIME] = st->st_ctim;
+	ctx->dev = st->st_dev;
+	ctx->mode = st->st_mode;
+}
+
+/*
+ * Reads time information for file name and write them to the times
+ * array of ctx, as found by the probe of ctx. If name is NULL the
+ * current time is taken instead. path is the name of the file as
+ * shown to the user.
  * Returns 0 on success, -1 on failure.
  */
 static int
-scan(const char *file)
+scan(struct file_ctx *ctx, const char *name, const char *path)
 {
-	int (*statf)(const char*, struct stat*);
-	struct timeval tv;
-	struct stat st;
-	struct tm *ts;
+	const struct file_probe *p = ctx->probe;
+	const struct stat *st;
+	int err;
 
-	if(!file) {
-		if(gettimeofday(&tv, NULL) < 0) {
+	if(!name) {
+		if(clock_gettime(CLOCK_REALTIME, &ctx->times[MTIME]) < 0) {
 			error_out(ERROR_ERROR_GETTD, errno, FLN);
 			return -1;
 		}
-		st.st_mtime = st.st_atime = st.st_ctime = tv.tv_sec;
-	} else {
-		statf = CHKF(SYMLINKS) ? &lstat : &stat;
-		if((*statf)(file, &st) < 0) {
-			const char *hint = IFSTR(!laccess(file, F_OK),
-						 "Dangling symbolic link? Try `-l'.");
-			if(!*hint)
-				hint = strerror(errno);
-			error_out(ERROR_ERROR_STAT, 0, FLN, file, hint);
-			return -1;
-		}
+		ctx->times[ATIME] = ctx->times[CTIME] = ctx->times[MTIME];
+		return 0;
 	}
 
-	/* mtime */
-	if(!(ts = localtime(&st.st_mtime))) goto gmfail;
-	translate(ts, time_vals, MTIME, TO_FT);
+	err = CHKF(SYMLINKS) ? p->lerr : p->err;
+	st = CHKF(SYMLINKS) ? &p->lst : &p->st;
+	if(err) {
+		const char *hint = IFSTR(!ctx_laccess(ctx),
+					 "Dangling symbolic link? Try `-l'.");
+		if(!*hint)
+			hint = strerror(err);
+		errno = err;
+		error_out(ERROR_ERROR_STAT, 0, FLN, path, hint);
+		return -1;
+	}
+
+	stat_to_ctx(ctx, st);
+	return 0;
+}
 
-	/* atime */
-	if(!(ts = localtime(&st.st_atime))) goto gmfail;
-	translate(ts, time_vals, ATIME, TO_FT);
+/*
+ * Read back the time stamps of the file of ctx after changing them;
+ * through its descriptor if it has one.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+rescan(struct file_ctx *ctx, int dirfd, const char *name, const char *path)
+{
+	struct stat st;
 
-	/* ctime */
-	if(!(ts = localtime(&st.st_ctime))) goto gmfail;
-	translate(ts, time_vals, CTIME, TO_FT);
+	if((ctx->fd >= 0 ? SC(fstat(ctx->fd, &st)) :
+	    SC(fstatat(dirfd, name, &st,
+		       CHKF(SYMLINKS) ? AT_SYMLINK_NOFOLLOW : 0))) < 0) {
+		error_out(ERROR_ERROR_STAT, 0, FLN, path, strerror(errno));
+		return -1;
+	}
 
+	stat_to_ctx(ctx, &st);
 	return 0;
-
- gmfail:
-	error_out(ERROR_ERROR_GMTIM, errno, FLN, file);
-	return -1;
 }
 
+/*
+ * Descriptors opened with O_PATH can have their time stamps set
+ * through utimensat(AT_EMPTY_PATH) without any read or write access.
+ */
+#if defined(HAVE_UTIMENSAT) && defined(O_PATH) && defined(AT_EMPTY_PATH)
+# define HAVE_FD_UTIMENS 1
+#endif
+
 
+/*
+ * Value of a setter: either the time stamp ts, or expr evaluated
+ * for each file anew.
+ */
 struct timestamp_param {
 	GENERAL_BOOL set;
 	struct timespec ts;
+	struct expr *expr;
+	const char *src;
 };
 
 struct stroke_cli {
@@ -171,61 +260,159 @@ struct stroke_cli {
 	const char *copy_from;
 	GENERAL_BOOL dry_run;
 	GENERAL_BOOL parse_utc;
+	GENERAL_BOOL preserve_ctime;
+	GENERAL_BOOL recursive;
+	const char *files_from;
+	char list_delim;
+	int jobs;
+	int stats;
+	const char *save;
+	const char *restore;
+	GENERAL_BOOL diff;
+	const char *manifest;
+	const char *format;
+	const char *output;
+	GENERAL_BOOL keep_going;
+	const char *retry_list;
+	const char *journal;
+	const char *trace;
 };
 
-static int parse_timestamp_spec(const char *spec, struct timespec *out,
-				GENERAL_BOOL parse_as_utc);
-static int assign_timespec(FILE_TIMES ft, int slot, const struct timespec *ts);
-static int check_dry_run_permissions(const char *file, GENERAL_BOOL exists,
-				     GENERAL_BOOL will_touch_ctime,
-				     GENERAL_BOOL create_file);
-static GENERAL_BOOL have_ctime_privileges(void);
+/* Number of file systems whose time stamp granularity is kept */
+#define GRAN_DEVS 16
 
-static void
-current_timespec(struct timespec *ts)
-{
-#ifdef CLOCK_REALTIME
-	if(clock_gettime(CLOCK_REALTIME, ts) == 0)
-		return;
-#endif
-	ts->tv_sec = time(NULL);
-	ts->tv_nsec = 0;
-}
+/*
+ * Time stamp granularity of one file system in nanoseconds, for
+ * mtime and atime, as learned from what it actually stored.
+ */
+struct fs_gran {
+	dev_t dev;
+	long long ns[2];
+};
 
-static int
-parse_timestamp_spec(const char *spec, struct timespec *out,
-		     GENERAL_BOOL parse_as_utc)
-{
-	struct timespec base;
-	current_timespec(&base);
+/*
+ * State shared by all files of one invocation. Once processing
+ * has started only ctime_warning_emitted, the granularities
+ * (under gran_lock) and the counters are written to.
+ */
+struct stroke_run {
+	struct stroke_cli cli;
+	GENERAL_BOOL have_setters;
+	GENERAL_BOOL have_copy_template;
+	GENERAL_BOOL have_ctime_priv;
+	GENERAL_BOOL warn_ctime_pending;
+	int ctime_warning_emitted;
+	struct timespec copy_template[TIME_TBLS];
+	struct pool *pool;
+	struct probe_batch *batch;
+	struct clockstep *steps;
+	struct snapshot *snapshot;
+	struct spec_cache *specs;
+	struct format *format;
+	int output;
+	struct writer *out;
+	struct failure_log *failed;  /* Only with `--keep-going' */
+	struct journal *journal;
+
+	/* Input position of the file handed out last, from 1 */
+	unsigned long long position;
+
+	pthread_mutex_t gran_lock;
+	struct fs_gran grans[GRAN_DEVS];
+	int ngrans;
+
+	/* Files whose time stamps were changed or already as wanted */
+	unsigned long written;
+	unsigned long unchanged;
+
+	/* Files looked at, for `--stats' */
+	unsigned long files;
+
+	/* Files skipped as completed by an earlier run */
+	unsigned long resumed;
+};
 
-	if(!parse_as_utc) {
-		if(!parse_datetime(out, spec, &base))
-			return -1;
-		return 0;
-	}
+/*
+ * An open directory shared by the tasks for the files in it;
+ * closed once the last of them has completed.
+ */
+struct dir_ref {
+	int fd;
+	int refs;
+};
 
-	timezone_t utc = tzalloc("UTC0");
-	if(!utc)
-		return -1;
+/*
+ * Time stamps given for one particular file, by a snapshot or a
+ * manifest; set has TIME_BIT() of every clock given.
+ */
+struct file_times {
+	struct timespec times[TIME_TBLS];
+	unsigned set;
+};
 
-	int rc = parse_datetime2(out, spec, &base, 0, utc, "UTC0") ? 0 : -1;
-	tzfree(utc);
-	return rc;
-}
+/* One file queued for the worker threads */
+struct file_task {
+	struct dir_ref *dir;
+	const char *name;
+	GENERAL_BOOL has_given;
+	struct file_times given;
+	unsigned long long pos;
+	char path[];
+};
 
-static int
-assign_timespec(FILE_TIMES ft, int slot, const struct timespec *ts)
-{
-	time_t sec = ts->tv_sec;
-	struct tm tm;
+/*
+ * A file whose change time is queued with the clock steps; see
+ * ctime_queue(). What its report needs of the probe is kept, the
+ * target of a symbolic link after the path.
+ */
+struct held_file {
+	struct file_ctx ctx;
+	int action;
+	int err, lerr;
+	mode_t lmode;
+	const char *link;
+	char path[];
+};
 
-	if(!localtime_r(&sec, &tm))
-		return -1;
+/* Number of files looked up through io_uring at once */
+#define PROBE_BATCH 256
+
+/* One file waiting for its lookup */
+struct probe_entry {
+	struct dir_ref *dir;
+	const char *name;
+	const char *path;
+	unsigned long long pos;
+	struct file_probe probe;
+	struct file_ctx ctx;
+};
 
-	translate(&tm, ft, slot, TO_FT);
-	return 0;
-}
+/*
+ * Files to be inspected, collected so that their lookups can be
+ * handed to the kernel together and answered concurrently. Their
+ * time stamps are then converted for the report together as well.
+ */
+struct probe_batch {
+	struct uring *ring;
+	size_t count;
+	struct probe_entry entries[PROBE_BATCH];
+	struct zone_batch stamps;
+	ARENA *paths;        /* Paths of the entries; reset on flush */
+};
+
+/* Arena chunk size for the paths of a probe batch */
+#define PROBE_PATHS_CHUNK (PROBE_BATCH * 128)
+
+#if PROBE_BATCH * TIME_TBLS > ZONE_BATCH
+# error "A probe batch does not fit into a zone batch"
+#endif
+
+static int check_dry_run_permissions(struct file_ctx *ctx, int dirfd,
+				     const char *name, const char *path,
+				     GENERAL_BOOL exists,
+				     GENERAL_BOOL will_touch_ctime,
+				     GENERAL_BOOL create_file);
+static GENERAL_BOOL have_ctime_privileges(void);
 
 static char *
 parent_dir(const char *path, char *buf, size_t len)
@@ -266,25 +453,26 @@ ensure_parent_writable(const char *file)
 }
 
 static int
-check_dry_run_permissions(const char *file, GENERAL_BOOL exists,
-			  GENERAL_BOOL will_touch_ctime,
+check_dry_run_permissions(struct file_ctx *ctx, int dirfd, const char *name,
+			  const char *path, GENERAL_BOOL exists, GENERAL_BOOL will_touch_ctime,
 			  GENERAL_BOOL create_file)
 {
 	if(will_touch_ctime && geteuid() != 0) {
-		error_out(ERROR_ERROR_CHCTIME, EPERM, FLN, file,
+		error_out(ERROR_ERROR_CHCTIME, EPERM, FLN, path,
 			  "change time modifications require root privileges");
 		return -1;
 	}
 
-	int rc;
 	if(exists) {
-		rc = CHKF(SYMLINKS) ? laccess(file, W_OK) : access(file, W_OK);
-		if(rc < 0) {
-			error_out(ERROR_ERROR_SETTIM, errno, FLN, file);
+		/* The times of a link itself only need its ownership */
+		if(CHKF(SYMLINKS) && ctx_laccess(ctx) >= 0)
+			return 0;
+		if(SC(faccessat(dirfd, name, W_OK, 0)) < 0) {
+			error_out(ERROR_ERROR_SETTIM, errno, FLN, path);
 			return -1;
 		}
 	} else if(create_file) {
-		if(ensure_parent_writable(file) < 0)
+		if(ensure_parent_writable(path) < 0)
 			return -1;
 	}
 
@@ -297,186 +485,1785 @@ have_ctime_privileges(void)
 	return geteuid() == 0;
 }
 
+/* Granularities a file system may store time stamps at, finest first */
+static const long long gran_steps[] = {
+	1, 100, 1000, 1000000, 1000000000LL, 2000000000LL, 86400000000000LL
+};
+
+/*
+ * Truncate ts to a multiple of gran nanoseconds, as a file system
+ * of that granularity does.
+ */
+static void
+ts_truncate(struct timespec *ts, long long gran)
+{
+	long long step, rem;
+
+	if(gran < 1000000000LL) {
+		ts->tv_nsec -= ts->tv_nsec % gran;
+		return;
+	}
+
+	step = gran / 1000000000LL;
+	if((rem = ts->tv_sec % step) < 0)
+		rem += step;
+	ts->tv_sec -= rem;
+	ts->tv_nsec = 0;
+}
+
+/*
+ * Returns TRUE if a and b are the same time stamp on a file system
+ * of granularity gran.
+ */
+static GENERAL_BOOL
+ts_equal_at(const struct timespec *a, const struct timespec *b, long long gran)
+{
+	struct timespec x = *a, y = *b;
+
+	ts_truncate(&x, gran);
+	ts_truncate(&y, gran);
+	return x.tv_sec == y.tv_sec && x.tv_nsec == y.tv_nsec;
+}
+
+/*
+ * Returns TRUE if change times a and b are as close as stepping
+ * the clock can make them.
+ */
+static GENERAL_BOOL
+ctime_equal(const struct timespec *a, const struct timespec *b)
+{
+	long long d;
+
+	if(a->tv_sec - b->tv_sec > 1 || b->tv_sec - a->tv_sec > 1)
+		return FALSE;
+	d = (long long)(a->tv_sec - b->tv_sec) * 1000000000LL +
+		(a->tv_nsec - b->tv_nsec);
+	return d > -CTIME_SLACK && d < CTIME_SLACK;
+}
+
+/*
+ * Fetch the mtime and atime granularity known for the file system
+ * dev into gran; 1 (exact) until something was learned.
+ */
+static void
+gran_lookup(struct stroke_run *run, dev_t dev, long long gran[2])
+{
+	int i;
+
+	gran[MTIME] = gran[ATIME] = 1;
+
+	pthread_mutex_lock(&run->gran_lock);
+	for(i = 0; i < run->ngrans; i++) {
+		if(run->grans[i].dev == dev) {
+			gran[MTIME] = run->grans[i].ns[MTIME];
+			gran[ATIME] = run->grans[i].ns[ATIME];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&run->gran_lock);
+}
+
+/*
+ * Learn the granularity of file system dev from having written the
+ * mtime and atime in want and read back got.
+ */
+static void
+gran_learn(struct stroke_run *run, dev_t dev, const struct timespec *want,
+	   const struct timespec *got)
+{
+	long long gran[2] = {0, 0};
+	struct timespec ts;
+	struct fs_gran *g = NULL;
+	size_t i;
+	int t;
+
+	for(t = MTIME; t <= ATIME; t++) {
+		if(want[t].tv_sec == got[t].tv_sec && want[t].tv_nsec == got[t].tv_nsec)
+			continue;
+		for(i = 1; i < sizeof gran_steps / sizeof *gran_steps; i++) {
+			ts = want[t];
+			ts_truncate(&ts, gran_steps[i]);
+			if(ts.tv_sec == got[t].tv_sec && ts.tv_nsec == got[t].tv_nsec) {
+				gran[t] = gran_steps[i];
+				break;
+			}
+		}
+	}
+	if(!gran[MTIME] && !gran[ATIME])
+		return;
+
+	pthread_mutex_lock(&run->gran_lock);
+	for(t = 0; t < run->ngrans; t++) {
+		if(run->grans[t].dev == dev) {
+			g = &run->grans[t];
+			break;
+		}
+	}
+	if(!g && run->ngrans < GRAN_DEVS) {
+		g = &run->grans[run->ngrans++];
+		g->dev = dev;
+		g->ns[MTIME] = g->ns[ATIME] = 1;
+	}
+	if(g) {
+		for(t = MTIME; t <= ATIME; t++) {
+			if(gran[t] > g->ns[t]) {
+				char buf[32];
+
+				g->ns[t] = gran[t];
+				snprintf(buf, sizeof buf, "%lld", gran[t]);
+				verbose(1, "File system granularity of %s: %s ns",
+					names[t], buf);
+			}
+		}
+	}
+	pthread_mutex_unlock(&run->gran_lock);
+}
+
+#ifdef HAVE_UTIMENSAT
+/*
+ * Set the access and modification time of file name, relative to
+ * dirfd, to ts; through the descriptor of ctx if it has one.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int
+set_utimes(struct file_ctx *ctx, int dirfd, const char *name,
+	   const struct timespec ts[2])
+{
+	if(ctx->fd >= 0 && !CHKFF(ctx, FDPATH))
+		return SC(futimens(ctx->fd, ts));
+
+#ifdef HAVE_FD_UTIMENS
+	if(ctx->fd >= 0) {
+		int rc = SC(utimensat(ctx->fd, "", ts, AT_EMPTY_PATH));
+
+		/* AT_EMPTY_PATH is only understood since Linux 5.8 */
+		if(rc == 0 || errno != EINVAL)
+			return rc;
+	}
+#endif
+
+	return SC(utimensat(dirfd, name, ts,
+			    CHKF(SYMLINKS) ? AT_SYMLINK_NOFOLLOW : 0));
+}
+#endif
+
 /*
- * Apply time stamps in time_vals array to file.
+ * Apply the access and modification time in the times array of
+ * ctx to file name, relative to dirfd; the change time is left to
+ * ctime_queue().
  * Returns 0 on success, -1 on failure.
  */
 static int
-apply(const char *file)
+apply(struct file_ctx *ctx, int dirfd, const char *name, const char *path)
 {
-	struct utimbuf ut;
-	int (*utimef)(const char *, const struct utimbuf *) =
-		CHKF(SYMLINKS) ? &lutime_symlink : &utime;
+	const struct timespec ts[2] = {ctx->times[ATIME], ctx->times[MTIME]};
+	long long t0;
+	int rc;
 
-	verbose(1, "Applying date and time alterations: \"%s\"", file);
+	verbose(1, "Applying date and time alterations: \"%s\"", path);
 	
-	/* mtime, atime */
-	if(ft_to_utimbuf(time_vals, &ut) < 0 || (*utimef)(file, &ut) < 0) {
+	/* mtime, atime; left alone if already as wanted */
+	rc = 0;
+	if(!CHKFF(ctx, UTSAME)) {
+		t0 = PHASE_START();
+#ifdef HAVE_UTIMENSAT
+		rc = set_utimes(ctx, dirfd, name, ts);
+#else
+		struct timeval tv[2] = {
+			{ts[0].tv_sec, ts[0].tv_nsec / 1000},
+			{ts[1].tv_sec, ts[1].tv_nsec / 1000}
+		};
+# ifdef HAVE_LUTIMES
+		if(CHKF(SYMLINKS))
+			rc = SC(lutimes(path, tv));
+		else
+# endif
+		rc = SC(utimes(path, tv));
+#endif
+		PHASE_END(PHASE_UTIME, t0);
+	}
+
+	if(rc < 0) {
 		if(errno == EPERM || errno == EACCES) {
+			int err = errno;
+			libgeneral_lock();
 			fprintf(stderr, "%s: ** ERROR: cannot modify \"%s\": %s\n",
-				PROGRAM, file, strerror(errno));
-			last_error_code = ERROR_ERROR_SETTIM_PERM;
+				PROGRAM, path, strerror(err));
+			error_set_last(ERROR_ERROR_SETTIM_PERM, err);
 			++error_cnt;
+			libgeneral_unlock();
 		} else {
-			error_out(ERROR_ERROR_SETTIM, errno, FLN, file);
+			error_out(ERROR_ERROR_SETTIM, errno, FLN, path);
 		}
 		return -1;
 	}
 	
-	/* ctime */
-	if(CHKF(CTAPPLY) || CHKF(CTPRES)) {
-		if(mod_ctime(time_vals, file) < 0)
-			return -1;
-	}
-	
 	return 0;
 }
 
+/* Room for one formatted time stamp */
+#define STAMP_LEN 128
+
 /*
- * Print mtime, atime, ctime information of current time_vals table.
+ * Print the report of the file of ctx, its time stamps already
+ * formatted into stamps. The caller holds the lock of stdout.
  */
 static void
-times_info(const char *file)
+print_report(struct file_ctx *ctx, const char *path,
+	     char stamps[TIME_TBLS][STAMP_LEN])
 {
-	char lnk[PATH_MAX];
 	int i, slnk;
 
-	printf("%s:\n", file);
+	printf("%s:\n", path);
 	
-	if((slnk = laccess(file, F_OK)) >= 0 &&
-	   (i = readlink(file, lnk, sizeof lnk)) > 0) {
-		lnk[i] = 0;
+	if((slnk = ctx_laccess(ctx)) >= 0 && *ctx->probe->link) {
 		printf("  Symbolic link: \"%s\" -> \"%s\" %s\n",
-		       file, lnk, IFSTR(slnk == LDANGLING, "(dangling)"));
+		       path, ctx->probe->link, IFSTR(slnk == LDANGLING, "(dangling)"));
 		printf("  %s shown:\n", CHKF(SYMLINKS) ? "Symbolic link" : "Actual file");
 	}
 
-	if(CHKF(NEXIST)) {
+	if(CHKFF(ctx, NEXIST)) {
 		printf("  File does not exist. %s\n",
-		       IFSTR(laccess(file, F_OK) == LDANGLING,
+		       IFSTR(ctx_laccess(ctx) == LDANGLING,
 			     "Dangling symbolic link? Try `-l'."));
-		return;
-	}
-	
-	for(i = 0; i < TIME_TBLS; i++) {
-		char *stamp = tv_to_str(time_vals, i);
-		printf("  %s: %s\n", names[i], stamp);
+	} else {
+		for(i = 0; i < TIME_TBLS; i++)
+			printf("  %s: %s\n", names[i], stamps[i]);
 	}
-	new_str(NULL);
 }
 
 /*
- * Prints usage; will exit program
+ * Prepare file for rendering the report of the file of ctx through
+ * `--format'; its local times are left to the caller. A file that
+ * does not exist has no line.
+ * Returns TRUE if the file is to be rendered.
  */
-static void
-usage(GENERAL_BOOL error)
+static GENERAL_BOOL
+format_prepare(struct file_ctx *ctx, const char *path,
+	       struct format_file *file)
 {
-	if(!error) printf(PROGRAM" - %s\n\n", *pinf);
-	else putchar('\n');
-	printf("%s", usg);
-	exit(error ? last_error_code : 0);
+	if(CHKFF(ctx, NEXIST)) {
+		error_out(ERROR_WARNING_SNAPSKIP, 0, FLN, path, "no such file");
+		return FALSE;
+	}
+	file->path = path;
+	file->link = ctx->probe->link;
+	file->times = ctx->times;
+	file->local = 0;
+	return TRUE;
 }
 
 /*
- * Prints program info; will exit program
+ * Fill in rec from the file of ctx for `--output'; action is what
+ * was done to it (ACTION_*).
  */
-static void info()
+static void
+output_prepare(struct file_ctx *ctx, const char *path, int action,
+	       struct output_record *rec)
 {
-	printf(infostr, libgeneral_version, pinf[2], pinf[3]);
-	exit(0);
+	int slnk = ctx_laccess(ctx);
+
+	rec->path = path;
+	rec->link = slnk >= 0 ? ctx->probe->link : NULL;
+	rec->dangling = slnk == LDANGLING;
+	rec->times = CHKFF(ctx, NEXIST) ? NULL : ctx->times;
+	rec->action = action;
 }
 
 /*
- * Perform cleanups; called atexit()
+ * Print mtime, atime, ctime information of the times array of ctx,
+ * render it through `--format' or write its `--output' record;
+ * action is as for output_prepare(). The report of one file is
+ * written in one piece.
  */
-void cleanups()
+static void
+times_write(struct stroke_run *run, struct file_ctx *ctx, const char *path,
+	    int action)
 {
-	libgeneral_uninit_errors();
-	libgeneral_uninit();
+	char stamps[TIME_TBLS][STAMP_LEN];
+	struct format_file file;
+	struct output_record rec;
+	time_t sec;
+	int i;
+
+	if(run->output) {
+		output_prepare(ctx, path, action, &rec);
+		writer_lock(run->out);
+		output_record(run->output, run->out, &rec);
+		writer_unlock(run->out);
+		return;
+	}
+
+	if(run->format) {
+		if(!format_prepare(ctx, path, &file))
+			return;
+		for(i = 0; i < TIME_TBLS &&
+			    (format_flags(run->format) & FORMAT_LOCAL); i++) {
+			sec = ctx->times[i].tv_sec;
+			if(zone_localtime(sec, &file.tm[i]) == 0 ||
+			   localtime_r(&sec, &file.tm[i]))
+				file.local |= TIME_BIT(i);
+		}
+		writer_lock(run->out);
+		format_render(run->format, run->out, &file);
+		writer_unlock(run->out);
+		return;
+	}
+
+	if(!CHKFF(ctx, NEXIST))
+		for(i = 0; i < TIME_TBLS; i++)
+			ts_to_str(&ctx->times[i], stamps[i], sizeof stamps[i]);
+
+	flockfile(stdout);
+	print_report(ctx, path, stamps);
+	funlockfile(stdout);
 }
 
-int
-main(int argc, char **argv)
+/*
+ * Report the file of ctx as times_write() does. If ctx has DEFER set
+ * the report is only marked as due; see probe_batch_report().
+ */
+static void
+times_info(struct stroke_run *run, struct file_ctx *ctx, const char *path,
+	   int action)
 {
-	sigset_t segv_mask;
-	int fd;
-	struct stroke_cli cli = {0};
-	GENERAL_BOOL preserve_ctime_requested = FALSE;
-	GENERAL_BOOL have_setters = FALSE;
-	FILE_TIME copy_template[TIME_TBLS][TIME_VALS];
-	GENERAL_BOOL have_copy_template = FALSE;
-
-	static const struct option long_opts[] = {
-		{"mtime",   required_argument, NULL, 'm'},
-		{"atime",   required_argument, NULL, 'a'},
-		{"ctime",   required_argument, NULL, 'c'},
-		{"reference", required_argument, NULL, 'r'},
-		{"copy",    required_argument, NULL, 'r'},
-		{"symlinks",no_argument,       NULL, 'l'},
-		{"preserve-ctime", no_argument,NULL, 'p'},
-		{"force",   no_argument,       NULL, 'f'},
-		{"quiet",   no_argument,       NULL, 'q'},
-		{"verbose", no_argument,       NULL, 'v'},
-		{"dry-run", no_argument,       NULL, 'n'},
-		{"utc",     no_argument,       NULL, 'Z'},
-		{"help",    no_argument,       NULL, 'h'},
-		{"version", no_argument,       NULL, 1001},
-		{0,0,0,0}
-	};
+	long long t0;
 
-	libgeneral_init(PROGRAM, 0);
-	libgeneral_init_errors(&error_messages, 0);
-	libgeneral_init_verbose(&verbosity_level, "verbose", 1);
+	if(CHKFF(ctx, DEFER)) {
+		SETFF(ctx, REPORT);
+		return;
+	}
 
-	atexit(&cleanups);
+	t0 = PHASE_START();
+	times_write(run, ctx, path, action);
+	PHASE_END(PHASE_OUTPUT, t0);
+}
 
-	sigfillset(&segv_mask);
-	SET_SIGNAL(SIGSEGV, &segv_mask, 0);
+/*
+ * Queue setting the change time of the file of ctx to ctime with
+ * the clock steps of run, which take over the descriptor of ctx.
+ * The report of the file and its journal entry are held back until
+ * the change time is set, a failure until it is known; see
+ * ctime_done(). Must be called inside a shared fileop_lock()
+ * section; action is as for output_prepare().
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+ctime_queue(struct stroke_run *run, struct file_ctx *ctx, int dirfd,
+	    const char *name, const char *path, const struct timespec *ctime,
+	    int action)
+{
+	const struct file_probe *p = ctx->probe;
+	size_t plen = strlen(path) + 1, llen = strlen(p->link) + 1;
+	struct held_file *h;
+	int rc;
 
-	SIGNAL_CATCHING();
-	CATCH_SIGNAL(SIGSEGV) {
-		error_out(ERROR_FATAL_SEGV, 0, FLN, GET_SIGINFO()->si_addr);
+	verbose(1, "Attempting to %s change time",
+		CHKFF(ctx, CTPRES) ? "preserve" : "modify");
+
+	h = general_malloc(sizeof *h + plen + llen);
+	h->ctx = *ctx;
+	h->ctx.fd = -1;
+	h->ctx.probe = NULL;
+	h->action = action;
+	h->err = p->err;
+	h->lerr = p->lerr;
+	h->lmode = p->lst.st_mode;
+	memcpy(h->path, path, plen);
+	h->link = memcpy(h->path + plen, p->link, llen);
+
+	if((rc = clockstep_add(run->steps, ctx->fd, dirfd, name, path, ctx->mode,
+			       ctime, CHKF(SYMLINKS), h)) < 0) {
+		free(h);
+		return -1;
+	}
+	ctx->fd = -1;
+	SETFF(ctx, CTQUEUED);
+
+	if(rc) {
+		fileop_unlock();
+		fileop_lock(TRUE);
+		rc = clockstep_flush(run->steps);
+		fileop_unlock();
+		fileop_lock(FALSE);
 	}
 
-	int opt;
-	while((opt = getopt_long(argc, argv, "m:a:c:r:lpqnvfZh", long_opts, NULL)) != -1) {
-		switch(opt) {
-		case 'm':
-			if(parse_timestamp_spec(optarg, &cli.mtime.ts,
-						cli.parse_utc) < 0) {
+	return rc;
+}
+
+/*
+ * Complete a file held by ctime_queue() once its change time is set
+ * (see CLOCKSTEP_DONE): report it with the change time it now has
+ * and journal it. One that failed is logged for `--keep-going' and
+ * has a record of its failure written for `--output', showing the
+ * time stamps it was left with.
+ * Returns 0 on success, -1 if the failure should end the run.
+ */
+static int
+ctime_done(void *arg, void *data, const struct timespec *ctime, int err)
+{
+	struct stroke_run *run = arg;
+	struct held_file *h = data;
+	struct file_probe probe;
+	int rc = 0;
+
+	if(!err) {
+		h->ctx.times[CTIME] = *ctime;
+		__atomic_add_fetch(&run->written, 1, __ATOMIC_RELAXED);
+		if(run->journal)
+			journal_add(run->journal, h->ctx.pos, h->path);
+	} else if(run->failed) {
+		failure_log_add(run->failed, h->path, ERROR_ERROR_CHCTIME, err);
+	} else {
+		rc = -1;
+	}
+
+	if(!CHKF(QUIET) && (!err || run->output)) {
+		probe.err = h->err;
+		probe.lerr = h->lerr;
+		probe.lst.st_mode = h->lmode;
+		strcpy(probe.link, h->link);
+		h->ctx.probe = &probe;
+		times_info(run, &h->ctx, h->path, err ? ACTION_FAILED : h->action);
+	}
+	free(h);
+
+	return rc;
+}
+
+/*
+ * Compile setter value src for clock into t: an expression is
+ * evaluated for every file, anything else is a SPEC evaluated now.
+ * Returns 0 on success, -1 if src is invalid.
+ */
+static int
+setter_compile(struct stroke_run *run, struct timestamp_param *t, int clock,
+	       const char *src)
+{
+	int rc;
+
+	expr_free(t->expr);
+	t->expr = NULL;
+	t->src = src;
+	t->set = TRUE;
+	run->have_setters = TRUE;
+
+	if((rc = expr_compile(src, clock, &t->expr)) != 0)
+		return rc < 0 ? -1 : 0;
+	return spec_eval(run->specs, src, strlen(src), run->cli.parse_utc, &t->ts);
+}
+
+/*
+ * Value of setter t for a file whose time stamps are cur.
+ */
+static void
+setter_value(struct stroke_run *run, const struct timestamp_param *t,
+	     const struct timespec *cur, struct timespec *out)
+{
+	if(t->expr)
+		expr_eval(t->expr, cur, run->copy_template, out);
+	else
+		*out = t->ts;
+}
+
+/*
+ * Inspect or modify a single file name, relative to dirfd, according
+ * to run, using ctx for all per-file state. path is the name of the
+ * file as shown to the user. given, if not NULL, holds time stamps
+ * for this file alone; setters still override them.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+process_ctx(struct stroke_run *run, struct file_ctx *ctx, int dirfd,
+	    const char *name, const char *path, const struct file_times *given)
+{
+	struct stroke_cli *cli = &run->cli;
+	struct timespec cur[TIME_TBLS], want[TIME_TBLS];
+	struct file_probe probe, *p;
+	struct stat st;
+	GENERAL_BOOL exists, unchanged = FALSE, queued = FALSE;
+	int action = ACTION_SET, rc;
+	long long t0;
+
+	/*
+	 * One look at the file answers everything asked about it
+	 * below. When it is to be modified it is kept open as well.
+	 */
+	if(!ctx->probe) {
+		ctx->probe = &probe;
+		t0 = PHASE_START();
+#ifdef HAVE_FD_UTIMENS
+		if(run->have_setters && !cli->dry_run) {
+			probe_open(&probe, dirfd, name, CHKF(SYMLINKS), &ctx->fd);
+			if(ctx->fd >= 0)
+				SETFF(ctx, FDPATH);
+		} else
+#endif
+		probe_lookup(&probe, dirfd, name);
+		PHASE_END(PHASE_PROBE, t0);
+	}
+	p = ctx->probe;
+	__atomic_add_fetch(&run->files, 1, __ATOMIC_RELAXED);
+	exists = (CHKF(SYMLINKS) ? p->lerr : p->err) == 0;
+
+	if(!exists)
+		SETFF(ctx, NEXIST);
+
+	if(!run->have_setters) {
+		if(exists && scan(ctx, name, path) < 0)
+			return -1;
+		if(run->snapshot) {
+			if(exists)
+				snapshot_add(run->snapshot, path, ctx->times);
+			else
+				error_out(ERROR_WARNING_SNAPSKIP, 0, FLN, path,
+					  "no such file");
+			return 0;
+		}
+		if(!CHKF(QUIET))
+			times_info(run, ctx, path,
+				   exists ? ACTION_SHOW : ACTION_MISSING);
+		return 0;
+	}
+
+	/* Files named by a snapshot or manifest are never created */
+	if(given && !exists) {
+		error_out(ERROR_WARNING_SNAPSKIP, 0, FLN, path, "no such file");
+		return 0;
+	}
+
+	/*
+	 * Nor are files found below a directory by `-R' (which have a
+	 * directory of their own to be looked up in): such a file is a
+	 * dangling symbolic link, whose target could be anywhere.
+	 */
+	if(dirfd != AT_FDCWD && !exists) {
+		error_out(ERROR_WARNING_SNAPSKIP, 0, FLN, path,
+			  ctx_laccess(ctx) == LDANGLING ?
+			  "dangling symbolic link" : "no such file");
+		return 0;
+	}
+
+	if(!exists) {
+		if(scan(ctx, NULL, path) < 0)
+			return -1;
+	} else {
+		if(scan(ctx, name, path) < 0)
+			return -1;
+	}
+	memcpy(cur, ctx->times, sizeof cur);
+
+	if(run->have_copy_template) {
+		memcpy(ctx->times, run->copy_template, sizeof(run->copy_template));
+		if(run->have_ctime_priv)
+			SETFF(ctx, CTAPPLY);
+	}
+
+	if(given) {
+		for(int i = 0; i < TIME_TBLS; i++) {
+			if(given->set & TIME_BIT(i))
+				ctx->times[i] = given->times[i];
+		}
+		if((given->set & TIME_BIT(CTIME)) && run->have_ctime_priv)
+			SETFF(ctx, CTAPPLY);
+	}
+
+	t0 = PHASE_START();
+	if(cli->mtime.set)
+		setter_value(run, &cli->mtime, cur, &ctx->times[MTIME]);
+
+	if(cli->atime.set)
+		setter_value(run, &cli->atime, cur, &ctx->times[ATIME]);
+
+	if(cli->ctime.set) {
+		setter_value(run, &cli->ctime, cur, &ctx->times[CTIME]);
+		SETFF(ctx, CTAPPLY);
+	}
+	if(cli->mtime.set || cli->atime.set || cli->ctime.set)
+		PHASE_END(PHASE_PARSE, t0);
+
+	GENERAL_BOOL run_preserve =
+		cli->preserve_ctime &&
+		(cli->mtime.set || cli->atime.set ||
+		 (given && !(given->set & TIME_BIT(CTIME))));
+
+	if(run_preserve)
+		SETFF(ctx, CTPRES);
+
+	t0 = PHASE_START();
+	rc = validate_times(ctx->times);
+	PHASE_END(PHASE_VALIDATE, t0);
+	if(rc < 0)
+		return -1;
+
+	/*
+	 * Leave alone time stamps that already are as wanted, so that
+	 * repeated runs only read metadata. Without a write the change
+	 * time needs no preserving either.
+	 */
+	if(exists) {
+		long long gran[2];
+
+		gran_lookup(run, ctx->dev, gran);
+		if(ts_equal_at(&cur[MTIME], &ctx->times[MTIME], gran[MTIME]) &&
+		   ts_equal_at(&cur[ATIME], &ctx->times[ATIME], gran[ATIME])) {
+			SETFF(ctx, UTSAME);
+			REMFF(ctx, CTPRES);
+			if(CHKFF(ctx, CTAPPLY) &&
+			   ctime_equal(&cur[CTIME], &ctx->times[CTIME]))
+				REMFF(ctx, CTAPPLY);
+			unchanged = !CHKFF(ctx, CTAPPLY);
+		}
+	}
+
+	GENERAL_BOOL need_ctime = CHKFF(ctx, CTAPPLY) || CHKFF(ctx, CTPRES);
+
+	if(unchanged) {
+		verbose(1, "Time stamps already up to date: \"%s\"", path);
+		memcpy(ctx->times, cur, sizeof cur);
+		action = ACTION_UNCHANGED;
+		__atomic_add_fetch(&run->unchanged, 1, __ATOMIC_RELAXED);
+	} else if(cli->dry_run) {
+		action = ACTION_DRYRUN;
+		if(check_dry_run_permissions(ctx, dirfd, name, path, exists,
+					     need_ctime, CHKFF(ctx, NEXIST)) < 0)
+			return -1;
+	} else {
+		/*
+		 * A new file is set up through the descriptor it was
+		 * created with; should one have appeared in the meantime
+		 * it is not truncated.
+		 */
+		if(CHKFF(ctx, NEXIST)) {
+			if((ctx->fd = SC(openat(dirfd, name,
+						O_CREAT | O_WRONLY | O_CLOEXEC,
+						S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH))) < 0) {
+				error_out(ERROR_ERROR_FCREATE, errno, FLN, path);
+				return -1;
+			}
+			if(SC(fstat(ctx->fd, &st)) < 0) {
+				error_out(ERROR_ERROR_STAT, 0, FLN, path, strerror(errno));
+				return -1;
+			}
+			ctx->dev = st.st_dev;
+			ctx->mode = st.st_mode;
+			REMFF(ctx, NEXIST);
+			action = ACTION_CREATE;
+			verbose(1, "File created: \"%s\"", *p->link ? p->link : path);
+
+			/* Created through a dangling link, or plainly */
+			p->st = st;
+			p->err = 0;
+			if(p->lerr) {
+				p->lst = st;
+				p->lerr = 0;
+			}
+			exists = TRUE;
+		}
+
+		memcpy(want, ctx->times, sizeof want);
+		if(apply(ctx, dirfd, name, path) < 0)
+			return -1;
+
+		if(rescan(ctx, dirfd, name, path) < 0)
+			return -1;
+		if(!CHKFF(ctx, UTSAME))
+			gran_learn(run, ctx->dev, want, ctx->times);
+		queued = need_ctime;
+	}
+
+	if(run->warn_ctime_pending &&
+	   !__atomic_exchange_n(&run->ctime_warning_emitted, 1, __ATOMIC_RELAXED))
+		error_out(ERROR_WARNING_CTCOPY, 0, FLN);
+
+	/* Counted and reported once the change time is set */
+	if(queued)
+		return ctime_queue(run, ctx, dirfd, name, path, &want[CTIME],
+				   action);
+
+	if(!unchanged)
+		__atomic_add_fetch(&run->written, 1, __ATOMIC_RELAXED);
+
+	if(CHKF(QUIET))
+		return 0;
+
+	/* A dry run reports the file as if it had been created */
+	REMFF(ctx, NEXIST);
+	times_info(run, ctx, path, action);
+
+	return 0;
+}
+
+/*
+ * Note that processing path failed. With `--keep-going' the failure
+ * is logged along with the error it was reported with, and the run
+ * goes on with the next file.
+ * Returns 0 if it should, -1 otherwise.
+ */
+static int
+file_failed(struct stroke_run *run, const char *path)
+{
+	int code, err;
+
+	if(!run->failed)
+		return -1;
+	error_last(&code, &err);
+	failure_log_add(run->failed, path, code, err);
+
+	return 0;
+}
+
+/*
+ * Note that the file of ctx, path, is done, for `--journal'. One
+ * whose change time is still queued is noted once that is set; see
+ * ctime_done().
+ */
+static void
+file_done(struct stroke_run *run, struct file_ctx *ctx, const char *path)
+{
+	if(run->journal && !CHKFF(ctx, CTQUEUED))
+		journal_add(run->journal, ctx->pos, path);
+}
+
+/*
+ * Process a single file with a fresh context; given is as for
+ * process_ctx() and pos is the input position of the file.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+process_file(struct stroke_run *run, int dirfd, const char *name,
+	     const char *path, const struct file_times *given,
+	     unsigned long long pos)
+{
+	struct file_ctx ctx;
+	long long t0 = TRACE_START();
+	int rc;
+
+	file_ctx_init(&ctx);
+	ctx.pos = pos;
+
+	fileop_lock(FALSE);
+	rc = process_ctx(run, &ctx, dirfd, name, path, given);
+	fileop_unlock();
+	file_ctx_release(&ctx);
+
+	if(rc < 0)
+		rc = file_failed(run, path);
+	else
+		file_done(run, &ctx, path);
+	TRACE_END("file", t0, path);
+
+	return rc;
+}
+
+/*
+ * Drop a reference to dir, closing it with the last one.
+ */
+static void
+dir_ref_put(struct dir_ref *dir)
+{
+	if(dir && !__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL)) {
+		close(dir->fd);
+		free(dir);
+	}
+}
+
+/*
+ * Worker side of process_file(); see POOL_HANDLER.
+ */
+static int
+process_task(void *arg, void *data, GENERAL_BOOL skip)
+{
+	struct file_task *task = data;
+	int rc = 0;
+
+	if(!skip)
+		rc = process_file(arg, task->dir ? task->dir->fd : AT_FDCWD,
+				  task->name, task->path,
+				  task->has_given ? &task->given : NULL, task->pos);
+	dir_ref_put(task->dir);
+	free(task);
+
+	return rc;
+}
+
+/*
+ * Set up batched lookups for inspect mode.
+ * Returns NULL if io_uring cannot be used.
+ */
+static struct probe_batch*
+probe_batch_create(void)
+{
+	struct probe_batch *b;
+	struct uring *ring;
+
+	if(!(ring = uring_open(PROBE_BATCH)))
+		return NULL;
+
+	b = general_malloc(sizeof *b);
+	b->ring = ring;
+	b->count = 0;
+	b->paths = arena_new(PROBE_PATHS_CHUNK);
+
+	return b;
+}
+
+/*
+ * Render the reports held back for the first n files of the batch
+ * through `--format', all in one piece. Their time stamps have
+ * been converted into z if the format needs that.
+ */
+static void
+probe_batch_render(struct stroke_run *run, struct probe_batch *b, size_t n,
+		   const struct zone_batch *z)
+{
+	struct format_file file;
+	struct probe_entry *e;
+	size_t i;
+	int t;
+
+	writer_lock(run->out);
+	for(i = 0; i < n; i++) {
+		e = &b->entries[i];
+		if(!CHKFF(&e->ctx, REPORT) || !format_prepare(&e->ctx, e->path, &file))
+			continue;
+		for(t = 0; t < TIME_TBLS && z; t++)
+			if(zone_batch_tm(z, i * TIME_TBLS + t, &file.tm[t]) == 0)
+				file.local |= TIME_BIT(t);
+		format_render(run->format, run->out, &file);
+	}
+	writer_unlock(run->out);
+}
+
+/*
+ * Print the reports held back for the first n files of the batch,
+ * all in one piece. Their time stamps are converted in one go,
+ * unless only `--output' records are written.
+ * Returns the number of reports printed.
+ */
+static size_t
+probe_batch_report(struct stroke_run *run, struct probe_batch *b, size_t n)
+{
+	struct zone_batch *z = &b->stamps;
+	char stamps[TIME_TBLS][STAMP_LEN];
+	struct probe_entry *e;
+	size_t due = 0;
+	size_t i;
+	int t;
+
+	for(i = 0; i < n; i++) {
+		e = &b->entries[i];
+		for(t = 0; t < TIME_TBLS; t++)
+			z->t[i * TIME_TBLS + t] = CHKFF(&e->ctx, NEXIST) ? 0 :
+				e->ctx.times[t].tv_sec;
+		if(CHKFF(&e->ctx, REPORT))
+			++due;
+	}
+	if(!due)
+		return 0;
+
+	if(run->output) {
+		struct output_record rec;
+
+		writer_lock(run->out);
+		for(i = 0; i < n; i++) {
+			e = &b->entries[i];
+			if(!CHKFF(&e->ctx, REPORT))
+				continue;
+			output_prepare(&e->ctx, e->path, CHKFF(&e->ctx, NEXIST) ?
+				       ACTION_MISSING : ACTION_SHOW, &rec);
+			output_record(run->output, run->out, &rec);
+		}
+		writer_unlock(run->out);
+		return due;
+	}
+
+	if(run->format) {
+		if(!(format_flags(run->format) & FORMAT_LOCAL))
+			z = NULL;
+		else
+			zone_localtime_batch(z, n * TIME_TBLS);
+		probe_batch_render(run, b, n, z);
+		return due;
+	}
+
+	zone_localtime_batch(z, n * TIME_TBLS);
+
+	flockfile(stdout);
+	for(i = 0; i < n; i++) {
+		e = &b->entries[i];
+		if(!CHKFF(&e->ctx, REPORT))
+			continue;
+		for(t = 0; t < TIME_TBLS; t++)
+			zone_batch_str(z, i * TIME_TBLS + t, stamps[t], sizeof stamps[t]);
+		print_report(&e->ctx, e->path, stamps);
+	}
+	funlockfile(stdout);
+
+	return due;
+}
+
+/*
+ * Look up and then process every file collected in the batch, in
+ * the order they were added, and print their reports. Should the
+ * ring fail, the files are processed the ordinary way instead.
+ * Processing stops at the first file that fails.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+probe_batch_flush(struct stroke_run *run)
+{
+	struct probe_batch *b = run->batch;
+	struct probe_entry *e;
+	GENERAL_BOOL probed = TRUE;
+	long long t0, t1, tf, share = 0;
+	size_t i, n;
+	int rc = 0;
+
+	/*
+	 * Only the link itself is looked up in the ring; the few
+	 * links among the files are resolved afterwards. For `--stats'
+	 * every file is charged an equal share of the ring's round trip;
+	 * `--trace' shows the round trip as a span of its own.
+	 */
+	t0 = PHASE_START();
+	for(i = 0; b->ring && i < b->count; i++) {
+		e = &b->entries[i];
+		uring_queue_stat(b->ring, e->dir ? e->dir->fd : AT_FDCWD, e->name,
+				 FALSE, &e->probe.lst, &e->probe.lerr);
+	}
+	if(!b->ring) {
+		probed = FALSE;
+	} else if(b->count && uring_run(b->ring) < 0) {
+		/* The ring is not trusted with another batch */
+		verbose(1, "io_uring lookups failed; falling back to stat()");
+		uring_close(b->ring);
+		b->ring = NULL;
+		probed = FALSE;
+	} else if(t0 && b->count) {
+		t1 = stats_clock();
+		share = (t1 - t0) / b->count;
+		if(trace_on)
+			trace_span("uring", t0, t1, NULL);
+	}
+
+	for(i = 0; !rc && i < b->count; i++) {
+		e = &b->entries[i];
+		tf = TRACE_START();
+		t0 = PHASE_START();
+		if(probed)
+			probe_resolve(&e->probe, e->dir ? e->dir->fd : AT_FDCWD,
+				      e->name);
+		else
+			probe_lookup(&e->probe, e->dir ? e->dir->fd : AT_FDCWD,
+				     e->name);
+		if(t0) {
+			t1 = stats_clock();
+			if(stats_on)
+				stats_add(PHASE_PROBE, t1 - t0 + share, 1);
+			if(trace_on)
+				trace_span("probe", t0, t1, NULL);
+		}
+		file_ctx_init(&e->ctx);
+		e->ctx.probe = &e->probe;
+		e->ctx.pos = e->pos;
+		SETFF(&e->ctx, DEFER);
+		fileop_lock(FALSE);
+		rc = process_ctx(run, &e->ctx, e->dir ? e->dir->fd : AT_FDCWD,
+				 e->name, e->path, NULL);
+		fileop_unlock();
+		file_ctx_release(&e->ctx);
+		if(rc < 0)
+			rc = file_failed(run, e->path);
+		else
+			file_done(run, &e->ctx, e->path);
+		TRACE_END("file", tf, e->path);
+	}
+	t0 = PHASE_START();
+	n = probe_batch_report(run, b, i);
+	if(n)
+		PHASE_END_N(PHASE_OUTPUT, t0, n);
+
+	for(i = 0; i < b->count; i++)
+		dir_ref_put(b->entries[i].dir);
+	arena_reset(b->paths);
+	b->count = 0;
+
+	return rc;
+}
+
+/*
+ * Add file name, relative to dirfd, to the batch; a full batch is
+ * flushed first. dir and pos are as for dispatch().
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+probe_batch_add(struct stroke_run *run, struct dir_ref *dir,
+		const char *name, const char *path, unsigned long long pos)
+{
+	struct probe_batch *b = run->batch;
+	struct probe_entry *e;
+
+	if(b->count == PROBE_BATCH && probe_batch_flush(run) < 0)
+		return -1;
+
+	e = &b->entries[b->count++];
+	e->path = arena_str(b->paths, path);
+	e->name = e->path + (name - path);
+	e->pos = pos;
+	if((e->dir = dir))
+		__atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/*
+ * Release the batch along with any files still in it.
+ */
+static void
+probe_batch_destroy(struct probe_batch *b)
+{
+	size_t i;
+
+	for(i = 0; i < b->count; i++)
+		dir_ref_put(b->entries[i].dir);
+	arena_destroy(&b->paths);
+	uring_close(b->ring);
+	free(b);
+}
+
+/*
+ * Process file name, relative to dirfd, either right away or, with
+ * `-j', by queuing it for the worker threads. In inspect mode files
+ * may be collected for batched lookups instead. dir holds dirfd open
+ * for queued files; it is NULL if dirfd is AT_FDCWD. given is as
+ * for process_ctx(). Files that `--journal' records as done by an
+ * earlier run are skipped.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+dispatch(struct stroke_run *run, struct dir_ref *dir, int dirfd,
+	 const char *name, const char *path, const struct file_times *given)
+{
+	unsigned long long pos = ++run->position;
+	struct file_task *task;
+	size_t len;
+
+	if(run->journal && journal_completed(run->journal, pos, path)) {
+		++run->resumed;
+		return 0;
+	}
+
+	if(run->batch)
+		return probe_batch_add(run, dir, name, path, pos);
+
+	if(!run->pool)
+		return process_file(run, dirfd, name, path, given, pos);
+
+	if(pool_failed(run->pool))
+		return -1;
+
+	len = strlen(path);
+	task = general_malloc(sizeof *task + len + 1);
+	memcpy(task->path, path, len + 1);
+	task->name = task->path + (name - path);
+	if((task->has_given = given != NULL))
+		task->given = *given;
+	task->pos = pos;
+	if((task->dir = dir))
+		__atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+
+	pool_submit(run->pool, task);
+	return 0;
+}
+
+/*
+ * Process path given on the command line; with `-R' every
+ * file below it is processed as well.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+process_arg(struct stroke_run *run, const char *path)
+{
+	struct walk_entry entry;
+	struct dir_ref *dir = NULL;
+	unsigned long dir_id = 0;
+	struct walk *w;
+	int rc;
+
+	if(!run->cli.recursive)
+		return dispatch(run, NULL, AT_FDCWD, path, path, NULL);
+
+	w = walk_open(path, !CHKF(SYMLINKS), FALSE);
+	while((rc = walk_next(w, &entry)) != 0) {
+		if(rc < 0) {
+			if(file_failed(run, walk_path(w)) < 0)
+				break;
+			continue;
+		}
+
+		/*
+		 * Queued files outlive the walk's descriptors, so each
+		 * directory they refer to is kept open by a duplicate.
+		 */
+		if((run->pool || run->batch) && entry.dirfd != AT_FDCWD &&
+		   (!dir || dir_id != entry.dir_id)) {
+			dir_ref_put(dir);
+			dir = general_malloc(sizeof *dir);
+			dir->refs = 1;
+			dir_id = entry.dir_id;
+			if((dir->fd = fcntl(entry.dirfd, F_DUPFD_CLOEXEC, 0)) < 0) {
+				error_out(ERROR_ERROR_OPENDIR, errno, FLN, entry.path);
+				free(dir);
+				dir = NULL;
+				rc = -1;
+				break;
+			}
+		}
+
+		if(dispatch(run, entry.dirfd == AT_FDCWD ? NULL : dir,
+			    entry.dirfd, entry.name, entry.path, NULL) < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	dir_ref_put(dir);
+	walk_close(w);
+
+	return rc;
+}
+
+/*
+ * Process every path listed in file (standard input if "-").
+ * Paths are streamed one at a time, so arbitrarily long lists
+ * are handled in constant memory.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+process_list(struct stroke_run *run, const char *file)
+{
+	struct path_reader *r;
+	const char *path;
+	int rc;
+
+	if(!(r = path_reader_open(file, run->cli.list_delim)))
+		return -1;
+
+	while((rc = path_reader_next(r, &path)) > 0) {
+		if(process_arg(run, path) < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	path_reader_close(r);
+
+	return rc;
+}
+
+/*
+ * The directories open on the way from base to the file of a path.
+ * The paths of a snapshot come sorted, so a path mostly lies in
+ * the directories of the one before; only the rest is opened, one
+ * component at a time, so that no lookup is longer than a name.
+ */
+struct dir_chain {
+	int base;
+	char *path;		/* Directories of the path before */
+	size_t pathsz;
+	struct dir_level {
+		struct dir_ref *dir;
+		size_t end;	/* Length of the path up to it */
+	} *level;
+	size_t depth;
+	size_t size;
+};
+
+/*
+ * Open the directories of path, relative to the base of c, keeping
+ * those it shares with the path before. The file is left as *name,
+ * to be looked up relative to *dir, or to the base of c if *dir is
+ * NULL.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int
+dir_chain_enter(struct dir_chain *c, const char *path,
+		struct dir_ref **dir, const char **name)
+{
+	const char *slash = strrchr(path, '/');
+	size_t dirlen = slash ? (size_t)(slash - path) + 1 : 0;
+	size_t keep = 0, off, len;
+	char comp[NAME_MAX + 1];
+	struct dir_ref *d;
+	int fd;
+
+	while(keep < c->depth && c->level[keep].end <= dirlen &&
+	      !memcmp(c->path, path, c->level[keep].end))
+		++keep;
+	while(c->depth > keep)
+		dir_ref_put(c->level[--c->depth].dir);
+
+	if(dirlen + 1 > c->pathsz) {
+		c->pathsz = dirlen + 1;
+		c->path = general_realloc(c->path, c->pathsz);
+	}
+	memcpy(c->path, path, dirlen);
+
+	for(off = keep ? c->level[keep-1].end : 0; off < dirlen; off += len + 1) {
+		len = (const char*)memchr(path + off, '/', dirlen - off) - (path + off);
+		if(!len && off)
+			continue;
+		if(len > NAME_MAX) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		if(len)
+			memcpy(comp, path + off, len);
+		else
+			comp[len++] = '/';
+		comp[len] = 0;
+		if((fd = SC(openat(c->depth ? c->level[c->depth-1].dir->fd : c->base,
+				   comp, O_RDONLY | O_DIRECTORY | O_CLOEXEC))) < 0)
+			return -1;
+		if(*comp == '/')
+			len = 0;
+
+		d = general_malloc(sizeof *d);
+		d->fd = fd;
+		d->refs = 1;
+		if(c->depth == c->size) {
+			c->size = c->size ? c->size << 1 : 16;
+			c->level = general_realloc(c->level, c->size * sizeof *c->level);
+		}
+		c->level[c->depth].dir = d;
+		c->level[c->depth++].end = off + len + 1;
+	}
+
+	*dir = c->depth ? c->level[c->depth-1].dir : NULL;
+	*name = path + dirlen;
+	return 0;
+}
+
+/*
+ * Close the directories of c.
+ */
+static void
+dir_chain_close(struct dir_chain *c)
+{
+	while(c->depth)
+		dir_ref_put(c->level[--c->depth].dir);
+	free(c->level);
+	free(c->path);
+	if(c->base != AT_FDCWD)
+		close(c->base);
+}
+
+/*
+ * Put back the time stamps of every file in snapshot r. Entries are
+ * taken straight from the mapped snapshot, one at a time, and their
+ * paths are followed from the directory the snapshot was taken in.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+process_snapshot(struct stroke_run *run, struct snapshot_reader *r)
+{
+	struct dir_chain chain;
+	struct file_times given;
+	struct dir_ref *dir;
+	const char *path, *name, *root = snapshot_root(r);
+	int rc;
+
+	memset(&chain, 0, sizeof chain);
+	chain.base = AT_FDCWD;
+	if(root && (chain.base = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		error_out(ERROR_ERROR_OPENDIR, errno, FLN, root);
+		return -1;
+	}
+
+	given.set = TIME_BIT(MTIME) | TIME_BIT(ATIME) | TIME_BIT(CTIME);
+	while((rc = snapshot_next(r, &path, given.times)) > 0) {
+		if(dir_chain_enter(&chain, path, &dir, &name) < 0) {
+			/* Taken up like a file that is missing or failed */
+			++run->position;
+			if(errno == ENOENT || errno == ENOTDIR) {
+				error_out(ERROR_WARNING_SNAPSKIP, 0, FLN, path,
+					  "no such file");
+				continue;
+			}
+			error_out(ERROR_ERROR_OPENDIR, errno, FLN, path);
+			if(file_failed(run, path) < 0) {
+				rc = -1;
+				break;
+			}
+			continue;
+		}
+		if(dispatch(run, dir, dir ? dir->fd : chain.base, name, path,
+			    &given) < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	dir_chain_close(&chain);
+
+	return rc;
+}
+
+/*
+ * Parse time stamp field f of length len from a manifest. Seconds
+ * since the epoch are taken here also without the `@'; anything
+ * else is a SPEC. An empty field or `-' leaves the clock alone.
+ * Returns 1 if a time was parsed, 0 if none is given, -1 on failure.
+ */
+static int
+parse_manifest_time(struct stroke_run *run, const char *f, size_t len,
+		    struct timespec *ts)
+{
+	if(!len || (len == 1 && *f == '-'))
+		return 0;
+
+	if(literal_epoch(f, len, ts))
+		return 1;
+
+	return spec_eval(run->specs, f, len, run->cli.parse_utc, ts) < 0 ? -1 : 1;
+}
+
+/*
+ * Apply the time stamps listed in manifest file, one file per
+ * record, straight from the file.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+process_manifest(struct stroke_run *run, const char *file)
+{
+	static const int clocks[MANIFEST_FIELDS] = {MTIME, ATIME};
+	struct manifest_record rec;
+	struct file_times given;
+	struct manifest *m;
+	int rc, i;
+
+	if(!(m = manifest_open(file)))
+		return -1;
+
+	while((rc = manifest_next(m, &rec)) > 0) {
+		given.set = 0;
+		for(i = 0; i < MANIFEST_FIELDS; i++) {
+			long long t0 = PHASE_START();
+			int got = parse_manifest_time(run, rec.field[i], rec.len[i],
+						      &given.times[clocks[i]]);
+
+			if(got > 0)
+				PHASE_END(PHASE_PARSE, t0);
+			if(got < 0) {
+				char spec[64], line[32];
+
+				snprintf(spec, sizeof spec, "%.*s",
+					 (int)(rec.len[i] < 48 ? rec.len[i] : 48),
+					 rec.field[i]);
+				snprintf(line, sizeof line, "%lu", rec.line);
+				error_out(ERROR_ERROR_MANITIME, 0, FLN, spec, file, line);
+				rc = -1;
+				break;
+			}
+			if(got)
+				given.set |= TIME_BIT(clocks[i]);
+		}
+
+		/*
+		 * With `--keep-going' a bad record fails its file alone;
+		 * it keeps its input position all the same
+		 */
+		if(rc < 0) {
+			++run->position;
+			if(file_failed(run, rec.path) < 0)
+				break;
+			continue;
+		}
+
+		if(dispatch(run, NULL, AT_FDCWD, rec.path, rec.path, &given) < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	manifest_close(m);
+
+	return rc;
+}
+
+/*
+ * Describe input file by its size and modification time into buf
+ * of size len, so that a journal notices when a file of the same
+ * name holds other times; see `--journal'.
+ * Returns buf, or NULL if file is NULL, standard input or cannot
+ * be looked up.
+ */
+static const char*
+input_identity(const char *file, char *buf, size_t len)
+{
+	struct stat st;
+
+	if(!file || !strcmp(file, "-") || stat(file, &st) < 0)
+		return NULL;
+	snprintf(buf, len, "%lld %lld.%09ld", (long long)st.st_size,
+		 (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+	return buf;
+}
+
+/*
+ * Order in which a sorted walk returns relative paths: names
+ * within a directory compare by strcmp(), and a directory comes
+ * after everything below it. The root itself is "".
+ */
+static int
+walk_order(const char *a, const char *b)
+{
+	size_t i = 0;
+	unsigned char ca, cb;
+
+	while(a[i] && a[i] == b[i])
+		++i;
+	if(!a[i] && !b[i])
+		return 0;
+
+	/* One is a directory the other lies below */
+	if(!a[i] && (!i || b[i] == '/'))
+		return 1;
+	if(!b[i] && (!i || a[i] == '/'))
+		return -1;
+
+	ca = a[i] == '/' ? 0 : a[i];
+	cb = b[i] == '/' ? 0 : b[i];
+	return ca < cb ? -1 : 1;
+}
+
+/*
+ * Path of a walk entry relative to the root of length rootlen.
+ */
+static const char*
+rel_path(const char *path, size_t rootlen)
+{
+	path += rootlen;
+	return *path == '/' ? path + 1 : path;
+}
+
+/*
+ * Read the time stamps of a walk entry into ctx the way scan()
+ * does for any other file. A dangling symbolic link is compared
+ * by the times of the link itself.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+diff_scan(struct file_ctx *ctx, struct file_probe *p,
+	  const struct walk_entry *e)
+{
+	file_ctx_init(ctx);
+	probe_lookup(p, e->dirfd, e->name);
+	ctx->probe = p;
+	if(ctx_laccess(ctx) == LDANGLING) {
+		stat_to_ctx(ctx, &p->lst);
+		return 0;
+	}
+	return scan(ctx, e->name, e->path);
+}
+
+/*
+ * Write the difference b - a as signed seconds to buf.
+ */
+static char*
+ts_delta_str(const struct timespec *a, const struct timespec *b,
+	     char *buf, size_t len)
+{
+	long long d = (long long)(b->tv_sec - a->tv_sec) * 1000000000LL +
+		(b->tv_nsec - a->tv_nsec);
+
+	snprintf(buf, len, "%c%lld.%09lld", d < 0 ? '-' : '+',
+		 (d < 0 ? -d : d) / 1000000000LL, (d < 0 ? -d : d) % 1000000000LL);
+	return buf;
+}
+
+/*
+ * Compare the trees a and b by walking both in sorted order and
+ * joining their entries by relative path. Files only in b are
+ * shown as added (+), files only in a as removed (-), and files in
+ * both whose time stamps differ (~) with the change of every clock.
+ * Only the directories currently being walked are held in memory.
+ * Returns 1 if the trees differ, 0 if not, -1 on failure.
+ */
+static int
+process_diff(const char *a, const char *b)
+{
+	struct walk *wa, *wb;
+	struct walk_entry ea, eb;
+	struct file_probe pa, pb;
+	struct file_ctx ca, cb;
+	unsigned long added = 0, removed = 0, changed = 0, same = 0;
+	size_t alen = strlen(a), blen = strlen(b);
+	const char *ra = NULL, *rb = NULL;
+	char delta[48], counts[4][32];
+	int rc = 0, ha, hb, cmp, i;
+
+	wa = walk_open(a, !CHKF(SYMLINKS), TRUE);
+	wb = walk_open(b, !CHKF(SYMLINKS), TRUE);
+
+	ha = walk_next(wa, &ea);
+	hb = walk_next(wb, &eb);
+	while(ha > 0 || hb > 0) {
+		if(ha < 0 || hb < 0)
+			break;
+		if(ha > 0)
+			ra = rel_path(ea.path, alen);
+		if(hb > 0)
+			rb = rel_path(eb.path, blen);
+
+		if(ha <= 0)
+			cmp = 1;
+		else if(hb <= 0)
+			cmp = -1;
+		else
+			cmp = walk_order(ra, rb);
+
+		if(cmp < 0) {
+			++removed;
+			if(!CHKF(QUIET))
+				printf("- %s\n", *ra ? ra : ".");
+			ha = walk_next(wa, &ea);
+			continue;
+		}
+		if(cmp > 0) {
+			++added;
+			if(!CHKF(QUIET))
+				printf("+ %s\n", *rb ? rb : ".");
+			hb = walk_next(wb, &eb);
+			continue;
+		}
+
+		if(diff_scan(&ca, &pa, &ea) < 0 || diff_scan(&cb, &pb, &eb) < 0) {
+			rc = -1;
+		} else {
+			GENERAL_BOOL differs = FALSE;
+
+			for(i = 0; i < TIME_TBLS; i++) {
+				if(ca.times[i].tv_sec == cb.times[i].tv_sec &&
+				   ca.times[i].tv_nsec == cb.times[i].tv_nsec)
+					continue;
+				if(!differs && !CHKF(QUIET))
+					printf("~ %s:", *ra ? ra : ".");
+				if(!CHKF(QUIET))
+					printf(" %s %s", names[i],
+					       ts_delta_str(&ca.times[i], &cb.times[i],
+							    delta, sizeof delta));
+				differs = TRUE;
+			}
+			if(differs) {
+				++changed;
+				if(!CHKF(QUIET))
+					putchar('\n');
+			} else {
+				++same;
+			}
+		}
+
+		ha = walk_next(wa, &ea);
+		hb = walk_next(wb, &eb);
+	}
+	if(ha < 0 || hb < 0)
+		rc = -1;
+
+	walk_close(wa);
+	walk_close(wb);
+
+	snprintf(counts[0], sizeof counts[0], "%lu", added);
+	snprintf(counts[1], sizeof counts[1], "%lu", removed);
+	snprintf(counts[2], sizeof counts[2], "%lu", changed);
+	snprintf(counts[3], sizeof counts[3], "%lu", same);
+	verbose(1, "%s added, %s removed, %s changed, %s unchanged",
+		counts[0], counts[1], counts[2], counts[3]);
+
+	if(rc < 0)
+		return -1;
+	return added || removed || changed;
+}
+
+/*
+ * Prints usage; will exit program
+ */
+static void
+usage(GENERAL_BOOL error)
+{
+	if(!error) printf(PROGRAM" - %s\n\n", *pinf);
+	else putchar('\n');
+	printf("%s", usg);
+	exit(error ? last_error_code : 0);
+}
+
+/*
+ * Prints program info; will exit program
+ */
+static void info()
+{
+	printf(infostr, libgeneral_version, pinf[2], pinf[3]);
+	exit(0);
+}
+
+/*
+ * Perform cleanups; called atexit()
+ */
+void cleanups()
+{
+	libgeneral_uninit_errors();
+	libgeneral_uninit();
+}
+
+int
+main(int argc, char **argv)
+{
+	sigset_t segv_mask;
+	static struct stroke_run run;
+	struct stroke_cli *cli = &run.cli;
+
+	cli->list_delim = '\n';
+	cli->jobs = 1;
+
+	static const struct option long_opts[] = {
+		{"mtime",   required_argument, NULL, 'm'},
+		{"atime",   required_argument, NULL, 'a'},
+		{"ctime",   required_argument, NULL, 'c'},
+		{"reference", required_argument, NULL, 'r'},
+		{"copy",    required_argument, NULL, 'r'},
+		{"symlinks",no_argument,       NULL, 'l'},
+		{"preserve-ctime", no_argument,NULL, 'p'},
+		{"recursive", no_argument,     NULL, 'R'},
+		{"files-from", required_argument, NULL, 1002},
+		{"null",    no_argument,       NULL, '0'},
+		{"jobs",    required_argument, NULL, 'j'},
+		{"stats",   optional_argument, NULL, 1003},
+		{"save",    required_argument, NULL, 1004},
+		{"restore", required_argument, NULL, 1005},
+		{"diff",    no_argument,       NULL, 1006},
+		{"manifest", required_argument, NULL, 1007},
+		{"format",  required_argument, NULL, 1008},
+		{"output",  required_argument, NULL, 1009},
+		{"keep-going", no_argument,    NULL, 1010},
+		{"retry-list", required_argument, NULL, 1011},
+		{"journal", required_argument, NULL, 1012},
+		{"trace", required_argument, NULL, 1013},
+		{"force",   no_argument,       NULL, 'f'},
+		{"quiet",   no_argument,       NULL, 'q'},
+		{"verbose", no_argument,       NULL, 'v'},
+		{"dry-run", no_argument,       NULL, 'n'},
+		{"utc",     no_argument,       NULL, 'Z'},
+		{"help",    no_argument,       NULL, 'h'},
+		{"version", no_argument,       NULL, 1001},
+		{0,0,0,0}
+	};
+
+	libgeneral_init(PROGRAM, 0);
+	libgeneral_init_errors(&error_messages, 0);
+	libgeneral_init_verbose(&verbosity_level, "verbose", 1);
+
+	atexit(&cleanups);
+
+	sigfillset(&segv_mask);
+	SET_SIGNAL(SIGSEGV, &segv_mask, 0);
+
+	SIGNAL_CATCHING();
+	CATCH_SIGNAL(SIGSEGV) {
+		error_out(ERROR_FATAL_SEGV, 0, FLN, GET_SIGINFO()->si_addr);
+	}
+
+	zone_init();
+	if(!(run.specs = spec_cache_create())) {
+		error_out(ERROR_ERROR_TZALLOC, 0, FLN,
+			  getenv("TZ") ? getenv("TZ") : "local");
+		return last_error_code;
+	}
+
+	int opt;
+	while((opt = getopt_long(argc, argv, "m:a:c:r:lpR0j:qnvfZh", long_opts, NULL)) != -1) {
+		switch(opt) {
+		case 'm':
+			if(setter_compile(&run, &cli->mtime, MTIME, optarg) < 0) {
 				error_out(ERROR_ERROR_INVTSP, 0, FLN, optarg);
 				return last_error_code;
 			}
-			cli.mtime.set = TRUE;
-			have_setters = TRUE;
 			break;
 		case 'a':
-			if(parse_timestamp_spec(optarg, &cli.atime.ts,
-						cli.parse_utc) < 0) {
+			if(setter_compile(&run, &cli->atime, ATIME, optarg) < 0) {
 				error_out(ERROR_ERROR_INVTSP, 0, FLN, optarg);
 				return last_error_code;
 			}
-			cli.atime.set = TRUE;
-			have_setters = TRUE;
 			break;
 		case 'c':
-			if(parse_timestamp_spec(optarg, &cli.ctime.ts,
-						cli.parse_utc) < 0) {
+			if(setter_compile(&run, &cli->ctime, CTIME, optarg) < 0) {
 				error_out(ERROR_ERROR_INVTSP, 0, FLN, optarg);
 				return last_error_code;
 			}
-			cli.ctime.set = TRUE;
-			have_setters = TRUE;
 			break;
 		case 'r':
-			cli.copy_from = optarg;
-			have_setters = TRUE;
+			cli->copy_from = optarg;
+			run.have_setters = TRUE;
 			break;
 		case 'l':
 			SETF(SYMLINKS);
 			break;
 		case 'p':
-			preserve_ctime_requested = TRUE;
+			cli->preserve_ctime = TRUE;
+			break;
+		case 'R':
+			cli->recursive = TRUE;
+			break;
+		case '0':
+			cli->list_delim = '\0';
+			break;
+		case 1002: /* --files-from */
+			cli->files_from = optarg;
+			break;
+		case 'j':
+			if(!isnum(optarg) || (cli->jobs = atoi(optarg)) < 1) {
+				error_out(ERROR_ERROR_INVJOBS, 0, FLN, optarg);
+				return last_error_code;
+			}
+			break;
+		case 1003: /* --stats */
+			if((cli->stats = stats_kind(optarg)) < 0) {
+				error_out(ERROR_ERROR_STATS, 0, FLN, optarg);
+				return last_error_code;
+			}
+			break;
+		case 1004: /* --save */
+			cli->save = optarg;
+			break;
+		case 1005: /* --restore */
+			cli->restore = optarg;
+			run.have_setters = TRUE;
+			break;
+		case 1006: /* --diff */
+			cli->diff = TRUE;
+			break;
+		case 1007: /* --manifest */
+			cli->manifest = optarg;
+			run.have_setters = TRUE;
+			break;
+		case 1008: /* --format */
+			cli->format = optarg;
+			break;
+		case 1009: /* --output */
+			if((run.output = output_kind(optarg)) < 0) {
+				error_out(ERROR_ERROR_OUTPUT, 0, FLN, optarg);
+				return last_error_code;
+			}
+			cli->output = optarg;
+			break;
+		case 1010: /* --keep-going */
+			cli->keep_going = TRUE;
+			break;
+		case 1011: /* --retry-list */
+			cli->retry_list = optarg;
+			cli->keep_going = TRUE;
+			break;
+		case 1012: /* --journal */
+			cli->journal = optarg;
+			break;
+		case 1013: /* --trace */
+			cli->trace = optarg;
 			break;
 		case 'f':
 			SETF(FORCE);
@@ -496,10 +2283,10 @@ main(int argc, char **argv)
 			usage(0);
 			break;
 		case 'n': /* -n, --dry-run */
-			cli.dry_run = TRUE;
+			cli->dry_run = TRUE;
 			break;
 		case 'Z':
-			cli.parse_utc = TRUE;
+			cli->parse_utc = TRUE;
 			break;
 		case 1001: /* --version */
 			info();
@@ -515,164 +2302,333 @@ main(int argc, char **argv)
 	if(verbosity_level() && CHKF(FORCE))
 		error_out(ERROR_WARNING_FORCVAL, 0, FLN);
 
-	if(optind >= argc) {
+	/* Snapshots and manifests name their files themselves */
+	const char *listopt = cli->restore ? "--restore" :
+		cli->manifest ? "--manifest" : NULL;
+
+	if(cli->restore && cli->manifest) {
+		error_out(ERROR_ERROR_OPTCOMB, 0, FLN, "--manifest", "`--restore'");
+		return last_error_code;
+	}
+	if(listopt) {
+		if(optind < argc || cli->files_from) {
+			error_out(ERROR_ERROR_OPTCOMB, 0, FLN, listopt, "FILE arguments");
+			return last_error_code;
+		}
+		if(cli->copy_from) {
+			error_out(ERROR_ERROR_OPTCOMB, 0, FLN, listopt, "`--copy'");
+			return last_error_code;
+		}
+	} else if(optind >= argc && !cli->files_from) {
 		fprintf(stderr, PROGRAM": please specify at least one FILE\n\n");
 		usage(1);
 	}
 
-	if(preserve_ctime_requested && (cli.copy_from || cli.ctime.set)) {
+	/* Comparing trees only reads them */
+	if(cli->diff) {
+		if(argc - optind != 2) {
+			fprintf(stderr, PROGRAM": --diff needs exactly two FILEs\n\n");
+			usage(1);
+		}
+		if(run.have_setters || cli->save || cli->files_from || cli->format ||
+		   cli->output || cli->retry_list || cli->journal || cli->trace) {
+			error_out(ERROR_ERROR_OPTCOMB, 0, FLN, "--diff",
+				  "setters, `--save', `--files-from', `--format', "
+				  "`--output', `--retry-list', `--journal' or `--trace'");
+			return last_error_code;
+		}
+		int rc = process_diff(argv[optind], argv[optind+1]);
+		return rc < 0 ? last_error_code : rc;
+	}
+
+	if(cli->format && cli->output) {
+		error_out(ERROR_ERROR_OPTCOMB, 0, FLN, "--format", "`--output'");
+		return last_error_code;
+	}
+
+	/* Only now is it known how records are to end */
+	if(cli->format &&
+	   !(run.format = format_compile(cli->format, cli->list_delim))) {
+		error_out(ERROR_ERROR_FORMAT, 0, FLN, cli->format);
+		return last_error_code;
+	}
+
+	/* Files only checked or recorded are not done */
+	if(cli->journal && (cli->dry_run || cli->save)) {
+		error_out(ERROR_ERROR_OPTCOMB, 0, FLN, "--journal",
+			  cli->dry_run ? "`--dry-run'" : "`--save'");
+		return last_error_code;
+	}
+
+	if(cli->save && run.have_setters) {
+		error_out(ERROR_ERROR_OPTCOMB, 0, FLN, "--save",
+			  cli->restore ? "`--restore'" :
+			  cli->manifest ? "`--manifest'" : "setters");
+		return last_error_code;
+	}
+
+	/* Expressions may only refer to a reference file if there is one */
+	struct timestamp_param *setters[] = {&cli->mtime, &cli->atime, &cli->ctime};
+
+	for(int i = 0; i < TIME_TBLS; i++) {
+		if(setters[i]->expr && (expr_flags(setters[i]->expr) & EXPR_REF) &&
+		   !cli->copy_from) {
+			error_out(ERROR_ERROR_EXPREF, 0, FLN, setters[i]->src);
+			return last_error_code;
+		}
+	}
+
+	if(cli->preserve_ctime && (cli->copy_from || cli->ctime.set)) {
 		error_out(ERROR_ERROR_CTPRES, 0, FLN);
 		return last_error_code;
 	}
 
-	GENERAL_BOOL have_ctime_priv = have_ctime_privileges();
-	GENERAL_BOOL warn_ctime_pending = FALSE;
-	GENERAL_BOOL ctime_warning_emitted = FALSE;
+	run.have_ctime_priv = have_ctime_privileges();
+	pthread_mutex_init(&run.gran_lock, NULL);
 
-	if(cli.ctime.set && !have_ctime_priv) {
+	if(cli->ctime.set && !run.have_ctime_priv) {
 		error_out(ERROR_ERROR_CTPRIV, 0, FLN, "--ctime");
 		return last_error_code;
 	}
 
-	if(preserve_ctime_requested && !have_ctime_priv) {
+	if(cli->preserve_ctime && !run.have_ctime_priv) {
 		error_out(ERROR_ERROR_CTPRIV, 0, FLN, "--preserve-ctime");
 		return last_error_code;
 	}
 
-	if(cli.copy_from) {
-		if(scan(cli.copy_from) < 0)
+	/* A snapshot is restored the way it was taken */
+	struct snapshot_reader *snap = NULL;
+
+	if(cli->restore) {
+		char count[32];
+
+		if(!(snap = snapshot_open(cli->restore)))
 			return last_error_code;
-		memcpy(copy_template, time_vals, sizeof(copy_template));
-		have_copy_template = TRUE;
-		if(!have_ctime_priv)
-			warn_ctime_pending = TRUE;
+		if(snapshot_symlinks(snap))
+			SETF(SYMLINKS);
+		else
+			REMF(SYMLINKS);
+		snprintf(count, sizeof count, "%lu", snapshot_count(snap));
+		verbose(1, "Restoring %s file(s) from \"%s\"", count, cli->restore);
+		if(!run.have_ctime_priv)
+			run.warn_ctime_pending = TRUE;
 	}
 
-	for(int idx = optind; idx < argc; ++idx) {
-		const char *file = argv[idx];
-		GENERAL_BOOL exists;
+	if(cli->save)
+		run.snapshot = snapshot_create(cli->save, CHKF(SYMLINKS));
 
-		if(CHKF(SYMLINKS)) {
-			if(laccess(file, F_OK) < 0 && access(file, F_OK) < 0)
-				exists = FALSE;
-			else
-				exists = TRUE;
-		} else {
-			exists = (access(file, F_OK) == 0);
-		}
-
-		if(exists)
-			REMF(NEXIST);
-		else
-			SETF(NEXIST);
+	if(cli->copy_from) {
+		struct file_probe probe;
+		struct file_ctx ref;
 
-		REMF(CTAPPLY);
+		file_ctx_init(&ref);
+		probe_lookup(&probe, AT_FDCWD, cli->copy_from);
+		ref.probe = &probe;
+		if(scan(&ref, cli->copy_from, cli->copy_from) < 0)
+			return last_error_code;
+		memcpy(run.copy_template, ref.times, sizeof(run.copy_template));
+		run.have_copy_template = TRUE;
+		if(!run.have_ctime_priv)
+			run.warn_ctime_pending = TRUE;
+	}
 
-		if(!have_setters) {
-			if(exists && scan(file) < 0)
-				return last_error_code;
-			if(!CHKF(QUIET))
-				times_info(file);
-			continue;
-		}
+	/*
+	 * Inspecting only needs lookups, which a single thread can keep
+	 * in flight by the hundreds through io_uring; `-j' is left to
+	 * kernels without it.
+	 */
+	if(!run.have_setters && (run.batch = probe_batch_create()))
+		verbose(1, "Looking up files through io_uring");
+	else if(cli->jobs > 1)
+		run.pool = pool_create(cli->jobs, &process_task, &run);
+
+	if(cli->keep_going)
+		run.failed = failure_log_create();
+
+	/*
+	 * The order of a walk may change from one run to the next. A
+	 * resumed run has to give files the same times as the one
+	 * interrupted, hence everything deciding them is recorded.
+	 */
+	if(cli->journal) {
+		char manifest_id[64], restore_id[64];
+		const char *settings[] = {
+			cli->mtime.set ? cli->mtime.src : NULL,
+			cli->atime.set ? cli->atime.src : NULL,
+			cli->ctime.set ? cli->ctime.src : NULL,
+			cli->copy_from,
+			cli->restore,
+			input_identity(cli->restore, restore_id, sizeof restore_id),
+			cli->manifest,
+			input_identity(cli->manifest, manifest_id, sizeof manifest_id),
+			CHKF(SYMLINKS) ? "symlinks" : NULL,
+			cli->preserve_ctime ? "preserve-ctime" : NULL,
+			cli->parse_utc ? "utc" : NULL,
+		};
+
+		if(!(run.journal = journal_open(cli->journal, !cli->recursive,
+						settings, sizeof settings / sizeof *settings)))
+			return last_error_code;
+		if(journal_resumed(run.journal)) {
+			char done[32];
 
-		if(have_copy_template) {
-			memcpy(time_vals, copy_template, sizeof(copy_template));
-			if(have_ctime_priv) {
-				SETF(CTAPPLY);
-			} else {
-				REMF(CTAPPLY);
-				warn_ctime_pending = TRUE;
-			}
-		} else if(!exists) {
-			if(scan(NULL) < 0)
-				return last_error_code;
-		} else {
-			if(scan(file) < 0)
-				return last_error_code;
+			snprintf(done, sizeof done, "%lu", journal_resumed(run.journal));
+			verbose(1, "Resuming after %s file(s) journaled as done",
+				done);
 		}
+	}
 
-		if(cli.mtime.set) {
-			if(assign_timespec(time_vals, MTIME, &cli.mtime.ts) < 0) {
-				error_out(ERROR_ERROR_GMTIM, errno, FLN, file);
-				return last_error_code;
-			}
-		}
+	if(run.have_setters && !cli->dry_run)
+		run.steps = clockstep_create(&ctime_done, &run);
 
-		if(cli.atime.set) {
-			if(assign_timespec(time_vals, ATIME, &cli.atime.ts) < 0) {
-				error_out(ERROR_ERROR_GMTIM, errno, FLN, file);
-				return last_error_code;
-			}
-		}
+	if(run.format || run.output)
+		run.out = writer_open(STDOUT_FILENO);
+	if(run.output && !CHKF(QUIET))
+		output_begin(run.output, run.out);
 
-		if(cli.ctime.set) {
-			if(assign_timespec(time_vals, CTIME, &cli.ctime.ts) < 0) {
-				error_out(ERROR_ERROR_GMTIM, errno, FLN, file);
-				return last_error_code;
-			}
-			SETF(CTAPPLY);
-		}
+	long long started = 0;
 
-		GENERAL_BOOL run_preserve =
-			preserve_ctime_requested &&
-			(cli.mtime.set || cli.atime.set);
+	if(cli->stats) {
+		stats_on = TRUE;
+		started = stats_clock();
+	}
+	if(cli->trace && trace_open(cli->trace) < 0)
+		return last_error_code;
 
-		if(run_preserve)
-			SETF(CTPRES);
-		else
-			REMF(CTPRES);
+	int rc = 0;
+	for(int idx = optind; idx < argc && !rc; ++idx)
+		rc = process_arg(&run, argv[idx]);
 
-		if(validate_times(time_vals) < 0)
-			return last_error_code;
+	if(!rc && cli->files_from)
+		rc = process_list(&run, cli->files_from);
 
-		GENERAL_BOOL need_ctime = CHKF(CTAPPLY) || CHKF(CTPRES);
+	if(snap) {
+		if(!rc)
+			rc = process_snapshot(&run, snap);
+		snapshot_close(snap);
+	}
 
-		if(cli.dry_run) {
-			if(check_dry_run_permissions(file, exists, need_ctime, CHKF(NEXIST)) < 0)
-				return last_error_code;
-		} else {
-			if(CHKF(NEXIST)) {
-				if((fd = open(file, O_CREAT | O_WRONLY | O_TRUNC,
-					      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
-					error_out(ERROR_ERROR_FCREATE, errno, FLN, file);
-					return last_error_code;
-				}
-				close(fd);
-				REMF(NEXIST);
-				verbose(1, "File created: \"%s\"", IFF(realname(file), "-"));
-				exists = TRUE;
-			}
+	if(!rc && cli->manifest)
+		rc = process_manifest(&run, cli->manifest);
 
-			if(apply(file) < 0)
-				return last_error_code;
+	if(run.batch) {
+		if(!rc && probe_batch_flush(&run) < 0)
+			rc = -1;
+		probe_batch_destroy(run.batch);
+	}
 
-			if(scan(file) < 0)
-				return last_error_code;
+	if(run.pool && pool_finish(run.pool) < 0)
+		rc = -1;
+
+	/*
+	 * The reports of files whose change time was queued are only
+	 * written now, so the output is closed after this
+	 */
+	unsigned long steps = 0;
+	struct timespec away = {0, 0};
+
+	if(run.steps) {
+		fileop_lock(TRUE);
+		if(clockstep_flush(run.steps) < 0)
+			rc = -1;
+		fileop_unlock();
+
+		clockstep_report(run.steps, &steps, &away);
+		if(steps) {
+			char nsteps[32], secs[32];
+
+			snprintf(nsteps, sizeof nsteps, "%lu", steps);
+			snprintf(secs, sizeof secs, "%ld.%06ld", (long)away.tv_sec,
+				 away.tv_nsec / 1000);
+			verbose(1, "System clock stepped %s time(s), away for %s s "
+				"in total", nsteps, secs);
 		}
+		clockstep_destroy(run.steps);
+	}
+
+	if(writer_close(run.out) < 0) {
+		error_out(ERROR_ERROR_WRITE, errno, FLN);
+		rc = -1;
+	}
+	format_free(run.format);
+
+	/* An incomplete snapshot is not written */
+	if(run.failed && failure_log_count(run.failed))
+		rc = -1;
+	if(run.snapshot) {
+		if(!rc && snapshot_write(run.snapshot) < 0)
+			rc = -1;
+		snapshot_free(run.snapshot);
+	}
 
-		if(warn_ctime_pending && !ctime_warning_emitted) {
-			error_out(ERROR_WARNING_CTCOPY, 0, FLN);
-			ctime_warning_emitted = TRUE;
+	/* Closed only now that every queued change time is set */
+	if(run.journal) {
+		if(journal_close(run.journal) < 0)
+			rc = -1;
+		if(run.resumed) {
+			char resumed[32];
+
+			snprintf(resumed, sizeof resumed, "%lu", run.resumed);
+			verbose(1, "%s file(s) skipped as done before", resumed);
 		}
+	}
 
-		if(!cli.dry_run && CHKF(QUIET))
-			continue;
-		if(cli.dry_run && CHKF(QUIET))
-			continue;
+	/* Every thread that recorded events is done by now */
+	if(trace_close() < 0)
+		rc = -1;
+
+	if(run.have_setters) {
+		char written[32], unchanged[32];
+
+		snprintf(written, sizeof written, "%lu", run.written);
+		snprintf(unchanged, sizeof unchanged, "%lu", run.unchanged);
+		verbose(1, "%s file(s) %s, %s already up to date", written,
+			cli->dry_run ? "to be modified" : "modified", unchanged);
+	}
 
-		GENERAL_BOOL cleared = FALSE;
-		if(cli.dry_run && CHKF(NEXIST)) {
-			REMF(NEXIST);
-			cleared = TRUE;
+	/*
+	 * Failed files are summed up by kind; they can be processed
+	 * again from the retry list alone.
+	 */
+	if(run.failed) {
+		if(failure_log_count(run.failed)) {
+			if(!CHKF(QUIET)) {
+				libgeneral_lock();
+				fflush(stdout);
+				failure_log_summary(run.failed, stderr);
+				libgeneral_unlock();
+			}
+			rc = -1;
 		}
+		if(cli->retry_list &&
+		   failure_log_write(run.failed, cli->retry_list) < 0) {
+			error_out(ERROR_ERROR_RETRYWR, errno, FLN, cli->retry_list);
+			rc = -1;
+		}
+		failure_log_destroy(run.failed);
+	}
 
-		times_info(file);
-		warn_ctime_pending = FALSE;
+	spec_cache_destroy(run.specs);
+	expr_free(cli->mtime.expr);
+	expr_free(cli->atime.expr);
+	expr_free(cli->ctime.expr);
 
-		if(cleared)
-			SETF(NEXIST);
+	if(cli->stats) {
+		struct stats_totals totals;
+
+		totals.files = run.files;
+		totals.syscalls = syscall_count;
+		totals.elapsed = stats_clock() - started;
+		totals.steps = steps;
+		totals.away = away;
+
+		libgeneral_lock();
+		stats_print(cli->stats, stderr, &totals);
+		libgeneral_unlock();
 	}
 
+	if(rc < 0)
+		return last_error_code;
+
 	return 0;
 }
@@ -41,6 +41,8 @@
 
 #include <libgeneral/general.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <limits.h>
 #include <utime.h>
 
 #ifdef STDC_HEADERS
@@ -74,45 +76,75 @@ enum {
 	VERBOSE = _FLAG(1),
 	SYMLINKS= _FLAG(2),
 	QUIET   = _FLAG(3),
-	NEXIST  = _FLAG(4),
-	CTPRES  = _FLAG(5),
-	CTAPPLY = _FLAG(6),
 };
 
-/* Time table values */
-#define TIME_TBLS 3
-#define TIME_VALS 8
+/* Per-file flags; kept in struct file_ctx */
+enum {
+	NEXIST  = _FLAG(0),
+	CTPRES  = _FLAG(1),
+	CTAPPLY = _FLAG(2),
+	UTSAME  = _FLAG(3),
+	FDPATH  = _FLAG(4),
+	DEFER   = _FLAG(5),	/* caller prints the report; see REPORT */
+	REPORT  = _FLAG(6),	/* report due, held back by DEFER */
+	CTQUEUED= _FLAG(7),	/* ctime queued; journaled once set */
+};
 
-/* One specific date or time component */
-typedef struct {
+/* Number of time stamps of a file: mtime, atime, ctime */
+#define TIME_TBLS 3
 
-	int val;
-	const char *name;
-	
-} FILE_TIME;
+/* Bit of one of them in a set of clocks */
+#define TIME_BIT(CLOCK) (1u << (CLOCK))
 
-/* Time table */
-typedef FILE_TIME (*FILE_TIMES)[TIME_VALS];
+/*
+ * Range of time stamps accepted by validate_times(): from
+ * 1900-01-01 00:00:00 to 2100-12-31 23:59:59 UTC
+ */
+#define TIME_MIN (-2208988800LL)
+#define TIME_MAX 4133980799LL
 
-/* Time value boundaries; as used for validation by validate() */
-struct val_bounds {
+/*
+ * Stepping the clock cannot place a change time any closer than
+ * this many nanoseconds (see clockstep.c).
+ */
+#define CTIME_SLACK 10000000LL
 
-	int lower;
-	int upper;
+/*
+ * Everything looked up about a file before processing it; every
+ * later stage reads from here instead of asking the kernel again
+ * (see probe_lookup()). st follows a symbolic link, lst describes
+ * the link itself; err and lerr hold the errno of the respective
+ * lookup, or 0 if it succeeded. link is the target of a symbolic
+ * link and empty for anything else.
+ */
+struct file_probe {
+	struct stat st;
+	struct stat lst;
+	int err;
+	int lerr;
+	char link[PATH_MAX];
 };
 
-/* Value validation array */
-typedef struct val_bounds VALUE_BOUNDS[];
-
 /*
- * Symbolic names for time_vals array indices
+ * Everything stroke knows about the file currently processed.
+ * Each file gets its own context so that several files can be
+ * worked on at the same time (see `-j').
  */
-enum {
-	MTIME = 0, ATIME, CTIME
+struct file_ctx {
+	struct timespec times[TIME_TBLS];
+	dev_t dev;
+	mode_t mode;
+	_FLAG_TYPE flags;
+	int fd;				/* open file, -1 if none; see FDPATH */
+	struct file_probe *probe;	/* what was looked up about the file */
+	unsigned long long pos;		/* input position; see `--journal' */
 };
 
+/*
+ * Symbolic names for times array indices
+ */
 enum {
-	YEAR = 0, MON, DAY, HOUR, MIN, SEC, DST, WKD
+	MTIME = 0, ATIME, CTIME
 };
 
 /*
@@ -121,32 +153,32 @@ enum {
 
 /* Date conversion and date formatting macros */
 #define YEAR_BASE 1900
-#define CURR_CENT 20
 #define MON_BASE 1
 #define DST_BASE 1
 #define DATE_FORMAT \
 	"%04d-%02d-%02d %02d:%02d:%02d %s (%cdst)",\
-	D(YEAR), D(MON), D(DAY),\
-	D(HOUR), D(MIN), D(SEC),\
-	W(D(WKD)), L(D(DST))
+	tm.tm_year + YEAR_BASE, tm.tm_mon + MON_BASE, tm.tm_mday,\
+	tm.tm_hour, tm.tm_min, tm.tm_sec,\
+	W(tm.tm_wday), L(tm.tm_isdst + DST_BASE)
 
-/* Macros for translate() and laccess() */
-#define TO_TM 0
-#define TO_FT 1
+/* Result of a link check; see ctx_laccess() */
 #define LDANGLING 1
 
+/* Count system call CALL for `--stats' and evaluate to its result */
+#define SC(CALL) (__atomic_add_fetch(&syscall_count, 1, __ATOMIC_RELAXED), (CALL))
+
 /* Flags */
 #define SETF(FLAG) flags |= (FLAG)
 #define REMF(FLAG) flags &= ~(FLAG)
 #define CHKF(FLAG) (flags & (FLAG))
 
-/*FILE_TIMES initializer */
-#define WD T(0)
-#define T(NAM) {0, NAM}
+/* Per-file flags */
+#define SETFF(CTX, FLAG) ((CTX)->flags |= (FLAG))
+#define REMFF(CTX, FLAG) ((CTX)->flags &= ~(FLAG))
+#define CHKFF(CTX, FLAG) ((CTX)->flags & (FLAG))
 
 /* Date format */
 #define W(OFF) *(wdays+OFF)
-#define D(OFF) (time_vals[t]+OFF)->val
 #define L(DST) (DST ? (DST == 1 ? '-' : '+') : '?')
 
 /*
@@ -158,19 +190,29 @@ extern _FLAG_TYPE flags;
 
 /* mtime, atime, ctime  */
 extern const char *names[];
+extern const char *wdays[];
+
+/* System calls made on behalf of files */
+extern unsigned long syscall_count;
+
+struct zone_batch;
 
 /*
  * Function declarations
  */
-extern void translate(struct tm *tm, FILE_TIMES, int mactime, GENERAL_BOOL to_file_time);
-extern inline GENERAL_BOOL validate(const char *name, int val);
-extern int validate_times(FILE_TIMES);
-extern char* tv_to_str(FILE_TIMES, int t);
-extern int ft_to_utimbuf(FILE_TIMES, struct utimbuf *);
-extern int lutime_symlink(const char *filename, const struct utimbuf *times);
-extern int laccess(const char *pathname, int mode);
-extern const char* realname(const char *file);
-extern int mod_ctime(FILE_TIMES, const char *file);
+extern GENERAL_BOOL isnum(const char *str);
+extern int validate_times(const struct timespec *times);
+extern char* ts_to_str(const struct timespec *ts, char *buf, size_t len);
+extern char* zone_batch_str(const struct zone_batch *b, size_t i, char *buf,
+			    size_t len);
+extern void probe_resolve(struct file_probe *, int dirfd, const char *name);
+extern void probe_lookup(struct file_probe *, int dirfd, const char *name);
+extern void probe_open(struct file_probe *, int dirfd, const char *name,
+		       GENERAL_BOOL nofollow, int *fd);
+extern void file_ctx_init(struct file_ctx *);
+extern void file_ctx_release(struct file_ctx *);
+extern void fileop_lock(GENERAL_BOOL exclusive);
+extern void fileop_unlock(void);
 
 /*
  * Debugging
@@ -178,7 +220,7 @@ extern int mod_ctime(FILE_TIMES, const char *file);
 extern inline int verbosity_level();
 
 #ifdef DEBUG
-extern inline void dump_tv(FILE_TIME (*)[]);
+extern inline void dump_tv(const struct timespec *);
 #endif
 
 #endif /* STROKE_H */
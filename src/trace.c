@@ -0,0 +1,394 @@
+/*
+ *      trace.c - Per-file event tracing for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "trace.h"
+
+#include "stroke.h"
+#include "errors.h"
+#include "stats.h"
+#include "writer.h"
+#include "output.h"
+
+#include <libgeneral/error.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* Events and bytes of paths one buffer holds */
+#define TRACE_BUF_EVENTS 2048
+#define TRACE_BUF_TEXT (128 * 1024)
+
+/*
+ * Events are written in the Chrome trace event format, which
+ * Perfetto and chrome://tracing open directly: one complete ("X")
+ * event per span, with its start and duration in microseconds
+ * since the trace was opened. Each thread gets a track of its own,
+ * on which spans enclosed by others show nested below them.
+ *
+ * A thread records its events into a buffer of its own, without
+ * taking any lock. Only when the buffer is full is it handed to
+ * the writer thread, which formats and writes it out while the
+ * thread goes on with a buffer written out before. The threads
+ * doing the actual work thus never wait for the trace file.
+ */
+
+/* One span; path is an offset into the text of the buffer, or -1 */
+struct trace_event {
+	const char *name;
+	long long t0, t1;
+	long path;
+};
+
+struct trace_buf {
+	struct trace_buf *next;
+	unsigned tid;
+	size_t count;
+	size_t used;
+	struct trace_event events[TRACE_BUF_EVENTS];
+	char text[TRACE_BUF_TEXT];
+};
+
+/* A thread that recorded events */
+struct trace_thread {
+	struct trace_thread *next;
+	unsigned tid;
+	struct trace_buf *buf;
+};
+
+struct trace {
+	int fd;
+	struct writer *out;
+	long long base;		/* stats_clock() when opened */
+	long pid;
+	char pidtid[48];	/* ,"pid":N,"tid": for every event */
+	size_t pidtidlen;
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct trace_buf *full, **full_tail;	/* to be written, oldest first */
+	struct trace_buf *spare;		/* written, for reuse */
+	struct trace_thread *threads;
+	unsigned last_tid;
+	GENERAL_BOOL closing;
+};
+
+GENERAL_BOOL trace_on;
+
+static struct trace trace;
+static __thread struct trace_thread *self;
+
+/*
+ * A buffer ready for events of thread tid; trace.lock must be held.
+ */
+static struct trace_buf*
+buf_get(unsigned tid)
+{
+	struct trace_buf *b;
+
+	if((b = trace.spare))
+		trace.spare = b->next;
+	else
+		b = general_malloc(sizeof *b);
+	b->next = NULL;
+	b->tid = tid;
+	b->count = b->used = 0;
+
+	return b;
+}
+
+/*
+ * Queue buffer b to be written; trace.lock must be held.
+ */
+static void
+buf_queue(struct trace_buf *b)
+{
+	*trace.full_tail = b;
+	trace.full_tail = &b->next;
+	pthread_cond_signal(&trace.cond);
+}
+
+/*
+ * The calling thread as known to the trace, set up along with a
+ * buffer on its first event.
+ */
+static struct trace_thread*
+thread_self(void)
+{
+	struct trace_thread *t;
+
+	if((t = self))
+		return t;
+
+	t = general_malloc(sizeof *t);
+	pthread_mutex_lock(&trace.lock);
+	t->tid = ++trace.last_tid;
+	t->buf = buf_get(t->tid);
+	t->next = trace.threads;
+	trace.threads = t;
+	pthread_mutex_unlock(&trace.lock);
+
+	return self = t;
+}
+
+/* Write string literal S to the trace */
+#define WRITE_LIT(S) writer_write(trace.out, (S), sizeof(S) - 1)
+
+/* Longest number put_dec() writes */
+#define DEC_MAX 24
+
+/*
+ * Write u in decimal to p, with a decimal point before the last
+ * point digits if point is not 0; snprintf() would take most of the
+ * writer's time.
+ * Returns the number of bytes written.
+ */
+static size_t
+put_dec(char *p, unsigned long long u, int point)
+{
+	char digits[DEC_MAX];
+	size_t len = 0;
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+		if(n == point)
+			digits[n++] = '.';
+	} while(u || (point && n <= point + 1));
+
+	while(n)
+		p[len++] = digits[--n];
+	return len;
+}
+
+/*
+ * Write ns nanoseconds, at least 0, as microseconds.
+ */
+static void
+write_us(long long ns)
+{
+	writer_commit(trace.out, put_dec(writer_reserve(trace.out, DEC_MAX),
+					 ns > 0 ? ns : 0, 3));
+}
+
+/*
+ * Write one event of b.
+ */
+static void
+event_write(const struct trace_buf *b, const struct trace_event *e)
+{
+	WRITE_LIT(",\n{\"name\":\"");
+	writer_write(trace.out, e->name, strlen(e->name));
+	if(e->path < 0)
+		WRITE_LIT("\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":");
+	else
+		WRITE_LIT("\",\"cat\":\"file\",\"ph\":\"X\",\"ts\":");
+	write_us(e->t0 - trace.base);
+	WRITE_LIT(",\"dur\":");
+	write_us(e->t1 - e->t0);
+	writer_write(trace.out, trace.pidtid, trace.pidtidlen);
+	writer_commit(trace.out, put_dec(writer_reserve(trace.out, DEC_MAX),
+					 b->tid, 0));
+
+	if(e->path >= 0) {
+		WRITE_LIT(",\"args\":{\"path\":");
+		json_string(trace.out, b->text + e->path);
+		WRITE_LIT("}");
+	}
+	WRITE_LIT("}");
+}
+
+/*
+ * Write out the buffers of trace data as they fill up, until it is
+ * closed and none are left.
+ */
+static void*
+writer_main(void *data)
+{
+	struct trace *t = data;
+	struct trace_buf *list, *b;
+	size_t i;
+
+	pthread_mutex_lock(&t->lock);
+	for(;;) {
+		while(!t->full && !t->closing)
+			pthread_cond_wait(&t->cond, &t->lock);
+		if(!(list = t->full))
+			break;
+		t->full = NULL;
+		t->full_tail = &t->full;
+		pthread_mutex_unlock(&t->lock);
+
+		for(b = list; b; b = b->next)
+			for(i = 0; i < b->count; i++)
+				event_write(b, &b->events[i]);
+
+		pthread_mutex_lock(&t->lock);
+		while((b = list)) {
+			list = b->next;
+			b->next = t->spare;
+			t->spare = b;
+		}
+	}
+	pthread_mutex_unlock(&t->lock);
+
+	return NULL;
+}
+
+/*
+ * Begin tracing into file, which is replaced. The calling thread
+ * is taken as the main one.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+trace_open(const char *file)
+{
+	static const char head[] =
+		"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,"
+		"\"args\":{\"name\":\"" PROGRAM "\"}}";
+	char line[sizeof head + 32];
+	int err;
+
+	if((trace.fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			    0666)) < 0) {
+		error_out(ERROR_ERROR_TRACE, errno, FLN, file);
+		return -1;
+	}
+	trace.out = writer_open(trace.fd);
+	trace.base = stats_clock();
+	trace.pid = (long)getpid();
+	trace.pidtidlen = snprintf(trace.pidtid, sizeof trace.pidtid,
+				   ",\"pid\":%ld,\"tid\":", trace.pid);
+	trace.full_tail = &trace.full;
+	pthread_mutex_init(&trace.lock, NULL);
+	pthread_cond_init(&trace.cond, NULL);
+
+	writer_write(trace.out, line,
+		     snprintf(line, sizeof line, head, trace.pid));
+
+	if((err = pthread_create(&trace.writer, NULL, &writer_main, &trace))) {
+		error_out(ERROR_ERROR_TRACE, err, FLN, file);
+		writer_close(trace.out);
+		close(trace.fd);
+		return -1;
+	}
+
+	trace_on = TRUE;
+	thread_self();
+
+	return 0;
+}
+
+/*
+ * Record a span of name, from t0 to t1, for the calling thread.
+ * name must remain valid until the trace is closed; path, if not
+ * NULL, is copied.
+ */
+void
+trace_span(const char *name, long long t0, long long t1, const char *path)
+{
+	struct trace_thread *t = thread_self();
+	struct trace_buf *b = t->buf;
+	struct trace_event *e;
+	size_t len = path ? strlen(path) + 1 : 0;
+
+	if(b->count == TRACE_BUF_EVENTS || len > TRACE_BUF_TEXT - b->used) {
+		pthread_mutex_lock(&trace.lock);
+		buf_queue(b);
+		b = t->buf = buf_get(t->tid);
+		pthread_mutex_unlock(&trace.lock);
+	}
+
+	e = &b->events[b->count++];
+	e->name = name;
+	e->t0 = t0;
+	e->t1 = t1;
+	e->path = -1;
+	if(len) {
+		if(len > TRACE_BUF_TEXT)
+			len = TRACE_BUF_TEXT;
+		memcpy(b->text + b->used, path, len - 1);
+		b->text[b->used + len - 1] = 0;
+		e->path = b->used;
+		b->used += len;
+	}
+}
+
+/*
+ * Stop tracing, write out the events of every thread and finish
+ * the trace file. No other thread may record events any more.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+trace_close(void)
+{
+	struct trace_thread *t;
+	struct trace_buf *b;
+	char line[128];
+	int rc = 0;
+
+	if(!trace_on)
+		return 0;
+	trace_on = FALSE;
+
+	pthread_mutex_lock(&trace.lock);
+	for(t = trace.threads; t; t = t->next)
+		buf_queue(t->buf);
+	trace.closing = TRUE;
+	pthread_cond_signal(&trace.cond);
+	pthread_mutex_unlock(&trace.lock);
+	pthread_join(trace.writer, NULL);
+
+	/* Threads are named last, once all of them are known */
+	while((t = trace.threads)) {
+		trace.threads = t->next;
+		writer_write(trace.out, line,
+			     snprintf(line, sizeof line, ",\n{\"name\":\"thread_name\","
+				      "\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,"
+				      "\"args\":{\"name\":\"%s %u\"}}", trace.pid,
+				      t->tid, t->tid == 1 ? "main" : "worker",
+				      t->tid));
+		free(t);
+	}
+	self = NULL;
+	writer_write(trace.out, "\n]}\n", 4);
+
+	if(writer_close(trace.out) < 0 || close(trace.fd) < 0) {
+		error_out(ERROR_ERROR_TRACE, errno, FLN, "-");
+		rc = -1;
+	}
+
+	while((b = trace.spare)) {
+		trace.spare = b->next;
+		free(b);
+	}
+	pthread_cond_destroy(&trace.cond);
+	pthread_mutex_destroy(&trace.lock);
+
+	return rc;
+}
@@ -0,0 +1,47 @@
+/*
+ *      trace.h - Per-file event tracing for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef STROKE_TRACE_H
+#define STROKE_TRACE_H 1
+
+#include <libgeneral/general.h>
+
+/* Set while events are traced */
+extern GENERAL_BOOL trace_on;
+
+/*
+ * Trace a span of work on path. TRACE_START() is 0 while tracing
+ * is off, and TRACE_END() then does nothing; times are those of
+ * stats_clock().
+ */
+#define TRACE_START() (trace_on ? stats_clock() : 0)
+#define TRACE_END(NAME, T0, PATH) \
+	do { if(T0) trace_span((NAME), (T0), stats_clock(), (PATH)); } while(0)
+
+/*
+ * Function declarations
+ */
+extern int trace_open(const char *file);
+extern void trace_span(const char *name, long long t0, long long t1,
+		       const char *path);
+extern int trace_close(void);
+
+#endif /* STROKE_TRACE_H */
@@ -0,0 +1,405 @@
+/*
+ *      uring.c - Batched file lookups through io_uring
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "stroke.h"
+#include "uring.h"
+
+#include <stdlib.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && HAVE_DECL_IORING_OP_STATX && \
+	HAVE_DECL___NR_IO_URING_SETUP
+# define USE_IO_URING 1
+#endif
+
+#ifdef USE_IO_URING
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+
+/*
+ * The ring is driven through the raw system calls so that no
+ * library beyond the kernel headers is needed. Lookups are only
+ * queued while no others are in flight: a batch is prepared with
+ * uring_queue_stat() and then handed to the kernel as a whole by
+ * uring_run(), which returns once every lookup has completed.
+ */
+
+/* Destination of one queued lookup */
+struct uring_op {
+	struct statx stx;
+	struct stat *st;
+	int *err;
+};
+
+struct uring {
+	int fd;
+	unsigned entries;
+
+	/* Submission queue */
+	void *sq_ring;
+	size_t sq_ring_sz;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_sz;
+
+	/* Completion queue */
+	void *cq_ring;
+	size_t cq_ring_sz;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* Lookups of the current batch */
+	struct uring_op *ops;
+	unsigned queued;
+
+	/* Set once io_uring_enter() has failed */
+	GENERAL_BOOL failed;
+	/* Lookups may still be in flight */
+	GENERAL_BOOL lost;
+};
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		   unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Check whether the kernel knows the statx operation; io_uring
+ * itself predates it.
+ */
+static GENERAL_BOOL
+statx_supported(int fd)
+{
+	struct io_uring_probe *probe;
+	size_t sz = sizeof *probe + 256 * sizeof probe->ops[0];
+	GENERAL_BOOL ok = FALSE;
+
+	probe = general_malloc(sz);
+	memset(probe, 0, sz);
+	if(sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+	   probe->last_op >= IORING_OP_STATX &&
+	   (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+		ok = TRUE;
+	free(probe);
+
+	return ok;
+}
+
+static void
+statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof *st);
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+/*
+ * Set up a ring able to hold entries lookups per batch.
+ * Returns NULL if io_uring is unavailable (old kernel, or
+ * disabled by seccomp or sysctl); callers should then fall
+ * back to plain system calls.
+ */
+struct uring*
+uring_open(unsigned entries)
+{
+	struct io_uring_params p;
+	struct uring *r;
+	void *ring;
+	int fd;
+
+	memset(&p, 0, sizeof p);
+	if((fd = sys_io_uring_setup(entries, &p)) < 0)
+		return NULL;
+
+	if(!statx_supported(fd)) {
+		close(fd);
+		return NULL;
+	}
+
+	r = general_malloc(sizeof *r);
+	memset(r, 0, sizeof *r);
+	r->fd = fd;
+	r->entries = p.sq_entries;
+
+	r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(r->cq_ring_sz > r->sq_ring_sz)
+			r->sq_ring_sz = r->cq_ring_sz;
+		r->cq_ring_sz = r->sq_ring_sz;
+	}
+
+	ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(ring == MAP_FAILED)
+		goto fail;
+	r->sq_ring = ring;
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ring = r->sq_ring;
+	} else {
+		ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if(ring == MAP_FAILED)
+			goto fail;
+		r->cq_ring = ring;
+	}
+
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(ring == MAP_FAILED)
+		goto fail;
+	r->sqes = ring;
+
+	r->sq_tail = (unsigned*)((char*)r->sq_ring + p.sq_off.tail);
+	r->sq_mask = (unsigned*)((char*)r->sq_ring + p.sq_off.ring_mask);
+	r->sq_array = (unsigned*)((char*)r->sq_ring + p.sq_off.array);
+	r->cq_head = (unsigned*)((char*)r->cq_ring + p.cq_off.head);
+	r->cq_tail = (unsigned*)((char*)r->cq_ring + p.cq_off.tail);
+	r->cq_mask = (unsigned*)((char*)r->cq_ring + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)((char*)r->cq_ring + p.cq_off.cqes);
+
+	r->ops = general_malloc(r->entries * sizeof *r->ops);
+
+	return r;
+
+ fail:
+	uring_close(r);
+	return NULL;
+}
+
+/*
+ * Queue a lookup of file name, relative to dirfd. Once uring_run()
+ * has returned, st holds its attributes and err is 0, or err is the
+ * errno of the failed lookup. If follow is FALSE a symbolic link
+ * itself is looked up. All pointers must remain valid until then.
+ * Returns 0 on success, -1 if the batch is full.
+ */
+int
+uring_queue_stat(struct uring *r, int dirfd, const char *name,
+		 GENERAL_BOOL follow, struct stat *st, int *err)
+{
+	struct io_uring_sqe *sqe;
+	struct uring_op *op;
+	unsigned tail, idx;
+
+	if(r->failed || r->queued == r->entries)
+		return -1;
+
+	op = &r->ops[r->queued];
+	op->st = st;
+	op->err = err;
+
+	tail = *r->sq_tail + r->queued;
+	idx = tail & *r->sq_mask;
+	sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof *sqe);
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = dirfd;
+	sqe->addr = (unsigned long)name;
+	sqe->len = STATX_BASIC_STATS;
+	sqe->off = (unsigned long)&op->stx;
+	sqe->statx_flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+	sqe->user_data = r->queued;
+	r->sq_array[idx] = idx;
+
+	++r->queued;
+	return 0;
+}
+
+/*
+ * Consume the completions the kernel has posted so far and return
+ * how many there were. Their results are handed to the lookups
+ * they belong to only if keep is TRUE.
+ */
+static unsigned
+uring_reap(struct uring *r, GENERAL_BOOL keep)
+{
+	struct io_uring_cqe *cqe;
+	struct uring_op *op;
+	unsigned head, tail, n = 0;
+
+	head = *r->cq_head;
+	tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	for(; head != tail; ++head, ++n) {
+		if(!keep)
+			continue;
+		cqe = &r->cqes[head & *r->cq_mask];
+		op = &r->ops[cqe->user_data];
+		if(cqe->res < 0) {
+			*op->err = -cqe->res;
+		} else {
+			statx_to_stat(&op->stx, op->st);
+			*op->err = 0;
+		}
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/*
+ * Submit every queued lookup and wait for all of them to complete.
+ * Returns 0 on success, -1 if the ring failed; the results of the
+ * batch are then undefined and the lookups should be repeated by
+ * other means. A failed ring must not be used again other than to
+ * close it.
+ */
+int
+uring_run(struct uring *r)
+{
+	unsigned pending = r->queued, done = 0;
+	int n;
+
+	if(r->failed)
+		return -1;
+
+	__atomic_store_n(r->sq_tail, *r->sq_tail + r->queued, __ATOMIC_RELEASE);
+
+	while(done < r->queued) {
+		if((n = SC(sys_io_uring_enter(r->fd, pending, 1,
+					      IORING_ENTER_GETEVENTS))) < 0) {
+			if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			break;
+		}
+		pending -= (unsigned)n < pending ? (unsigned)n : pending;
+		done += uring_reap(r, TRUE);
+	}
+
+	if(done < r->queued) {
+		/*
+		 * Lookups already submitted still complete and write
+		 * into r->ops; wait for them so that none is left to be
+		 * mistaken for one of a later batch. Should the ring
+		 * not even allow that, it is given up as it is and its
+		 * buffers are never released.
+		 */
+		r->failed = TRUE;
+		while(done < r->queued - pending) {
+			if(SC(sys_io_uring_enter(r->fd, 0, 1,
+						 IORING_ENTER_GETEVENTS)) < 0 &&
+			   errno != EINTR) {
+				r->lost = TRUE;
+				break;
+			}
+			done += uring_reap(r, FALSE);
+		}
+		r->queued = 0;
+		return -1;
+	}
+
+	r->queued = 0;
+	return 0;
+}
+
+/*
+ * Tear down the ring.
+ */
+void
+uring_close(struct uring *r)
+{
+	if(!r)
+		return;
+	if(r->sqes)
+		munmap(r->sqes, r->sqes_sz);
+	if(r->cq_ring && r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+	if(r->sq_ring)
+		munmap(r->sq_ring, r->sq_ring_sz);
+	close(r->fd);
+	if(r->lost)
+		return;
+	free(r->ops);
+	free(r);
+}
+
+#else /* !USE_IO_URING */
+
+/*
+ * Without io_uring support no ring can be set up; callers fall
+ * back to plain system calls.
+ */
+struct uring*
+uring_open(unsigned entries)
+{
+	return NULL;
+}
+
+int
+uring_queue_stat(struct uring *r, int dirfd, const char *name,
+		 GENERAL_BOOL follow, struct stat *st, int *err)
+{
+	return -1;
+}
+
+int
+uring_run(struct uring *r)
+{
+	return -1;
+}
+
+void
+uring_close(struct uring *r)
+{
+}
+
+#endif /* USE_IO_URING */
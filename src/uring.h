@@ -0,0 +1,40 @@
+/*
+ *      uring.h - Batched file lookups through io_uring
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef STROKE_URING_H
+#define STROKE_URING_H 1
+
+#include <libgeneral/general.h>
+#include <sys/stat.h>
+
+/* Opaque ring state */
+struct uring;
+
+/*
+ * Function declarations
+ */
+extern struct uring* uring_open(unsigned entries);
+extern int uring_queue_stat(struct uring *r, int dirfd, const char *name,
+			    GENERAL_BOOL follow, struct stat *st, int *err);
+extern int uring_run(struct uring *r);
+extern void uring_close(struct uring *r);
+
+#endif /* STROKE_URING_H */
@@ -0,0 +1,425 @@
+/*
+ *      walk.c - Directory tree traversal for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "walk.h"
+
+#include "stroke.h"
+#include "errors.h"
+#include "stats.h"
+
+#include <libgeneral/error.h>
+#include <libgeneral/arena.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Arena chunk size for the names of sorted walks */
+#define WALK_NAMES_CHUNK (64 * 1024)
+
+/* One entry of a directory read ahead */
+struct walk_name {
+	char *name;
+	unsigned char type;
+};
+
+/*
+ * A directory currently being read. Every level of the tree
+ * below the root holds exactly one open descriptor, and every
+ * lookup is made relative to it; full paths are only kept
+ * around for display.
+ */
+struct walk_frame {
+	DIR *dir;
+	int fd;
+
+	/* Entries read ahead and sorted, for sorted walks only */
+	struct walk_name *names;
+	size_t nnames;
+	size_t next;
+	ARENA_MARK mark;     /* Start of the names in the walk's arena */
+	GENERAL_BOOL failed; /* Reading failed; taken as the end */
+
+	size_t pathlen;
+	size_t nameoff;
+	unsigned long id;
+	dev_t dev;
+	ino_t ino;
+};
+
+struct walk {
+	const char *root;
+	GENERAL_BOOL follow_root;
+	GENERAL_BOOL sorted;
+	GENERAL_BOOL started;
+	GENERAL_BOOL done;
+
+	/* Display path of the current entry */
+	char *path;
+	size_t pathsz;
+
+	/* Open directories, root first */
+	struct walk_frame *stack;
+	size_t depth;
+	size_t stacksz;
+	unsigned long last_id;
+
+	/*
+	 * Names read ahead by sorted walks. Frames are closed in the
+	 * reverse order they were opened, so each one gives back its
+	 * names by releasing the arena to where it started.
+	 */
+	ARENA *names;
+};
+
+/*
+ * Make sure the path buffer can hold len bytes.
+ */
+static void
+path_reserve(struct walk *w, size_t len)
+{
+	if(len <= w->pathsz)
+		return;
+	while(w->pathsz < len)
+		w->pathsz = w->pathsz ? w->pathsz << 1 : 256;
+	w->path = general_realloc(w->path, w->pathsz);
+}
+
+/*
+ * Append name to the directory path of length dirlen.
+ * Returns the offset of name within the path buffer.
+ */
+static size_t
+path_append(struct walk *w, size_t dirlen, const char *name)
+{
+	size_t nlen = strlen(name);
+	size_t off = dirlen;
+
+	path_reserve(w, dirlen + nlen + 2);
+	if(dirlen && w->path[dirlen-1] != '/')
+		w->path[off++] = '/';
+	memcpy(w->path + off, name, nlen + 1);
+	return off;
+}
+
+static int
+name_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct walk_name*)a)->name,
+		      ((const struct walk_name*)b)->name);
+}
+
+/*
+ * Read all entries of the directory of f and sort them by name.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+frame_read_sorted(struct walk *w, struct walk_frame *f)
+{
+	struct dirent *d;
+	size_t size = 0;
+
+	for(;;) {
+		errno = 0;
+		if(!(d = readdir(f->dir)))
+			break;
+		if(d->d_name[0] == '.' &&
+		   (!d->d_name[1] || (d->d_name[1] == '.' && !d->d_name[2])))
+			continue;
+		if(f->nnames == size) {
+			size = size ? size << 1 : 64;
+			f->names = general_realloc(f->names, size * sizeof *f->names);
+		}
+		f->names[f->nnames].name = arena_str(w->names, d->d_name);
+		f->names[f->nnames].type = d->d_type;
+		++f->nnames;
+	}
+	if(errno) {
+		error_out(ERROR_ERROR_OPENDIR, errno, FLN, w->path);
+		return -1;
+	}
+
+	qsort(f->names, f->nnames, sizeof *f->names, &name_cmp);
+	return 0;
+}
+
+/*
+ * Release the directory of f.
+ */
+static void
+frame_close(struct walk *w, struct walk_frame *f)
+{
+	closedir(f->dir);
+	if(w->names)
+		arena_release(w->names, f->mark);
+	free(f->names);
+}
+
+/*
+ * Fetch the next entry of the directory of f, skipping `.' and
+ * `..'. name remains valid until the frame is closed or, in an
+ * unsorted walk, read again.
+ * Returns 1 if an entry was found, 0 at the end, -1 on failure.
+ */
+static int
+frame_next(struct walk *w, struct walk_frame *f, const char **name,
+	   unsigned char *type)
+{
+	struct dirent *d;
+
+	if(f->failed)
+		return 0;
+
+	if(w->sorted) {
+		if(f->next == f->nnames)
+			return 0;
+		*name = f->names[f->next].name;
+		*type = f->names[f->next].type;
+		++f->next;
+		return 1;
+	}
+
+	do {
+		errno = 0;
+		if(!(d = readdir(f->dir))) {
+			if(errno) {
+				f->failed = TRUE;
+				error_out(ERROR_ERROR_OPENDIR, errno, FLN, w->path);
+				return -1;
+			}
+			return 0;
+		}
+	} while(d->d_name[0] == '.' &&
+		(!d->d_name[1] || (d->d_name[1] == '.' && !d->d_name[2])));
+
+	*name = d->d_name;
+	*type = d->d_type;
+	return 1;
+}
+
+/*
+ * Open directory name relative to dirfd and push it onto the
+ * traversal stack. Symbolic links are never descended into
+ * (O_NOFOLLOW), and a directory already present among the
+ * ancestors is skipped; the latter can only happen through
+ * bind mounts but would otherwise loop forever.
+ * Returns 1 if pushed, 0 if skipped, -1 on failure.
+ */
+static int
+walk_push(struct walk *w, int dirfd, const char *name, size_t nameoff, int oflags)
+{
+	struct walk_frame *f;
+	struct stat st;
+	long long t0 = TRACE_START();
+	size_t i;
+	int fd;
+
+	if((fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | oflags)) < 0 ||
+	   fstat(fd, &st) < 0) {
+		error_out(ERROR_ERROR_OPENDIR, errno, FLN, w->path);
+		if(fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	for(i = 0; i < w->depth; i++) {
+		if(w->stack[i].dev == st.st_dev && w->stack[i].ino == st.st_ino) {
+			error_out(ERROR_WARNING_FSLOOP, 0, FLN, w->path);
+			close(fd);
+			return 0;
+		}
+	}
+
+	if(w->depth == w->stacksz) {
+		w->stacksz = w->stacksz ? w->stacksz << 1 : 16;
+		w->stack = general_realloc(w->stack, w->stacksz * sizeof *w->stack);
+	}
+
+	f = &w->stack[w->depth];
+	if(!(f->dir = fdopendir(fd))) {
+		error_out(ERROR_ERROR_OPENDIR, errno, FLN, w->path);
+		close(fd);
+		return -1;
+	}
+	f->fd = fd;
+	f->names = NULL;
+	f->nnames = f->next = 0;
+	f->failed = FALSE;
+	if(w->names)
+		f->mark = arena_mark(w->names);
+	if(w->sorted && frame_read_sorted(w, f) < 0) {
+		frame_close(w, f);
+		return -1;
+	}
+	f->pathlen = strlen(w->path);
+	f->nameoff = nameoff;
+	f->id = ++w->last_id;
+	f->dev = st.st_dev;
+	f->ino = st.st_ino;
+	++w->depth;
+	TRACE_END("opendir", t0, w->path);
+
+	return 1;
+}
+
+/*
+ * Begin a traversal of root. If root is a directory its whole
+ * tree is visited; otherwise root alone is returned.
+ * If follow_root is TRUE a symbolic link given as root is
+ * followed, links found below the root never are. If sorted is
+ * TRUE the entries of every directory are returned in strcmp()
+ * order of their names, at the cost of reading each directory
+ * as a whole when entering it.
+ */
+struct walk*
+walk_open(const char *root, GENERAL_BOOL follow_root, GENERAL_BOOL sorted)
+{
+	struct walk *w = general_malloc(sizeof *w);
+
+	memset(w, 0, sizeof *w);
+	w->root = root;
+	w->follow_root = follow_root;
+	w->sorted = sorted;
+	if(sorted)
+		w->names = arena_new(WALK_NAMES_CHUNK);
+
+	return w;
+}
+
+/*
+ * Fetch the next entry of the traversal. Directories are
+ * returned after their contents (post-order) so that reading
+ * them does not disturb access times that were just applied.
+ * Returns 1 if entry was filled in, 0 once the traversal is
+ * complete, -1 on failure. The traversal may be continued after a
+ * failure; the entry that failed, see walk_path(), is skipped.
+ */
+int
+walk_next(struct walk *w, struct walk_entry *entry)
+{
+	struct walk_frame *f;
+	const char *name;
+	unsigned char type;
+	struct stat st;
+	size_t nameoff;
+	int rc;
+
+	if(w->done)
+		return 0;
+
+	if(!w->started) {
+		w->started = TRUE;
+		path_reserve(w, strlen(w->root) + 1);
+		strcpy(w->path, w->root);
+
+		if(fstatat(AT_FDCWD, w->root, &st,
+			   w->follow_root ? 0 : AT_SYMLINK_NOFOLLOW) < 0 ||
+		   !S_ISDIR(st.st_mode)) {
+			w->done = TRUE;
+			entry->dirfd = AT_FDCWD;
+			entry->dir_id = 0;
+			entry->name = entry->path = w->path;
+			entry->is_dir = FALSE;
+			return 1;
+		}
+
+		if(walk_push(w, AT_FDCWD, w->root, 0,
+			     w->follow_root ? 0 : O_NOFOLLOW) <= 0) {
+			w->done = TRUE;
+			return -1;
+		}
+	}
+
+	while(w->depth > 0) {
+		f = &w->stack[w->depth-1];
+		w->path[f->pathlen] = 0;
+
+		if((rc = frame_next(w, f, &name, &type)) < 0)
+			return -1;
+		if(!rc) {
+			frame_close(w, f);
+			--w->depth;
+			if(!w->depth)
+				w->done = TRUE;
+
+			entry->dirfd = w->depth ? w->stack[w->depth-1].fd : AT_FDCWD;
+			entry->dir_id = w->depth ? w->stack[w->depth-1].id : 0;
+			entry->name = w->path + f->nameoff;
+			entry->path = w->path;
+			entry->is_dir = TRUE;
+			return 1;
+		}
+
+		nameoff = path_append(w, f->pathlen, name);
+
+		entry->is_dir = type == DT_DIR;
+		if(type == DT_UNKNOWN) {
+			if(fstatat(f->fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+				error_out(ERROR_ERROR_STAT, 0, FLN, w->path, strerror(errno));
+				return -1;
+			}
+			entry->is_dir = S_ISDIR(st.st_mode) ? TRUE : FALSE;
+		}
+
+		if(entry->is_dir) {
+			if((rc = walk_push(w, f->fd, name, nameoff, O_NOFOLLOW)) < 0)
+				return -1;
+			continue;
+		}
+
+		entry->dirfd = f->fd;
+		entry->dir_id = f->id;
+		entry->name = w->path + nameoff;
+		entry->path = w->path;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Path of the entry last fetched, or of the one that failed.
+ */
+const char*
+walk_path(struct walk *w)
+{
+	return w->path ? w->path : w->root;
+}
+
+/*
+ * Release all resources held by the traversal.
+ */
+void
+walk_close(struct walk *w)
+{
+	if(!w)
+		return;
+	while(w->depth > 0)
+		frame_close(w, &w->stack[--w->depth]);
+	arena_destroy(&w->names);
+	free(w->stack);
+	free(w->path);
+	free(w);
+}
@@ -0,0 +1,55 @@
+/*
+ *      walk.h - Directory tree traversal for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef STROKE_WALK_H
+#define STROKE_WALK_H 1
+
+#include <libgeneral/general.h>
+
+/*
+ * One entry returned by walk_next().
+ * name is relative to dirfd and path is the full display path
+ * (beginning with the root given to walk_open()). Both pointers
+ * remain valid until the next call to walk_next(). dir_id tells
+ * apart the directories dirfd referred to during the walk, as
+ * descriptor numbers are reused.
+ */
+struct walk_entry {
+	int dirfd;
+	unsigned long dir_id;
+	const char *name;
+	const char *path;
+	GENERAL_BOOL is_dir;
+};
+
+/* Opaque traversal state */
+struct walk;
+
+/*
+ * Function declarations
+ */
+extern struct walk* walk_open(const char *root, GENERAL_BOOL follow_root,
+			      GENERAL_BOOL sorted);
+extern int walk_next(struct walk *w, struct walk_entry *entry);
+extern const char* walk_path(struct walk *w);
+extern void walk_close(struct walk *w);
+
+#endif /* STROKE_WALK_H */
@@ -0,0 +1,170 @@
+/*
+ *      writer.c - Buffered output for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#include "writer.h"
+
+#include "stroke.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* Size of the output buffer */
+#define WRITER_BUF (256 * 1024)
+
+/*
+ * Output gathered in one large buffer and handed to write() only
+ * when it is full or at the end, instead of going through stdio.
+ * Several threads may share a writer; each takes the lock around
+ * whatever it wants to appear in one piece.
+ */
+struct writer {
+	int fd;
+	int err;		/* errno of the first failed write, or 0 */
+	pthread_mutex_t lock;
+	size_t len;
+	char buf[WRITER_BUF];
+};
+
+/*
+ * Write all n bytes of s to the descriptor of w. Once a write has
+ * failed everything else is dropped; writer_close() reports it.
+ */
+static void
+write_all(struct writer *w, const char *s, size_t n)
+{
+	ssize_t done;
+
+	while(n && !w->err) {
+		if((done = write(w->fd, s, n)) < 0) {
+			if(errno != EINTR)
+				w->err = errno;
+			continue;
+		}
+		s += done;
+		n -= done;
+	}
+}
+
+/*
+ * Set up a writer for descriptor fd, which is not closed by
+ * writer_close().
+ */
+struct writer*
+writer_open(int fd)
+{
+	struct writer *w = general_malloc(sizeof *w);
+
+	w->fd = fd;
+	w->err = 0;
+	w->len = 0;
+	pthread_mutex_init(&w->lock, NULL);
+
+	return w;
+}
+
+void
+writer_lock(struct writer *w)
+{
+	pthread_mutex_lock(&w->lock);
+}
+
+void
+writer_unlock(struct writer *w)
+{
+	pthread_mutex_unlock(&w->lock);
+}
+
+/*
+ * Append n bytes of s. Runs larger than the buffer bypass it.
+ */
+void
+writer_write(struct writer *w, const char *s, size_t n)
+{
+	if(n > WRITER_BUF - w->len) {
+		writer_flush(w);
+		if(n > WRITER_BUF) {
+			write_all(w, s, n);
+			return;
+		}
+	}
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+}
+
+/*
+ * Make room for n bytes, at most WRITER_RESERVE, to be written
+ * directly into the buffer; the number actually used is then
+ * passed to writer_commit(). Returns where they go.
+ */
+char*
+writer_reserve(struct writer *w, size_t n)
+{
+	if(n > WRITER_BUF - w->len)
+		writer_flush(w);
+	return w->buf + w->len;
+}
+
+void
+writer_commit(struct writer *w, size_t n)
+{
+	w->len += n;
+}
+
+/*
+ * Hand everything buffered to the descriptor. What stdio still
+ * holds for the same descriptor goes first so that the two do not
+ * mix up.
+ * Returns 0 on success, -1 if a write has failed.
+ */
+int
+writer_flush(struct writer *w)
+{
+	if(w->fd == STDOUT_FILENO)
+		fflush(stdout);
+	write_all(w, w->buf, w->len);
+	w->len = 0;
+
+	return w->err ? -1 : 0;
+}
+
+/*
+ * Flush and release w.
+ * Returns 0 on success, -1 if any output was lost; errno is then
+ * that of the failed write.
+ */
+int
+writer_close(struct writer *w)
+{
+	int rc;
+
+	if(!w)
+		return 0;
+	if((rc = writer_flush(w)) < 0)
+		errno = w->err;
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+
+	return rc;
+}
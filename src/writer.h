@@ -0,0 +1,46 @@
+/*
+ *      writer.h - Buffered output for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_WRITER_H
+#define STROKE_WRITER_H 1
+
+#include <stddef.h>
+
+/* Largest run of bytes writer_reserve() hands out */
+#define WRITER_RESERVE 64
+
+/* Opaque output buffer */
+struct writer;
+
+/*
+ * Function declarations
+ */
+extern struct writer* writer_open(int fd);
+extern void writer_lock(struct writer *w);
+extern void writer_unlock(struct writer *w);
+extern void writer_write(struct writer *w, const char *s, size_t n);
+extern char* writer_reserve(struct writer *w, size_t n);
+extern void writer_commit(struct writer *w, size_t n);
+extern int writer_flush(struct writer *w);
+extern int writer_close(struct writer *w);
+
+#endif /* STROKE_WRITER_H */
@@ -0,0 +1,817 @@
+/*
+ *      zone.c - Time zone conversions for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+
+#include "stroke.h"
+#include "zone.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * localtime_r() and mktime() take a process-wide lock in the C
+ * library and check TZ again on every call, which makes reporting
+ * from several threads contend on a lock for nothing. Instead, the
+ * zone in effect is read here once, from its TZif file (RFC 8536)
+ * or from a POSIX TZ string, into a table that is never written to
+ * again. A conversion is then a binary search and some arithmetic,
+ * safe from any thread and without allocating.
+ *
+ * The rules follow those of glibc: times before the first
+ * transition use the first standard time type, times after the
+ * last are computed from the POSIX TZ string at the end of the
+ * file. Zones that are not understood here, including those with
+ * leap seconds, are left to the C library; every function then
+ * returns -1 and callers fall back to it.
+ */
+
+/* Longest zone abbreviation kept, including the NUL */
+#define ZONE_ABBR 16
+
+/* Largest TZif file read */
+#define ZONE_FILE_MAX (1 << 20)
+
+/* Where zones named by TZ are found unless TZDIR says otherwise */
+#define ZONEINFO "/usr/share/zoneinfo"
+
+/* Zone used if TZ is not set */
+#define LOCALTIME "/etc/localtime"
+
+/* Times converted, about 300000 years either way */
+#define ZONE_LIMIT 10000000000000LL
+
+#define DAY 86400LL
+
+/*
+ * zone_localtime_batch() works on local times shifted by a whole
+ * number of 400 year eras, so that all its arithmetic is on
+ * unsigned 32 bit quantities, which vector units divide by
+ * constants as easily as scalar ones. It covers the years from
+ * -2430 to about 15000; anything else is converted one by one.
+ */
+#define BATCH_ERAS 11
+#define BATCH_DAYS (BATCH_ERAS * 146097LL)
+#define BATCH_MIN (-BATCH_DAYS * DAY)
+#define BATCH_MAX ((1LL << 39) - BATCH_DAYS * DAY)
+
+/* Times converted side by side by batch_civil() */
+#define BATCH_LANES 16
+
+#define IS_DIGIT(C) ((C) >= '0' && (C) <= '9')
+#define IS_ALPHA(C) (((C) >= 'a' && (C) <= 'z') || ((C) >= 'A' && (C) <= 'Z'))
+
+/* One local time type: offset east of UTC and whether it is DST */
+struct zone_type {
+	long off;
+	int isdst;
+	char abbr[ZONE_ABBR];
+};
+
+/* Day and time of day of a change of a POSIX TZ rule */
+struct zone_date {
+	char kind;	/* 'J' Julian day without Feb 29, 'D' day of year, 'M' */
+	int m, w, d;	/* month, week and weekday for 'M', day otherwise */
+	long secs;	/* local time of day of the change */
+};
+
+/* A POSIX TZ string, e.g. CET-1CEST,M3.5.0,M10.5.0/3 */
+struct zone_rule {
+	struct zone_type std;
+	struct zone_type dst;
+	GENERAL_BOOL has_dst;
+	struct zone_date start;
+	struct zone_date end;
+};
+
+/* The zone in effect; written by zone_init() only */
+static struct {
+	GENERAL_BOOL loaded;
+	GENERAL_BOOL has_file;
+
+	/* Transitions of the TZif file and the type each switches to */
+	long long *trans;
+	unsigned char *trans_type;
+	size_t ntrans;
+
+	struct zone_type *types;
+	size_t ntypes;
+	size_t before;		/* type before the first transition */
+
+	/* POSIX TZ string of the file, or TZ itself */
+	GENERAL_BOOL has_rule;
+	struct zone_rule rule;
+} zone;
+
+/*
+ * Number of days from 1970-01-01 to the given date of the
+ * proleptic Gregorian calendar.
+ */
+long long
+days_from_civil(long long y, int m, int d)
+{
+	long long era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+/*
+ * Date of the day days after 1970-01-01; the inverse of
+ * days_from_civil().
+ */
+void
+civil_from_days(long long days, long long *y, int *m, int *d)
+{
+	long long era, doe, yoe, doy, mp;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	doe = days - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+static GENERAL_BOOL
+is_leap(long long y)
+{
+	return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+}
+
+static int
+month_days(long long y, int m)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	return m == 2 && is_leap(y) ? 29 : days[m-1];
+}
+
+static long long
+floor_div(long long a, long long b)
+{
+	return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/*
+ * Read a zone name of at least three letters, or any name in angle
+ * brackets, into abbr.
+ * Returns the rest of s, NULL if there is no valid name.
+ */
+static const char*
+posix_name(const char *s, char *abbr)
+{
+	const char *b = s, *e;
+
+	if(*s == '<') {
+		for(e = b = s + 1; *e && *e != '>'; e++)
+			if(!IS_ALPHA(*e) && !IS_DIGIT(*e) && *e != '+' && *e != '-')
+				return NULL;
+		if(*e != '>')
+			return NULL;
+		s = e + 1;
+	} else {
+		for(e = s; IS_ALPHA(*e); e++)
+			;
+		s = e;
+	}
+	if(e - b < 3 || e - b >= ZONE_ABBR)
+		return NULL;
+	memcpy(abbr, b, e - b);
+	abbr[e - b] = 0;
+	return s;
+}
+
+/*
+ * Read [+-]hh[:mm[:ss]] of at most maxh hours into secs.
+ * Returns the rest of s, NULL if there is no valid time.
+ */
+static const char*
+posix_time(const char *s, long maxh, long *secs)
+{
+	long sign = 1, h = 0, part;
+	int i, n;
+
+	if(*s == '+' || *s == '-')
+		sign = *s++ == '-' ? -1 : 1;
+	for(n = 0; IS_DIGIT(*s) && n < 3; n++)
+		h = h * 10 + (*s++ - '0');
+	if(!n || h > maxh)
+		return NULL;
+	*secs = h * 3600;
+	for(i = 60 * 60; *s == ':' && i > 1; ) {
+		i /= 60;
+		++s;
+		if(!IS_DIGIT(s[0]) || !IS_DIGIT(s[1]))
+			return NULL;
+		part = (s[0] - '0') * 10 + (s[1] - '0');
+		if(part > 59)
+			return NULL;
+		*secs += part * i;
+		s += 2;
+	}
+	*secs *= sign;
+	return s;
+}
+
+/*
+ * Read a rule date, Jn, n or Mm.w.d with an optional /time, into d.
+ * Returns the rest of s, NULL if there is no valid date.
+ */
+static const char*
+posix_date(const char *s, struct zone_date *d)
+{
+	long v[3] = {0, 0, 0};
+	int i, n, parts = 1;
+
+	d->kind = 'D';
+	if(*s == 'J' || *s == 'M') {
+		d->kind = *s++;
+		if(d->kind == 'M')
+			parts = 3;
+	}
+	for(i = 0; i < parts; i++) {
+		if(i && *s++ != '.')
+			return NULL;
+		for(n = 0; IS_DIGIT(*s) && n < 3; n++)
+			v[i] = v[i] * 10 + (*s++ - '0');
+		if(!n)
+			return NULL;
+	}
+
+	switch(d->kind) {
+	case 'J':
+		if(v[0] < 1 || v[0] > 365)
+			return NULL;
+		break;
+	case 'D':
+		if(v[0] > 365)
+			return NULL;
+		break;
+	case 'M':
+		if(v[0] < 1 || v[0] > 12 || v[1] < 1 || v[1] > 5 || v[2] > 6)
+			return NULL;
+		break;
+	}
+	d->m = v[0];
+	d->w = v[1];
+	d->d = d->kind == 'M' ? v[2] : v[0];
+
+	d->secs = 2 * 3600;
+	if(*s == '/')
+		s = posix_time(s + 1, 167, &d->secs);
+	return s;
+}
+
+/*
+ * Parse POSIX TZ string s into r. A zone with daylight saving time
+ * must come with its rules; the defaults the C library would use
+ * instead are its own business.
+ * Returns 0 on success, -1 if s is not understood.
+ */
+static int
+posix_parse(const char *s, struct zone_rule *r)
+{
+	long off;
+
+	memset(r, 0, sizeof *r);
+	if(!(s = posix_name(s, r->std.abbr)) || !(s = posix_time(s, 24, &off)))
+		return -1;
+	r->std.off = -off;
+	if(!*s)
+		return 0;
+
+	if(!(s = posix_name(s, r->dst.abbr)))
+		return -1;
+	r->dst.off = r->std.off + 3600;
+	if(*s && *s != ',') {
+		if(!(s = posix_time(s, 24, &off)))
+			return -1;
+		r->dst.off = -off;
+	}
+	r->dst.isdst = 1;
+	r->has_dst = TRUE;
+
+	if(*s++ != ',' || !(s = posix_date(s, &r->start)) ||
+	   *s++ != ',' || !(s = posix_date(s, &r->end)) || *s)
+		return -1;
+	return 0;
+}
+
+/*
+ * Time, as local seconds since the epoch, at which change d takes
+ * place in year y. Like glibc, years before 1970 count their days
+ * from 1970-01-01, which keeps times from back then consistent
+ * with localtime_r().
+ */
+static long long
+rule_change(const struct zone_date *d, long long y)
+{
+	long long jan1 = days_from_civil(y, 1, 1);
+	long long base = y > 1970 ? jan1 : 0, first, day;
+	int dow, i;
+
+	switch(d->kind) {
+	case 'J':
+		day = d->d - 1;
+		if(d->d >= 60 && is_leap(y))
+			++day;
+		break;
+	case 'D':
+		day = d->d;
+		break;
+	default:
+		/* Day d of week w, the last one for 5, of month m */
+		first = days_from_civil(y, d->m, 1);
+		dow = (int)((first % 7 + 11) % 7);
+		day = d->d - dow;
+		if(day < 0)
+			day += 7;
+		for(i = 1; i < d->w && day + 7 < month_days(y, d->m); i++)
+			day += 7;
+		day += first - jan1;
+		break;
+	}
+	return (base + day) * DAY + d->secs;
+}
+
+/*
+ * Local time type rule r assigns to t.
+ */
+static const struct zone_type*
+rule_type(const struct zone_rule *r, long long t)
+{
+	long long y, start, end;
+	int m, d;
+	GENERAL_BOOL isdst;
+
+	if(!r->has_dst)
+		return &r->std;
+
+	civil_from_days(floor_div(t, DAY), &y, &m, &d);
+	start = rule_change(&r->start, y) - r->std.off;
+	end = rule_change(&r->end, y) - r->dst.off;
+	if(start > end)
+		isdst = t < end || t >= start;
+	else
+		isdst = t >= start && t < end;
+	return isdst ? &r->dst : &r->std;
+}
+
+/*
+ * Local time type in effect at t.
+ */
+static const struct zone_type*
+type_at(long long t)
+{
+	size_t lo, hi, mid;
+
+	if(!zone.has_file)
+		return rule_type(&zone.rule, t);
+	if(!zone.ntrans || t < zone.trans[0])
+		return &zone.types[zone.before];
+	if(t >= zone.trans[zone.ntrans-1]) {
+		if(zone.has_rule)
+			return rule_type(&zone.rule, t);
+		return &zone.types[zone.trans_type[zone.ntrans-1]];
+	}
+
+	/* Last transition at or before t */
+	for(lo = 0, hi = zone.ntrans - 1; hi - lo > 1; ) {
+		mid = lo + (hi - lo) / 2;
+		if(zone.trans[mid] <= t)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return &zone.types[zone.trans_type[lo]];
+}
+
+static unsigned long
+be32(const unsigned char *p)
+{
+	return (unsigned long)p[0] << 24 | (unsigned long)p[1] << 16 |
+		(unsigned long)p[2] << 8 | p[3];
+}
+
+static long long
+be64(const unsigned char *p)
+{
+	return (long long)((unsigned long long)be32(p) << 32 | be32(p + 4));
+}
+
+/*
+ * Read all of regular file path, of at most ZONE_FILE_MAX bytes.
+ * Returns the contents, NULL on failure.
+ */
+static unsigned char*
+read_file(const char *path, size_t *len)
+{
+	unsigned char *buf = NULL;
+	struct stat st;
+	ssize_t n;
+	size_t got = 0;
+	int fd;
+
+	if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return NULL;
+	if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	   st.st_size > ZONE_FILE_MAX)
+		goto out;
+
+	buf = general_malloc(st.st_size + 1);
+	while(got < (size_t)st.st_size) {
+		if((n = read(fd, buf + got, st.st_size - got)) < 0 && errno == EINTR)
+			continue;
+		if(n <= 0) {
+			free(buf);
+			buf = NULL;
+			goto out;
+		}
+		got += n;
+	}
+	buf[got] = 0;
+	*len = got;
+ out:
+	close(fd);
+	return buf;
+}
+
+/*
+ * Load the TZif data in buf of length len into zone.
+ * Returns 0 on success, -1 if it is not understood.
+ */
+static int
+load_tzif(const unsigned char *buf, size_t len)
+{
+	const unsigned char *p = buf, *end = buf + len, *abbrs;
+	unsigned long isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt;
+	size_t i, tsize = 4, block;
+	const char *footer, *nl;
+
+	for(;;) {
+		if(end - p < 44 || memcmp(p, "TZif", 4))
+			return -1;
+		isutcnt = be32(p + 20);
+		isstdcnt = be32(p + 24);
+		leapcnt = be32(p + 28);
+		timecnt = be32(p + 32);
+		typecnt = be32(p + 36);
+		charcnt = be32(p + 40);
+		block = timecnt * (tsize + 1) + typecnt * 6 + charcnt +
+			leapcnt * (tsize + 4) + isstdcnt + isutcnt;
+		if(timecnt > ZONE_FILE_MAX || typecnt > ZONE_FILE_MAX ||
+		   charcnt > ZONE_FILE_MAX || leapcnt > ZONE_FILE_MAX ||
+		   isstdcnt > ZONE_FILE_MAX || isutcnt > ZONE_FILE_MAX ||
+		   (size_t)(end - p - 44) < block)
+			return -1;
+
+		/* Version 2 and later repeat the data with 64 bit times */
+		if(buf[4] < '2' || tsize == 8)
+			break;
+		p += 44 + block;
+		tsize = 8;
+	}
+	p += 44;
+
+	if(leapcnt || !typecnt || typecnt > 256)
+		return -1;
+
+	zone.ntrans = timecnt;
+	zone.trans = general_malloc((timecnt ? timecnt : 1) * sizeof *zone.trans);
+	zone.trans_type = general_malloc(timecnt ? timecnt : 1);
+	zone.ntypes = typecnt;
+	zone.types = general_malloc(typecnt * sizeof *zone.types);
+
+	for(i = 0; i < timecnt; i++, p += tsize) {
+		zone.trans[i] = tsize == 8 ? be64(p) : (long long)(int32_t)be32(p);
+		if(i && zone.trans[i] <= zone.trans[i-1])
+			return -1;
+	}
+	for(i = 0; i < timecnt; i++) {
+		if((zone.trans_type[i] = *p++) >= typecnt)
+			return -1;
+	}
+	abbrs = p + typecnt * 6;
+	for(i = 0; i < typecnt; i++, p += 6) {
+		size_t a = p[5], n;
+
+		zone.types[i].off = (long)(int32_t)be32(p);
+		zone.types[i].isdst = p[4] != 0;
+		if(a >= charcnt)
+			return -1;
+		for(n = 0; a + n < charcnt && abbrs[a+n] && n < ZONE_ABBR - 1; n++)
+			zone.types[i].abbr[n] = abbrs[a+n];
+		zone.types[i].abbr[n] = 0;
+	}
+	p = abbrs + charcnt + leapcnt * (tsize + 4) + isstdcnt + isutcnt;
+
+	zone.before = 0;
+	while(zone.before < typecnt && zone.types[zone.before].isdst)
+		++zone.before;
+	if(zone.before == typecnt)
+		zone.before = 0;
+
+	/* The POSIX TZ string for times after the last transition */
+	zone.has_rule = FALSE;
+	if(tsize == 8 && p < end && *p == '\n') {
+		footer = (const char*)p + 1;
+		if(!(nl = memchr(footer, '\n', end - p - 1)))
+			return -1;
+		if(nl > footer) {
+			char rule[256];
+
+			if((size_t)(nl - footer) >= sizeof rule)
+				return -1;
+			memcpy(rule, footer, nl - footer);
+			rule[nl - footer] = 0;
+			if(posix_parse(rule, &zone.rule) < 0)
+				return -1;
+			zone.has_rule = TRUE;
+		}
+	}
+
+	zone.has_file = TRUE;
+	return 0;
+}
+
+/*
+ * Load the zone named by TZ, or the system default, the way the
+ * C library finds it. Must be called before any other thread is
+ * started; if the zone cannot be loaded the C library is used.
+ */
+void
+zone_init(void)
+{
+	const char *tz = getenv("TZ"), *dir;
+	char path[PATH_MAX];
+	unsigned char *buf;
+	size_t len;
+
+	if(zone.loaded)
+		return;
+
+	/* An empty TZ means UTC */
+	if(tz && *tz == ':')
+		++tz;
+	if(tz && !*tz) {
+		zone.loaded = posix_parse("UTC0", &zone.rule) == 0 ? TRUE : FALSE;
+		return;
+	}
+
+	if(!tz) {
+		snprintf(path, sizeof path, "%s", LOCALTIME);
+	} else if(*tz == '/') {
+		snprintf(path, sizeof path, "%s", tz);
+	} else {
+		if(!(dir = getenv("TZDIR")) || !*dir)
+			dir = ZONEINFO;
+		snprintf(path, sizeof path, "%s/%s", dir, tz);
+	}
+
+	if((buf = read_file(path, &len)) && load_tzif(buf, len) == 0) {
+		zone.loaded = TRUE;
+	} else {
+		free(zone.trans);
+		free(zone.trans_type);
+		free(zone.types);
+		memset(&zone, 0, sizeof zone);
+
+		/* Not a file, but maybe a POSIX TZ string */
+		if(tz && posix_parse(tz, &zone.rule) == 0)
+			zone.loaded = TRUE;
+	}
+	free(buf);
+}
+
+/*
+ * Convert t into local time in tm, like localtime_r(); tm_gmtoff
+ * and tm_zone are not filled in. Safe to call from any thread.
+ * Returns 0 on success, -1 if the C library has to be asked.
+ */
+int
+zone_localtime(time_t t, struct tm *tm)
+{
+	const struct zone_type *type;
+	long long secs, days, y;
+	int m, d;
+
+	if(!zone.loaded || t < -ZONE_LIMIT || t > ZONE_LIMIT)
+		return -1;
+
+	type = type_at(t);
+	secs = (long long)t + type->off;
+	days = floor_div(secs, DAY);
+	secs -= days * DAY;
+	civil_from_days(days, &y, &m, &d);
+
+	memset(tm, 0, sizeof *tm);
+	tm->tm_year = y - 1900;
+	tm->tm_mon = m - 1;
+	tm->tm_mday = d;
+	tm->tm_hour = secs / 3600;
+	tm->tm_min = secs / 60 % 60;
+	tm->tm_sec = secs % 60;
+	tm->tm_wday = (int)((days % 7 + 11) % 7);
+	tm->tm_yday = days - days_from_civil(y, 1, 1);
+	tm->tm_isdst = type->isdst;
+	return 0;
+}
+
+/*
+ * Convert the local time in tm, whose fields must be within their
+ * normal ranges, into t. Unlike mktime() no guess is made for a
+ * time skipped or repeated by a change of offset.
+ * Returns 1 on success, 0 if tm names no single instant, -1 if the
+ * C library has to be asked.
+ */
+int
+zone_mktime(const struct tm *tm, time_t *t)
+{
+	long long local, cand, found = 0;
+	long off[5];
+	int i, j, noff = 3, n = 0;
+
+	if(!zone.loaded || tm->tm_year < -ZONE_LIMIT / (366 * DAY) ||
+	   tm->tm_year > ZONE_LIMIT / (366 * DAY))
+		return -1;
+
+	local = days_from_civil(tm->tm_year + 1900LL, tm->tm_mon + 1, tm->tm_mday) * DAY +
+		tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
+
+	/*
+	 * Every offset in effect within a day and a bit of local, and
+	 * those of the rule, which may apply for mere hours around the
+	 * turn of the year, is a candidate; it is right if it is the
+	 * one in effect at the instant it gives.
+	 */
+	off[0] = type_at(local - 30 * 3600)->off;
+	off[1] = type_at(local)->off;
+	off[2] = type_at(local + 30 * 3600)->off;
+	if(!zone.has_file || zone.has_rule) {
+		off[noff++] = zone.rule.std.off;
+		if(zone.rule.has_dst)
+			off[noff++] = zone.rule.dst.off;
+	}
+	for(i = 0; i < noff; i++) {
+		for(j = 0; j < i; j++)
+			if(off[j] == off[i])
+				break;
+		if(j < i)
+			continue;
+		cand = local - off[i];
+		if(type_at(cand)->off == off[i]) {
+			found = cand;
+			++n;
+		}
+	}
+
+	if(n != 1)
+		return 0;
+	*t = found;
+	return 1;
+}
+
+/*
+ * Break down local times local[0..BATCH_LANES) of b, starting at
+ * index base, which must all lie within [BATCH_MIN, BATCH_MAX).
+ * The loop has neither branches nor calls so that the compiler
+ * turns it into vector instructions.
+ */
+static void
+batch_civil(struct zone_batch *b, size_t base)
+{
+	const long long *local = b->local + base;
+	int *year = b->year + base, *mon = b->mon + base, *mday = b->mday + base;
+	int *hour = b->hour + base, *min = b->min + base, *sec = b->sec + base;
+	int *wday = b->wday + base;
+	unsigned i;
+
+	for(i = 0; i < BATCH_LANES; i++) {
+		unsigned long long u = (unsigned long long)(local[i] + BATCH_DAYS * DAY);
+		unsigned hi = (unsigned)(u >> 7);	/* DAY is 675 << 7 */
+		unsigned days = hi / 675;
+		unsigned secs = (unsigned)(u & 127) + (hi - days * 675) * 128;
+		unsigned z, era, doe, yoe, doy, mp, m;
+
+		/* BATCH_DAYS is a multiple of 7: no weekday shift */
+		wday[i] = (days + 4) % 7;
+
+		z = days + 719468;
+		era = z / 146097;
+		doe = z - era * 146097;
+		yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		mp = (5 * doy + 2) / 153;
+		m = mp < 10 ? mp + 3 : mp - 9;
+		mday[i] = doy - (153 * mp + 2) / 5 + 1;
+		mon[i] = m;
+		year[i] = (int)(yoe + era * 400 + (m <= 2)) - BATCH_ERAS * 400;
+		hour[i] = secs / 3600;
+		min[i] = secs / 60 % 60;
+		sec[i] = secs % 60;
+	}
+}
+
+/*
+ * Convert the first n times of b, at most ZONE_BATCH, into local
+ * time; see struct zone_batch. Only the offsets are looked up one
+ * time at a time, the calendar is worked out for a whole run of
+ * times at once. Times the zone engine does not cover are handed
+ * to the C library. Safe to call from any thread.
+ */
+void
+zone_localtime_batch(struct zone_batch *b, size_t n)
+{
+	const struct zone_type *type;
+	size_t i, end = (n + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+	struct tm tm;
+	time_t t;
+
+	for(i = 0; i < n; i++) {
+		if(zone.loaded && b->t[i] >= -ZONE_LIMIT && b->t[i] <= ZONE_LIMIT) {
+			type = type_at(b->t[i]);
+			b->local[i] = b->t[i] + type->off;
+			b->isdst[i] = type->isdst;
+		} else {
+			b->local[i] = BATCH_MAX;
+		}
+	}
+	for(; i < end; i++)
+		b->local[i] = 0;
+
+	for(i = 0; i < end; i++)
+		b->ok[i] = b->local[i] >= BATCH_MIN && b->local[i] < BATCH_MAX;
+	for(i = 0; i < end; i++)
+		b->local[i] = b->ok[i] ? b->local[i] : 0;
+
+	for(i = 0; i < end; i += BATCH_LANES)
+		batch_civil(b, i);
+
+	for(i = 0; i < n; i++) {
+		if(b->ok[i])
+			continue;
+		t = b->t[i];
+		if(zone_localtime(t, &tm) < 0 && !localtime_r(&t, &tm))
+			continue;
+		b->year[i] = tm.tm_year + 1900;
+		b->mon[i] = tm.tm_mon + 1;
+		b->mday[i] = tm.tm_mday;
+		b->hour[i] = tm.tm_hour;
+		b->min[i] = tm.tm_min;
+		b->sec[i] = tm.tm_sec;
+		b->wday[i] = tm.tm_wday;
+		b->isdst[i] = tm.tm_isdst;
+		b->ok[i] = 1;
+	}
+}
+
+/*
+ * Fill in tm from time i of batch b, as zone_localtime() would.
+ * Returns 0 on success, -1 if the time could not be converted.
+ */
+int
+zone_batch_tm(const struct zone_batch *b, size_t i, struct tm *tm)
+{
+	if(!b->ok[i])
+		return -1;
+	memset(tm, 0, sizeof *tm);
+	tm->tm_year = b->year[i] - 1900;
+	tm->tm_mon = b->mon[i] - 1;
+	tm->tm_mday = b->mday[i];
+	tm->tm_hour = b->hour[i];
+	tm->tm_min = b->min[i];
+	tm->tm_sec = b->sec[i];
+	tm->tm_wday = b->wday[i];
+	tm->tm_isdst = b->isdst[i];
+	return 0;
+}
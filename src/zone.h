@@ -0,0 +1,65 @@
+/*
+ *      zone.h - Time zone conversions for stroke
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef STROKE_ZONE_H
+#define STROKE_ZONE_H 1
+
+#include <libgeneral/general.h>
+#include <time.h>
+
+/* Time stamps converted by one call of zone_localtime_batch() */
+#define ZONE_BATCH 768
+
+/*
+ * A batch of time stamps and their local times, one array per
+ * field so that every field is computed for all of them at once.
+ * The caller fills in t; after zone_localtime_batch() ok tells
+ * whether a time could be converted and the other arrays hold it,
+ * with the full year, month and day starting from 1 and a weekday
+ * counted from Sunday.
+ */
+struct zone_batch {
+	long long t[ZONE_BATCH];
+	long long local[ZONE_BATCH];	/* t plus its offset */
+	int year[ZONE_BATCH];
+	int mon[ZONE_BATCH];
+	int mday[ZONE_BATCH];
+	int hour[ZONE_BATCH];
+	int min[ZONE_BATCH];
+	int sec[ZONE_BATCH];
+	int wday[ZONE_BATCH];
+	int isdst[ZONE_BATCH];
+	unsigned char ok[ZONE_BATCH];
+};
+
+/*
+ * Function declarations
+ */
+extern long long days_from_civil(long long y, int m, int d);
+extern void civil_from_days(long long days, long long *y, int *m, int *d);
+extern void zone_init(void);
+extern int zone_localtime(time_t t, struct tm *tm);
+extern int zone_mktime(const struct tm *tm, time_t *t);
+extern void zone_localtime_batch(struct zone_batch *b, size_t n);
+extern int zone_batch_tm(const struct zone_batch *b, size_t i, struct tm *tm);
+
+#endif /* STROKE_ZONE_H */
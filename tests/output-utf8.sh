@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# JSON Lines records of files whose names are not UTF-8 must stay
+# valid JSON and carry the exact name in base64.
+#
+
+STROKE=${STROKE:-../src/stroke}
+case $STROKE in
+/*) ;;
+*) STROKE=$(pwd)/$STROKE ;;
+esac
+dir=$(mktemp -d) || exit 99
+trap 'rm -rf "$dir"' EXIT
+
+cd "$dir" || exit 99
+touch "$(printf 'bad\377')" "$(printf 'ok-\303\251')" || exit 77
+out=$("$STROKE" --output=jsonl "$(printf 'bad\377')" \
+	"$(printf 'ok-\303\251')") || exit 1
+
+fail=0
+expect() {
+	if ! printf '%s\n' "$out" | grep -F -q -- "$1"; then
+		echo "missing: $1"
+		fail=1
+	fi
+}
+
+# 0xff is escaped; "bad\377" is YmFk/w== in base64
+expect '{"path":"bad\u00ff","path_b64":"YmFk/w==","link":null,'
+# Valid UTF-8 is written as it is, without base64
+expect "$(printf '{"path":"ok-\303\251","link":null,')"
+
+if printf '%s\n' "$out" | LC_ALL=C grep -q "$(printf '\377')"; then
+	echo "raw 0xff byte in output"
+	fail=1
+fi
+
+[ $fail = 0 ] || printf '%s\n' "$out"
+exit $fail
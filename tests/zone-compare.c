@@ -0,0 +1,188 @@
+/*
+ *      zone-compare.c - Comparison of the zone engine with the C library
+ *
+ *      Copyright 2026 Peter Dey <github@realmtech.net>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * Converts times with zone.c and with localtime_r() in the zone
+ * named by TZ, and tells where they differ:
+ *
+ *   TZ=Europe/Dublin ./zone-compare
+ *
+ * Every change of offset from 1900 to 2100 the C library knows of
+ * is found by a daily scan and bisection, and the seconds around it
+ * are compared, along with pseudo-random times over the same years.
+ * Each time goes through zone_localtime() and zone_localtime_batch(),
+ * and back through zone_mktime(). Times the engine leaves to the C
+ * library are counted, not compared. The exit status is 1 if any
+ * time differs, 0 otherwise; see zone-glibc.sh.
+ */
+
+#include "zone.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* 1900-01-01 and 2100-12-31 UTC */
+#define FIRST (-2208988800LL)
+#define LAST 4133894400LL
+
+#define DAY 86400LL
+
+/* Pseudo-random times compared */
+#define RANDOM_TIMES 20000
+
+/* Differences printed at most */
+#define SHOW_MAX 5
+
+static struct zone_batch batch;
+static size_t batched;
+static unsigned long compared, skipped, differ;
+
+static void
+show(const char *what, long long t, const struct tm *a, const struct tm *b)
+{
+	if(++differ > SHOW_MAX)
+		return;
+	printf("%s: %s at %lld: %04d-%02d-%02d %02d:%02d:%02d w%d dst%d, "
+	       "C library %04d-%02d-%02d %02d:%02d:%02d w%d dst%d\n",
+	       getenv("TZ"), what, t,
+	       a->tm_year + 1900, a->tm_mon + 1, a->tm_mday, a->tm_hour,
+	       a->tm_min, a->tm_sec, a->tm_wday, a->tm_isdst,
+	       b->tm_year + 1900, b->tm_mon + 1, b->tm_mday, b->tm_hour,
+	       b->tm_min, b->tm_sec, b->tm_wday, b->tm_isdst);
+}
+
+static int
+tm_differ(const struct tm *a, const struct tm *b)
+{
+	return a->tm_year != b->tm_year || a->tm_mon != b->tm_mon ||
+		a->tm_mday != b->tm_mday || a->tm_hour != b->tm_hour ||
+		a->tm_min != b->tm_min || a->tm_sec != b->tm_sec ||
+		a->tm_wday != b->tm_wday || a->tm_isdst != b->tm_isdst;
+}
+
+/*
+ * Compare the batch converted so far, then start a new one.
+ */
+static void
+batch_check(void)
+{
+	struct tm a, b;
+	time_t t;
+	size_t i;
+
+	zone_localtime_batch(&batch, batched);
+	for(i = 0; i < batched; i++) {
+		t = batch.t[i];
+		localtime_r(&t, &b);
+		if(zone_batch_tm(&batch, i, &a) == 0 && tm_differ(&a, &b))
+			show("batch", batch.t[i], &a, &b);
+	}
+	batched = 0;
+}
+
+/*
+ * Compare the conversions of t.
+ */
+static void
+check(long long t)
+{
+	struct tm a, b;
+	time_t tt = t, back;
+
+	batch.t[batched++] = t;
+	if(batched == ZONE_BATCH)
+		batch_check();
+
+	localtime_r(&tt, &b);
+	if(zone_localtime(tt, &a) < 0) {
+		++skipped;
+		return;
+	}
+	++compared;
+	if(tm_differ(&a, &b)) {
+		show("localtime", t, &a, &b);
+		return;
+	}
+
+	/* A local time naming a single instant must name t */
+	if(zone_mktime(&b, &back) == 1 && back != tt)
+		show("mktime", t, &a, &b);
+}
+
+/*
+ * Offset and daylight saving flag of t according to the C library.
+ */
+static long long
+key(long long t)
+{
+	time_t tt = t;
+	struct tm tm;
+
+	localtime_r(&tt, &tm);
+	return (long long)tm.tm_gmtoff * 2 + (tm.tm_isdst > 0);
+}
+
+int
+main(void)
+{
+	static const long long around[] = {
+		-7200, -3600, -1800, -1, 0, 1, 1800, 3600, 7200
+	};
+	long long t, lo, hi, mid, k, r;
+	unsigned long changes = 0;
+	size_t i;
+
+	tzset();
+	zone_init();
+
+	k = key(FIRST);
+	for(t = FIRST + DAY; t <= LAST; t += DAY) {
+		if(key(t) == k)
+			continue;
+		for(lo = t - DAY, hi = t; hi - lo > 1;) {
+			mid = lo + (hi - lo) / 2;
+			if(key(mid) == k)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		for(i = 0; i < sizeof around / sizeof *around; i++)
+			check(hi + around[i]);
+		k = key(t);
+		++changes;
+	}
+
+	srand(1);
+	for(i = 0; i < RANDOM_TIMES; i++) {
+		r = ((long long)rand() << 31 ^ rand()) % (LAST - FIRST);
+		check(FIRST + r);
+	}
+	batch_check();
+
+	if(differ || getenv("VERBOSE"))
+		printf("%s: %lu changes, %lu times compared, %lu left to the "
+		       "C library, %lu differ\n", getenv("TZ"), changes,
+		       compared, skipped, differ);
+
+	return differ != 0;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# The zone engine must convert times as the C library does. It is
+# compared in zones chosen for their oddities, in POSIX TZ strings
+# alone, and in every zone installed.
+#
+
+COMPARE=${ZONE_COMPARE:-./zone-compare}
+TZDIR=${TZDIR:-/usr/share/zoneinfo}
+[ -x "$COMPARE" ] || exit 99
+[ -d "$TZDIR" ] || exit 77
+
+fail=0
+compare() {
+	TZ=$1 "$COMPARE" || fail=1
+}
+
+# 30 minute DST step; negative DST; a table that ends long before
+# 2100, the rest following the TZ string; DST in winter
+for zone in Australia/Lord_Howe Europe/Dublin Africa/Casablanca \
+	America/Sao_Paulo Europe/Berlin America/New_York Asia/Kolkata \
+	Pacific/Chatham America/Nuuk Antarctica/Troll; do
+	[ -f "$TZDIR/$zone" ] && compare "$zone"
+done
+
+# Rules only: with odd offsets, negative DST and negative hours
+for rule in 'CET-1CEST,M3.5.0,M10.5.0/3' \
+	'<+1030>-10:30<+11>-11,M10.1.0,M4.1.0' \
+	'IST-1GMT0,M10.5.0,M3.5.0/1' \
+	'<-03>3<-02>,M3.5.0/-2,M10.5.0/-1' \
+	'AEST-10AEDT,M10.1.0,M4.1.0/3' \
+	'EST5EDT,M3.2.0,M11.1.0' 'JST-9' 'UTC0'; do
+	compare "$rule"
+done
+
+# Everything installed; leap second zones are a matter of their own
+for file in $(cd "$TZDIR" && find . -type f ! -path './right/*' \
+		! -path './posix/*' | sort); do
+	zone=${file#./}
+	[ "$(head -c 4 "$TZDIR/$zone")" = TZif ] && compare "$zone"
+done
+
+exit $fail